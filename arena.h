@@ -0,0 +1,113 @@
+// arena.h
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/TypeName.h"
+
+// Small dense id per type ever allocated in an arena, so objects can be counted per class
+// (--stats) with one vector increment; shared by every arena/thread.
+struct ArenaTypeRegistry {
+  std::mutex Lock;
+  std::vector<llvm::StringRef> Names;   // id -> class name
+};
+inline ArenaTypeRegistry &arenaTypes() {
+  static ArenaTypeRegistry registry;
+  return registry;
+}
+inline unsigned arenaTypeId(llvm::StringRef Name) {
+  ArenaTypeRegistry &r = arenaTypes();
+  std::lock_guard<std::mutex> guard(r.Lock);
+  r.Names.push_back(Name);
+  return r.Names.size() - 1;
+}
+// one id per class T, whatever constructor arguments ASTArena::make is called with
+template <class T>
+unsigned arenaTypeIdOf() {
+  static const unsigned id = arenaTypeId(llvm::getTypeName<T>());
+  return id;
+}
+inline llvm::StringRef arenaTypeName(unsigned Id) {
+  ArenaTypeRegistry &r = arenaTypes();
+  std::lock_guard<std::mutex> guard(r.Lock);
+  return r.Names[Id];
+}
+
+// Bump-pointer arena that owns the whole AST of one compilation plus the interned
+// identifier / string literal texts the lexer hands out. Nothing is freed one by one:
+// reset() runs the few destructors that matter (nodes holding a std::vector) and drops
+// every slab at once after codegen. The texts have slabs of their own, so --stream can drop
+// the nodes of each statement (releaseNodes) and keep the names.
+class ASTArena {
+  llvm::BumpPtrAllocator Alloc;       // nodes
+  llvm::BumpPtrAllocator NameAlloc;   // interned texts
+  std::unique_ptr<llvm::UniqueStringSaver> Names;
+  std::vector<std::pair<void*, void (*)(void*)>> Dtors;   // objects needing a destructor call
+  size_t NumObjects = 0;
+  size_t PeakBytes = 0;   // of Alloc, before releaseNodes() emptied it
+  std::vector<size_t> PerType;   // objects by arenaTypeId
+
+public:
+  ASTArena() : Names(new llvm::UniqueStringSaver(NameAlloc)) {}
+  ~ASTArena() { reset(); }
+  ASTArena(const ASTArena&) = delete;
+  ASTArena& operator=(const ASTArena&) = delete;
+
+  template <class T, class... Args>
+  T* make(Args&&... args) {
+    void *mem = Alloc.Allocate(sizeof(T), alignof(T));
+    T *obj = new (mem) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value)
+      Dtors.emplace_back(obj, [](void *p) { static_cast<T*>(p)->~T(); });
+    ++NumObjects;
+    unsigned typeId = arenaTypeIdOf<T>();
+    if (typeId >= PerType.size())
+      PerType.resize(typeId + 1);
+    ++PerType[typeId];
+    return obj;
+  }
+
+  // One copy per distinct text; the result is NUL terminated and lives until reset()
+  llvm::StringRef intern(llvm::StringRef S) { return Names->save(S); }
+
+  void reset() {
+    releaseNodes();
+    Names.reset(new llvm::UniqueStringSaver(NameAlloc));
+    NameAlloc.Reset();
+    PeakBytes = 0;
+    NumObjects = 0;
+    PerType.clear();
+  }
+
+  // every node made so far is gone, the interned texts stay (the counts by class keep growing)
+  void releaseNodes() {
+    for (auto it = Dtors.rbegin(); it != Dtors.rend(); ++it)
+      it->second(it->first);
+    Dtors.clear();
+    PeakBytes = std::max(PeakBytes, Alloc.getBytesAllocated());
+    Alloc.Reset();
+  }
+
+  size_t objects() const { return NumObjects; }
+  // (class name, objects) for every class allocated since the last reset()
+  std::vector<std::pair<std::string, size_t>> objectsByType() const {
+    std::vector<std::pair<std::string, size_t>> counts;
+    for (size_t id = 0; id < PerType.size(); ++id)
+      if (PerType[id])
+        counts.emplace_back(arenaTypeName(id).str(), PerType[id]);
+    return counts;
+  }
+  size_t bytesUsed() const { return Alloc.getBytesAllocated() + NameAlloc.getBytesAllocated(); }
+  size_t bytesReserved() const { return Alloc.getTotalMemory() + NameAlloc.getTotalMemory(); }
+  // most node bytes live at once (releaseNodes) plus the texts
+  size_t peakBytes() const { return std::max(PeakBytes, Alloc.getBytesAllocated()) + NameAlloc.getBytesAllocated(); }
+};
@@ -1,4 +1,9 @@
 #include "ast.h"
+#include "arena.h"
+#include "compilation.h"
+#include "profile.h"
+#include "split.h"
+#include "stats.h"
 #include <vector>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Constants.h>
@@ -8,12 +13,671 @@
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/ADT/StringMap.h>
+#include <algorithm>
 #include <map>
+#include <cstdio>
+#include <cassert>
 using namespace llvm;
 using namespace std;
-static std::map<std::string, llvm::AllocaInst*> SymbolTable;
-std::map<std::string, BasicBlock*> LabelBlocks;
- static std::map<std::string, llvm::GlobalVariable*> ArrayTable;  // holds array names
+static FastMathFlags defaultBlockFastMath() {
+FastMathFlags fmf;
+fmf.setAllowReassoc();
+fmf.setAllowContract();
+fmf.setNoSignedZeros();
+fmf.setAllowReciprocal();
+return fmf;
+}
+
+EchoLowering EchoMode = EchoLowering::Runtime;
+int ParallelThreads = 0;
+FastMathFlags ProgramFastMath, BlockFastMath = defaultBlockFastMath();
+
+void resetCodegenOptions() {
+EchoMode = EchoLowering::Runtime;
+ParallelThreads = 0;
+ProgramFastMath = FastMathFlags();
+BlockFastMath = defaultBlockFastMath();
+}
+
+bool parseFastMathFlags(StringRef List, FastMathFlags &Flags) {
+SmallVector<StringRef, 8> names;
+List.split(names, ',', -1, /*KeepEmpty=*/false);
+for (StringRef name : names) {
+  if      (name == "fast")     Flags.setFast();
+  else if (name == "reassoc")  Flags.setAllowReassoc();
+  else if (name == "contract") Flags.setAllowContract();
+  else if (name == "nnan")     Flags.setNoNaNs();
+  else if (name == "ninf")     Flags.setNoInfs();
+  else if (name == "nsz")      Flags.setNoSignedZeros();
+  else if (name == "arcp")     Flags.setAllowReciprocal();
+  else if (name == "afn")      Flags.setApproxFunc();
+  else return false;
+}
+return true;
+}
+
+// ----------------------------------------------------------the compilation this thread is generating code for
+static thread_local Compilation *ActiveCompilation = nullptr;
+
+Compilation &currentCompilation() {
+assert(ActiveCompilation && "codegen outside of a CompilationScope");
+return *ActiveCompilation;
+}
+
+CompilationScope::CompilationScope(Compilation &C) : Prev(ActiveCompilation) { ActiveCompilation = &C; }
+CompilationScope::~CompilationScope() { ActiveCompilation = Prev; }
+
+// ----------------------------------------------------------name resolution
+// Labels are visible everywhere (MOVE TO can jump forward), so they are collected first
+// (--stream: a label gets its slot on first mention, see StreamingCodegen).
+// Variables and arrays are bound in textual order, the same order codegen emits them in:
+// a use sees the most recent ENTER / ENSEMBLE of that name, a redeclaration gets a fresh slot.
+class Resolver {
+  StringMap<int> Vars, Arrays, Labels;   // name -> slot currently visible
+  unsigned NumVars = 0, NumArrays = 0;
+  std::vector<size_t> ArraySizes;        // ENSEMBLE slot -> element count
+  Compilation &C;
+public:
+  unsigned Errors = 0;
+  int ElementTarget = -1;   // inside the RHS of a whole-ENSEMBLE assignment: its ENSEMBLE slot
+  std::vector<int> *LengthChecks = nullptr;   // ... and where ENSEMBLEs of run-time size go
+
+  // inside a PARALLEL body: every variable read / assignment in textual order (see classifyParallelVars)
+  struct VarAccess {
+    int Slot;
+    const Assign *Writer;   // null for a read
+    int Depth;              // REPEATs between the access and the PARALLEL loop
+  };
+  std::vector<VarAccess> *Accesses = nullptr;
+  int LoopDepth = 0;
+
+  explicit Resolver(Compilation &c) : C(c) {}
+  void error(const char *What, StringRef Name) {
+    fprintf(stderr, "%s: error: %s '%.*s'\n", C.InputName.c_str(), What, (int)Name.size(), Name.data());
+    ++Errors;
+  }
+  void error(const char *What) {
+    fprintf(stderr, "%s: error: %s\n", C.InputName.c_str(), What);
+    ++Errors;
+  }
+  void collectLabels(const std::vector<ASTNode*> &Stmts);
+
+  int declareVar(StringRef Name) {
+    VarNames.push_back(Name);
+    return Vars[Name] = NumVars++;
+  }
+  int declareArray(StringRef Name, size_t Count) {
+    ArraySizes.push_back(Count);
+    return Arrays[Name] = NumArrays++;
+  }
+  int lookup(const StringMap<int> &Table, StringRef Name, const char *What) {
+    auto it = Table.find(Name);
+    if (it == Table.end()) { error(What, Name); return -1; }
+    return it->second;
+  }
+  int var(StringRef Name) { return noteAccess(lookupVar(Name), nullptr); }
+  int assignedVar(StringRef Name, const Assign *A) { return noteAccess(lookupVar(Name), A); }
+  StringRef varName(int Slot) const { return VarNames[Slot]; }
+  bool isVar(StringRef Name) const { return Vars.count(Name); }
+  bool isArray(StringRef Name) const { return Arrays.count(Name); }
+  size_t arraySize(int Slot) const { return Slot >= 0 ? ArraySizes[Slot] : 0; }
+  bool knownSize(int Slot) const { return arraySize(Slot) != ArrayDecl::FileSized; }
+  int array(StringRef Name) { return lookup(Arrays, Name, "undefined ENSEMBLE"); }
+  int label(StringRef Name) { return Streaming ? streamedLabel(Name) : lookup(Labels, Name, "undefined label"); }
+  int labelSlot(StringRef Name) {   // Label nodes: already collected
+    if (!Streaming)
+      return Labels.lookup(Name);
+    int slot = streamedLabel(Name);
+    if (LabelDefined[slot]) {
+      error("duplicate label", Name);
+      return -1;
+    }
+    LabelDefined[slot] = true;
+    return slot;
+  }
+  bool Streaming = false;
+  std::vector<bool> LabelDefined;   // --stream: label slot -> its Label has been seen
+  int spin(StringRef Target) {
+    C.SpinTargets.push_back(Target);
+    return C.SpinTargets.size() - 1;
+  }
+
+  unsigned numVars() const { return NumVars; }
+  unsigned numArrays() const { return NumArrays; }
+private:
+  std::vector<StringRef> VarNames;       // variable slot -> name
+  int lookupVar(StringRef Name) {
+    if (!Vars.count(Name) && Arrays.count(Name)) {
+      error("ENSEMBLE used as a number (index it, or use SUM/MIN/MAX/DOT)", Name);
+      return -1;
+    }
+    return lookup(Vars, Name, "undefined variable");
+  }
+  int streamedLabel(StringRef Name) {
+    auto ins = Labels.insert({ Name, (int)C.LabelNames.size() });
+    if (ins.second) {
+      C.LabelNames.push_back(Name);
+      LabelDefined.push_back(false);
+    }
+    return ins.first->second;
+  }
+  int noteAccess(int Slot, const Assign *Writer) {
+    if (Accesses && Slot >= 0)
+      Accesses->push_back({ Slot, Writer, LoopDepth });
+    return Slot;
+  }
+};
+
+void Resolver::collectLabels(const std::vector<ASTNode*> &Stmts) {
+for (ASTNode *stmt : Stmts) {
+  if (auto *lbl = dynamic_cast<Label*>(stmt)) {
+    if (!Labels.insert({lbl->Name, (int)C.LabelNames.size()}).second)
+      error("duplicate label", lbl->Name);
+    else
+      C.LabelNames.push_back(lbl->Name);
+  } else if (auto *loop = dynamic_cast<Repeat*>(stmt)) {
+    collectLabels(loop->Body);
+  }
+}
+}
+
+unsigned resolveNames(Compilation &C) {
+C.LabelNames.clear();
+C.SpinTargets.clear();
+Resolver R(C);
+R.collectLabels(*C.Program);
+for (ASTNode *stmt : *C.Program)
+  stmt->resolve(R);
+C.VarSlots.assign(R.numVars(), nullptr);
+C.ArraySlots.assign(R.numArrays(), nullptr);
+C.ArrayLengths.assign(R.numArrays(), nullptr);
+C.LabelSlots.assign(C.LabelNames.size(), nullptr);
+C.Errors += R.Errors;
+return R.Errors;
+}
+
+void createLabelBlocks(Compilation &C, Function *F) {
+for (size_t i = 0; i < C.LabelNames.size(); ++i)
+  C.LabelSlots[i] = BasicBlock::Create(F->getContext(), C.LabelNames[i], F);
+}
+
+// ----------------------------------------------------------streaming (--stream)
+StreamingCodegen::StreamingCodegen(Compilation &C, Module &M, IRBuilder<> &Builder)
+  : C(C), M(M), Builder(Builder), R(new Resolver(C)) {
+C.LabelNames.clear();
+C.SpinTargets.clear();
+R->Streaming = true;
+}
+
+StreamingCodegen::~StreamingCodegen() = default;
+
+void StreamingCodegen::statement(ASTNode *Stmt) {
+Stmt->resolve(*R);
+C.VarSlots.resize(R->numVars(), nullptr);
+C.ArraySlots.resize(R->numArrays(), nullptr);
+C.ArrayLengths.resize(R->numArrays(), nullptr);
+C.NonIntegerSlots.resize(R->numVars(), true);   // no inference: all doubles, which computes the same
+C.LabelSlots.resize(C.LabelNames.size(), nullptr);
+if (!R->Errors)   // after an error the rest is only resolved, for its diagnostics
+  Stmt->codegen(M.getContext(), Builder, &M);
+C.Arena.releaseNodes();
+}
+
+unsigned StreamingCodegen::finish() {
+for (size_t i = 0; i < C.LabelNames.size(); ++i)
+  if (!R->LabelDefined[i])
+    R->error("undefined label", C.LabelNames[i]);
+C.Errors += R->Errors;
+return R->Errors;
+}
+
+// the block of label slot Slot; with --stream it is made on first mention, with --split a label
+// of another segment of main is a block returning there
+static BasicBlock *labelBlock(int Slot, IRBuilder<> &ChoreoBuilder) {
+Compilation &C = currentCompilation();
+BasicBlock *&BB = C.LabelSlots[Slot];
+if (!BB && C.Segment)
+  BB = segmentExit(C, Slot);
+else if (!BB)
+  BB = BasicBlock::Create(ChoreoBuilder.getContext(), C.LabelNames[Slot], ChoreoBuilder.GetInsertBlock()->getParent());
+return BB;
+}
+
+// the stack slot of variable slot Slot (null before its ENTER); a segment of main (--split)
+// makes its own copy on first use
+static AllocaInst *varSlot(int Slot, StringRef Name) {
+Compilation &C = currentCompilation();
+AllocaInst *&slot = C.VarSlots[Slot];
+if (!slot && C.Segment)
+  slot = segmentVariable(C, Slot, Name);
+return slot;
+}
+
+// a bare ENSEMBLE name is only a value inside a whole-ENSEMBLE assignment (variables win)
+void VariableExpr::resolve(Resolver &R) {
+if (R.ElementTarget >= 0 && !R.isVar(Name) && R.isArray(Name)) {
+  ArraySlot = R.array(Name);
+  if (ArraySlot < 0 || ArraySlot == R.ElementTarget)
+    return;
+  if (!R.knownSize(ArraySlot) || !R.knownSize(R.ElementTarget)) {
+    // sized by its file: compared when the assignment runs
+    if (std::find(R.LengthChecks->begin(), R.LengthChecks->end(), ArraySlot) == R.LengthChecks->end())
+      R.LengthChecks->push_back(ArraySlot);
+  } else if (R.arraySize(ArraySlot) != R.arraySize(R.ElementTarget)) {
+    R.error("ENSEMBLE size differs from the assigned ENSEMBLE", Name);
+  }
+  return;
+}
+Slot = R.var(Name);
+}
+void VarDecl::resolve(Resolver &R) { Init->resolve(R); Slot = R.declareVar(Name); }   // ENTER x = x + 1 reads the old x
+void EchoVar::resolve(Resolver &R) { Slot = R.var(Name); }
+void Label::resolve(Resolver &R) { Slot = R.labelSlot(Name); }
+void Jump::resolve(Resolver &R) { Slot = R.label(Target); }
+void BinaryExpr::resolve(Resolver &R) { Left->resolve(R); Right->resolve(R); }
+void Assign::resolve(Resolver &R) {
+if (R.isVar(LHS) || !R.isArray(LHS)) {
+  RHS->resolve(R);
+  Slot = R.assignedVar(LHS, this);
+  return;
+}
+ArraySlot = R.array(LHS);
+R.ElementTarget = ArraySlot;
+R.LengthChecks = &LengthChecks;
+RHS->resolve(R);
+R.ElementTarget = -1;
+R.LengthChecks = nullptr;
+}
+void ComparisonExpr::resolve(Resolver &R) { Left->resolve(R); Right->resolve(R); }
+void IfStmt::resolve(Resolver &R) { Cond->resolve(R); Slot = R.label(Label); Spin = R.spin(Label); }
+
+// statements that cannot run in a PARALLEL body: output would come out in any order, jumps
+// would leave the outlined body, declarations would only exist in one thread
+static void checkParallelBody(const std::vector<ASTNode*> &Body, Resolver &R) {
+for (ASTNode *stmt : Body) {
+  if (dynamic_cast<EchoStr*>(stmt) || dynamic_cast<EchoVar*>(stmt) || dynamic_cast<EchoIndexedVar*>(stmt))
+    R.error("ECCO inside a PARALLEL loop (its iterations run in no particular order)");
+  else if (dynamic_cast<SaveArray*>(stmt))
+    R.error("SAVE inside a PARALLEL loop (every iteration would write the file)");
+  else if (dynamic_cast<Label*>(stmt) || dynamic_cast<Jump*>(stmt) || dynamic_cast<IfStmt*>(stmt))
+    R.error("labels, MOVE TO and SPIN cannot be used inside a PARALLEL loop");
+  else if (auto *decl = dynamic_cast<VarDecl*>(stmt))
+    R.error("ENTER inside a PARALLEL loop (declare it before the loop)", decl->Name);
+  else if (dynamic_cast<ArrayDecl*>(stmt))
+    R.error("ENSEMBLE declared inside a PARALLEL loop");
+  else if (auto *loop = dynamic_cast<Repeat*>(stmt))
+    checkParallelBody(loop->Body, R);
+}
+}
+
+// s = s + e1 - e2 ... or s = s * e1 * e2: '+' / '*' when Slot is the leftmost operand of a
+// chain of those operators (s + a + b parses as (s + a) + b), else 0
+static char accumulationOp(const ASTNode *Value, int Slot) {
+char kind = 0;
+while (auto *bin = dynamic_cast<const BinaryExpr*>(Value)) {
+  char k = bin->op() == '-' ? '+' : bin->op();
+  if ((k != '+' && k != '*') || (kind && k != kind))
+    return 0;
+  kind = k;
+  Value = bin->lhs();
+}
+auto *var = dynamic_cast<const VariableExpr*>(Value);
+return var && var->Slot == Slot ? kind : 0;
+}
+
+static std::vector<ParallelVar> classifyParallelVars(const std::vector<Resolver::VarAccess> &Accesses,
+                                                     Resolver &R) {
+struct Uses {
+  const Resolver::VarAccess *First = nullptr;
+  std::vector<const Resolver::VarAccess*> Writes;
+  size_t Reads = 0;
+};
+std::map<int, Uses> bySlot;   // ordered: the layout of the loop's context follows the slots
+for (const Resolver::VarAccess &a : Accesses) {
+  Uses &u = bySlot[a.Slot];
+  if (!u.First) u.First = &a;
+  if (a.Writer) u.Writes.push_back(&a);
+  else ++u.Reads;
+}
+
+std::vector<ParallelVar> vars;
+for (auto &entry : bySlot) {
+  const Uses &u = entry.second;
+  ParallelVar v{ entry.first, ParallelVar::Shared, 0, 0 };
+  if (!u.Writes.empty()) {
+    const Assign *only = u.Writes.size() == 1 && u.Writes[0]->Depth == 0 ? u.Writes[0]->Writer : nullptr;
+    auto *bin = only ? dynamic_cast<const BinaryExpr*>(only->rhs()) : nullptr;
+    auto *self = bin ? dynamic_cast<const VariableExpr*>(bin->lhs()) : nullptr;
+    auto *step = bin ? dynamic_cast<const NumberExpr*>(bin->rhs()) : nullptr;
+    char kind = accumulationOp(u.Writes[0]->Writer->rhs(), v.Slot);
+    for (auto *w : u.Writes)
+      if (accumulationOp(w->Writer->rhs(), v.Slot) != kind)
+        kind = 0;
+
+    if (u.First->Writer && u.First->Depth == 0) {
+      v.Use = ParallelVar::Private;
+    } else if (self && self->Slot == v.Slot && step && step->isIntegral() &&
+               (bin->op() == '+' || bin->op() == '-')) {
+      v.Use = ParallelVar::Induction;
+      v.Step = bin->op() == '+' ? step->Val : -step->Val;
+    } else if (kind && u.Reads == u.Writes.size()) {   // no other reads of s, in e or elsewhere
+      v.Use = ParallelVar::Reduction;
+      v.Op = kind;
+    } else {
+      R.error("variable carries a value from one PARALLEL iteration to the next", R.varName(v.Slot));
+      continue;
+    }
+  }
+  vars.push_back(v);
+}
+return vars;
+}
+
+void Repeat::resolve(Resolver &R) {
+// trips() is an i64: ceil(Count) has to fit
+if (!(std::ceil(Count) < 9223372036854775808.0))
+  R.error("REPEAT count too large (at most 2^63 - 1 trips)");
+if (!Hints.Parallel) {
+  ++R.LoopDepth;
+  for (auto *stmt : Body) stmt->resolve(R);
+  --R.LoopDepth;
+  return;
+}
+if (R.Accesses)
+  R.error("PARALLEL loop inside a PARALLEL loop");
+checkParallelBody(Body, R);
+std::vector<Resolver::VarAccess> accesses;
+std::vector<Resolver::VarAccess> *outer = R.Accesses;
+int outerDepth = R.LoopDepth;
+R.Accesses = &accesses;
+R.LoopDepth = 0;
+for (auto *stmt : Body) stmt->resolve(R);
+R.Accesses = outer;
+R.LoopDepth = outerDepth;
+ParallelVars = classifyParallelVars(accesses, R);
+}
+void ArrayDecl::resolve(Resolver &R) {
+// every pass through the loop would map the file again and leak the previous mapping
+if (!Path.empty() && (R.LoopDepth > 0 || R.Accesses))
+  R.error("ENSEMBLE ... FROM inside a REPEAT (declare it before the loop)", Name);
+Slot = R.declareArray(Name, Count);
+}
+void SaveArray::resolve(Resolver &R) { Slot = R.array(Name); }
+void IndexExpr::resolve(Resolver &R) {
+Slot = R.array(Name);
+// a[0] in `a = a + a[0]` would see a[0] change halfway through the assignment
+if (Slot >= 0 && Slot == R.ElementTarget)
+  R.error("ENSEMBLE indexed in its own whole-ENSEMBLE assignment", Name);
+Idx->resolve(R);
+}
+void StoreToIndex::resolve(Resolver &R) { Slot = R.array(Name); Idx->resolve(R); RHS->resolve(R); }
+void EchoIndexedVar::resolve(Resolver &R) { Slot = R.array(Name); Idx->resolve(R); }
+void ReduceExpr::resolve(Resolver &R) {
+// the element loop would redo the whole reduction for every element (and see it change)
+if (R.ElementTarget >= 0)
+  R.error("reduction inside a whole-ENSEMBLE assignment (assign it to a variable first)", Name);
+Slot = R.array(Name);
+if (Op == Dot) {
+  Slot2 = R.array(Name2);
+  if (Slot >= 0 && Slot2 >= 0 && R.knownSize(Slot) && R.knownSize(Slot2) &&
+      R.arraySize(Slot) != R.arraySize(Slot2))
+    R.error("DOT of ENSEMBLEs of different sizes", Name2);
+}
+}
+
+// ----------------------------------------------------------integer type inference
+// A variable gets an i64 slot only where that cannot change a result: every value it ever holds,
+// and every intermediate of the + - * computing one, is provably an integer below 2^53 in
+// magnitude, where double arithmetic is exact too (and no 0 * -1 = -0.0 can come up). Everything
+// else stays a double, as with --stream, which infers nothing: x = x * 2 seventy times is 2^70.
+//
+// The ranges are a fixpoint over all ENTERs / assignments, flow-insensitive: a variable's range
+// covers 0 (a zeroed slot) and every value assigned to it. An assignment reading its own target
+// is only understood as an increment x = x + e1 - e2 ..., which moves x by at most as much as the
+// statement runs times the step: REPEAT trips, no bound where a backward MOVE TO / SPIN (or one
+// into a REPEAT body) can run it again. Any other kind, a range past 2^53 or a range still growing
+// after MaxRounds rounds demotes the variable to double, and so whatever depends on it.
+static const double IntegerLimit = 9007199254740992.0;   // 2^53
+static const double Unbounded = HUGE_VAL;
+
+static bool fitsInteger(const ValueRange &Range) {
+return std::fabs(Range.Lo) < IntegerLimit && std::fabs(Range.Hi) < IntegerLimit;   // NaN never fits
+}
+
+bool ASTNode::isIntegral() const {
+ValueRange range;
+return valueRange(range);
+}
+
+bool NumberExpr::valueRange(ValueRange &Range) const {
+Range = { Val, Val };
+return Val == std::trunc(Val) && !std::signbit(Val) && fitsInteger(Range);   // 0.0 is not -0.0
+}
+
+bool IntegerExpr::valueRange(ValueRange &Range) const {
+Range = { (double)Val, (double)Val };
+return fitsInteger(Range);
+}
+
+bool VariableExpr::valueRange(ValueRange &Range) const {
+if (ArraySlot >= 0 || !isIntegerVar(Slot))
+  return false;
+Range = currentCompilation().VarRanges[Slot];
+return fitsInteger(Range);
+}
+
+bool BinaryExpr::valueRange(ValueRange &Range) const {
+ValueRange l, r;
+if (Op == '/' || !Left->valueRange(l) || !Right->valueRange(r))
+  return false;
+switch (Op) {
+case '+': Range = { l.Lo + r.Lo, l.Hi + r.Hi }; break;
+case '-': Range = { l.Lo - r.Hi, l.Hi - r.Lo }; break;
+case '*': {
+  // 0 times a negative number is -0.0 as a double, which prints as -0
+  if ((l.Lo <= 0 && l.Hi >= 0 && r.Lo < 0) || (r.Lo <= 0 && r.Hi >= 0 && l.Lo < 0))
+    return false;
+  double p[] = { l.Lo * r.Lo, l.Lo * r.Hi, l.Hi * r.Lo, l.Hi * r.Hi };
+  Range = { *std::min_element(p, p + 4), *std::max_element(p, p + 4) };
+  break;
+}
+default: return false;
+}
+return fitsInteger(Range);   // rounding only ever takes a result past 2^53 to 2^53, never below
+}
+
+bool isIntegerVar(int Slot) {
+return Slot >= 0 && !currentCompilation().NonIntegerSlots[Slot];
+}
+
+namespace {
+class IntegerInference {
+  Compilation &C;
+  std::vector<const ASTNode*> Order;   // the statements in program order, REPEAT bodies after their REPEAT
+  std::vector<int> Parent;             // ... the enclosing REPEAT (-1: top level)
+  std::vector<size_t> End;             // ... a REPEAT: the position after its body
+  std::vector<double> Runs;            // ... how often it may run
+  std::vector<ValueRange> Assigned, Drift;   // this round: variable slot -> hull of assigned values / sum of increments
+  bool Changed = false;
+public:
+  static const int MaxRounds = 64;
+  explicit IntegerInference(Compilation &C) : C(C) {}
+  void countRuns();
+  void round();
+  bool changed() const { return Changed; }
+  bool Last = false;   // after MaxRounds: demote what still grows
+private:
+  void number(const std::vector<ASTNode*> &Stmts, int Loop);
+  void runs(const std::vector<ASTNode*> &Stmts, double Times, const std::vector<int> &Again, int &Open, size_t &Pos);
+  void assignment(int Slot, const ASTNode *Value, double Times);
+  void widen(int Slot);
+  void demote(int Slot) { C.NonIntegerSlots[Slot] = true; Changed = true; }
+};
+}
+
+void IntegerInference::number(const std::vector<ASTNode*> &Stmts, int Loop) {
+for (ASTNode *stmt : Stmts) {
+  size_t pos = Order.size();
+  Order.push_back(stmt);
+  Parent.push_back(Loop);
+  End.push_back(pos + 1);
+  if (auto *loop = dynamic_cast<Repeat*>(stmt)) {
+    number(loop->Body, pos);
+    End[pos] = Order.size();
+  }
+}
+}
+
+// Runs: REPEAT trips multiply down the nesting; a jump back to a label (or one into a REPEAT
+// body from outside it) runs everything from the label to the jump (that whole REPEAT) again
+void IntegerInference::countRuns() {
+number(*C.Program, -1);
+std::vector<size_t> labelAt(C.LabelNames.size(), 0);
+std::vector<std::pair<size_t, int>> jumps;   // (position, label slot)
+for (size_t i = 0; i < Order.size(); ++i) {
+  if (auto *lbl = dynamic_cast<const Label*>(Order[i])) {
+    if (lbl->Slot >= 0) labelAt[lbl->Slot] = i;
+  } else if (auto *jump = dynamic_cast<const Jump*>(Order[i])) {
+    if (jump->Slot >= 0) jumps.push_back({ i, jump->Slot });
+  } else if (auto *spin = dynamic_cast<const IfStmt*>(Order[i])) {
+    if (spin->target() >= 0) jumps.push_back({ i, spin->target() });
+  }
+}
+std::vector<int> again(Order.size() + 1, 0);   // difference array over the positions that may run again
+for (const std::pair<size_t, int> &j : jumps) {
+  size_t at = labelAt[j.second];
+  if (at <= j.first) {
+    ++again[at];
+    --again[j.first + 1];
+  }
+  for (int r = Parent[at]; r >= 0 && !((size_t)r <= j.first && j.first < End[r]); r = Parent[r]) {
+    ++again[r];
+    --again[End[r]];
+  }
+}
+Runs.assign(Order.size(), 0);
+int open = 0;
+size_t pos = 0;
+runs(*C.Program, 1, again, open, pos);
+}
+
+void IntegerInference::runs(const std::vector<ASTNode*> &Stmts, double Times, const std::vector<int> &Again,
+                            int &Open, size_t &Pos) {
+for (ASTNode *stmt : Stmts) {
+  Open += Again[Pos];
+  double times = Open > 0 ? Unbounded : Times;
+  Runs[Pos++] = times;
+  if (auto *loop = dynamic_cast<Repeat*>(stmt)) {
+    double trips = (double)loop->trips();
+    runs(loop->Body, trips == 0 ? 0 : times * trips, Again, Open, Pos);
+  }
+}
+}
+
+// x = e: e's range joins x's when e does not read x, x = x + e1 - e2 ... adds Times * (e1 - e2 ...)
+void IntegerInference::assignment(int Slot, const ASTNode *Value, double Times) {
+ValueRange range;
+if (!Value->valueRange(range)) {   // with x as it is: even the intermediates fit
+  demote(Slot);
+  return;
+}
+ValueRange &var = C.VarRanges[Slot], saved = var;
+var = { -Unbounded, Unbounded };   // now whatever reads x has no range
+if (Value->valueRange(range)) {
+  Assigned[Slot] = { std::min(Assigned[Slot].Lo, range.Lo), std::max(Assigned[Slot].Hi, range.Hi) };
+  var = saved;
+  widen(Slot);
+  return;
+}
+ValueRange step{ 0, 0 };
+const ASTNode *at = Value;
+const BinaryExpr *bin;
+while ((bin = dynamic_cast<const BinaryExpr*>(at)) && (bin->op() == '+' || bin->op() == '-') &&
+       bin->rhs()->valueRange(range)) {
+  step = bin->op() == '+' ? ValueRange{ step.Lo + range.Lo, step.Hi + range.Hi }
+                          : ValueRange{ step.Lo - range.Hi, step.Hi - range.Lo };
+  at = bin->lhs();
+}
+var = saved;
+auto *self = dynamic_cast<const VariableExpr*>(at);
+if (at == Value || !self || self->ArraySlot >= 0 || self->Slot != Slot) {
+  demote(Slot);
+  return;
+}
+auto times = [Times](double d) { return d == 0 ? 0 : Times * d; };   // no 0 * infinity
+Drift[Slot].Lo += times(std::min(0.0, step.Lo));
+Drift[Slot].Hi += times(std::max(0.0, step.Hi));
+widen(Slot);
+}
+
+// the variable's range takes in what this round found so far (the statements after see it)
+void IntegerInference::widen(int Slot) {
+ValueRange &var = C.VarRanges[Slot];
+ValueRange range{ std::min(var.Lo, Assigned[Slot].Lo + Drift[Slot].Lo),
+                  std::max(var.Hi, Assigned[Slot].Hi + Drift[Slot].Hi) };
+if (range.Lo == var.Lo && range.Hi == var.Hi)
+  return;
+if (!fitsInteger(range) || Last)
+  demote(Slot);
+var = range;
+Changed = true;
+}
+
+// one round over the program in order, each range growing as its assignments are seen
+void IntegerInference::round() {
+Changed = false;
+Assigned.assign(C.VarRanges.size(), ValueRange{ 0, 0 });
+Drift.assign(C.VarRanges.size(), ValueRange{ 0, 0 });
+for (size_t i = 0; i < Order.size(); ++i) {
+  int slot = -1;
+  const ASTNode *value = nullptr;
+  if (auto *decl = dynamic_cast<const VarDecl*>(Order[i])) {
+    slot = decl->Slot;
+    value = decl->Init;
+  } else if (auto *assign = dynamic_cast<const Assign*>(Order[i])) {
+    if (!assign->assignsElements()) {
+      slot = assign->slot();
+      value = assign->rhs();
+    }
+  }
+  if (isIntegerVar(slot))
+    assignment(slot, value, Runs[i]);
+}
+}
+
+void inferIntegerVariables(Compilation &C) {
+C.NonIntegerSlots.assign(C.VarSlots.size(), false);
+C.VarRanges.assign(C.VarSlots.size(), ValueRange{ 0, 0 });
+IntegerInference inference(C);
+inference.countRuns();
+int rounds = 0;
+do {
+  inference.Last = ++rounds >= IntegerInference::MaxRounds;
+  inference.round();
+} while (inference.changed());
+}
+
+// ----------------------------------------------------------conversions between i64 / double / i1 values
+static Value* toDouble(Value *V, IRBuilder<> &ChoreoBuilder) {
+if (!V || V->getType()->isDoubleTy()) return V;
+if (V->getType()->isIntegerTy(1))      // comparison result: 0.0 / 1.0
+  return ChoreoBuilder.CreateUIToFP(V, ChoreoBuilder.getDoubleTy(), "booltofp");
+return ChoreoBuilder.CreateSIToFP(V, ChoreoBuilder.getDoubleTy(), "itofp");
+}
+
+static Value* toInt64(Value *V, IRBuilder<> &ChoreoBuilder) {
+if (!V || V->getType()->isIntegerTy(64)) return V;
+if (V->getType()->isIntegerTy())
+  return ChoreoBuilder.CreateZExt(V, ChoreoBuilder.getInt64Ty(), "booltoi");
+return ChoreoBuilder.CreateFPToSI(V, ChoreoBuilder.getInt64Ty(), "fptoi");
+}
+
+static Value* toType(Value *V, Type *Ty, IRBuilder<> &ChoreoBuilder) {
+return Ty->isDoubleTy() ? toDouble(V, ChoreoBuilder) : toInt64(V, ChoreoBuilder);
+}
 
 // ----------------------------------------------------------Number literal e.g 6
 llvm::Value* NumberExpr::codegen(llvm::LLVMContext &ChoreoContext,
@@ -22,17 +686,26 @@ llvm::Value* NumberExpr::codegen(llvm::LLVMContext &ChoreoContext,
 return llvm::ConstantFP::get(ChoreoContext, llvm::APFloat(Val));
 }
 
+static Value* loadElement(int Slot, Value *Idx, StringRef Name, IRBuilder<> &ChoreoBuilder, Module *ChoreoModule);
+
 //-----------------------------------------------------------load the value of any variable by looking up in the symbol table
 Value* VariableExpr::codegen(LLVMContext &ChoreoContext,
     IRBuilder<> &ChoreoBuilder,
     Module *ChoreoModule) {
-auto symbolTable_slot = SymbolTable[Name];
-//SymbolTable["x"] = someAllocInstPointer; //we can load/read the value of x by this and also store into it
+if (ArraySlot >= 0) {
+  // whole-ENSEMBLE assignment: the element its loop is at
+  Value *idx = currentCompilation().ElementIndex;
+  if (!currentCompilation().ArraySlots[ArraySlot] || !idx) return nullptr;
+  return loadElement(ArraySlot, idx, Name, ChoreoBuilder, ChoreoModule);
+}
+if (Slot < 0) return nullptr;
+auto symbolTable_slot = varSlot(Slot, Name);
+//VarSlots[Slot] = someAllocInstPointer; //we can load/read the value of x by this and also store into it
 if (!symbolTable_slot)
 return nullptr;
-Type *elemTy = Type::getDoubleTy(ChoreoContext);
+Type *elemTy = symbolTable_slot->getAllocatedType();   // double, or i64 for integer variables
 
-//Load the double by CreateLoad command
+//Load the value by CreateLoad command
 return ChoreoBuilder.CreateLoad(elemTy, symbolTable_slot, Name + "_ld");
 }
 
@@ -48,78 +721,106 @@ Function *func = ChoreoBuilder.GetInsertBlock()->getParent();
 // That ensures all stack allocations happen before any other code.
 IRBuilder<> tmpBuilder(&func->getEntryBlock(),
 func->getEntryBlock().begin());
-//Allocate a 'double' slot on the stack
-AllocaInst *symbolTable_slot = tmpBuilder.CreateAlloca(
-Type::getDoubleTy(ChoreoContext), nullptr, Name);
-// Remember this stack slot in our symbol table.
-SymbolTable[Name] = symbolTable_slot;
+//Allocate a 'double' slot on the stack ('i64' if inference proved it only holds integers)
+Type *slotTy = isIntegerVar(Slot) ? Type::getInt64Ty(ChoreoContext)
+                                  : Type::getDoubleTy(ChoreoContext);
+// a region --interp compiles has the slot already, holding the interpreter's value
+AllocaInst *symbolTable_slot = varSlot(Slot, Name);
+// Remember this stack slot under our variable slot.
+if (!symbolTable_slot)
+  symbolTable_slot = currentCompilation().VarSlots[Slot] = tmpBuilder.CreateAlloca(slotTy, nullptr, Name);
 //Store that initial value into our newly allocated slot.
 //Create a store instruction 
-Value *openingMove = Init->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
+Value *openingMove = toType(Init->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule),
+                            slotTy, ChoreoBuilder);
 return ChoreoBuilder.CreateStore(openingMove, symbolTable_slot);
 }
 
+//----------------------------------------------------------per-module constant pool (see ModuleConstants)
+static ModuleConstants& constantsFor(Module *ChoreoModule) {
+ModuleConstants &pool = currentCompilation().Constants;
+if (pool.Owner != ChoreoModule) {
+  pool = ModuleConstants();
+  pool.Owner = ChoreoModule;
+}
+return pool;
+}
+
+static Constant* internString(StringRef Str, IRBuilder<> &ChoreoBuilder, Module *ChoreoModule) {
+auto &pool = constantsFor(ChoreoModule).Strings;
+auto it = pool.find(Str);
+if (it != pool.end()) return it->second;
+GlobalVariable *gv = ChoreoBuilder.CreateGlobalString(Str, ".str", 0, ChoreoModule);
+Constant *zero = ChoreoBuilder.getInt32(0);
+Constant *ptr = ConstantExpr::getInBoundsGetElementPtr(gv->getValueType(), gv,
+                                                       ArrayRef<Constant*>{ zero, zero });
+pool.emplace(Str.str(), ptr);
+return ptr;
+}
+
+// i32 printf(i8*, ...)
+static FunctionCallee printfFor(IRBuilder<> &ChoreoBuilder, Module *ChoreoModule) {
+ModuleConstants &mc = constantsFor(ChoreoModule);
+if (!mc.Printf)
+  mc.Printf = ChoreoModule->getOrInsertFunction("printf",
+    FunctionType::get(ChoreoBuilder.getInt32Ty(), { ChoreoBuilder.getInt8PtrTy() }, /*isVarArg=*/true));
+return mc.Printf;
+}
+
+//----------------------------------------------------------runtime echo: choreo_echo_str(i8*, i64) / choreo_echo_f64(double)
+static Value* emitRuntimeEchoStr(StringRef Str, IRBuilder<> &ChoreoBuilder, Module *ChoreoModule) {
+ModuleConstants &mc = constantsFor(ChoreoModule);
+if (!mc.EchoStr)
+  mc.EchoStr = ChoreoModule->getOrInsertFunction("choreo_echo_str",
+    ChoreoBuilder.getVoidTy(), ChoreoBuilder.getInt8PtrTy(), ChoreoBuilder.getInt64Ty());
+Value *strPtr = internString(Str, ChoreoBuilder, ChoreoModule);
+return ChoreoBuilder.CreateCall(mc.EchoStr, { strPtr, ChoreoBuilder.getInt64(Str.size()) });
+}
+
+static Value* emitRuntimeEchoF64(Value *Val, IRBuilder<> &ChoreoBuilder, Module *ChoreoModule) {
+ModuleConstants &mc = constantsFor(ChoreoModule);
+if (!mc.EchoF64)
+  mc.EchoF64 = ChoreoModule->getOrInsertFunction("choreo_echo_f64",
+    ChoreoBuilder.getVoidTy(), ChoreoBuilder.getDoubleTy());
+return ChoreoBuilder.CreateCall(mc.EchoF64, { Val });
+}
+
 //----------------------------------------------------------echostr calls a printFunction on the formatted string
 Value* EchoStr::codegen(LLVMContext &ChoreoContext,
     IRBuilder<> &ChoreoBuilder,
     Module *ChoreoModule) {
-// Prepare format string "%s\n"
-static const char *fmt = "%s\n";
-// Build the i8* type for the format and the string
-Type *i8Ty    = Type::getInt8Ty(ChoreoContext);
-Type *i8PtrTy = PointerType::get(i8Ty, 0);
-
-// Build a printf signature: i32 printf(i8*, ...)
-std::vector<Type*> printfArgs{ i8PtrTy };   //printf function takes i8* pointer types as arguements 
-FunctionType *printfTy = FunctionType::get(
-Type::getInt32Ty(ChoreoContext), // return i32
-printfArgs,            // takes i8*
-true
-);
-//fetch the printf function in the module
-FunctionCallee printfFunc =
-ChoreoModule->getOrInsertFunction("printf", printfTy);
-
-// create the global constant string for formatted an dour original string
-Value *formatStrPtr = ChoreoBuilder.CreateGlobalStringPtr(fmt);
-Value *strPtr = ChoreoBuilder.CreateGlobalStringPtr(Str);
+if (EchoMode == EchoLowering::Runtime)
+  return emitRuntimeEchoStr(Str, ChoreoBuilder, ChoreoModule);
+
+// the pooled "%s\n" format and our original string
+Value *formatStrPtr = internString("%s\n", ChoreoBuilder, ChoreoModule);
+Value *strPtr = internString(Str, ChoreoBuilder, ChoreoModule);
 
 // Call printf(formatStrPtr, strPtr)
-return ChoreoBuilder.CreateCall(printfFunc, { formatStrPtr, strPtr });
+return ChoreoBuilder.CreateCall(printfFor(ChoreoBuilder, ChoreoModule), { formatStrPtr, strPtr });
 }
 
 //----------------------------------------------------------echovar calls print(var)
 Value* EchoVar::codegen(LLVMContext &ChoreoContext,
 IRBuilder<> &ChoreoBuilder,
 Module *ChoreoModule) {
-//find the alloca instant in the symbol table
-auto *symbolTable_slot = SymbolTable[Name];
+//find the alloca instant for the variable slot
+if (Slot < 0) return nullptr;
+auto *symbolTable_slot = varSlot(Slot, Name);
 if (!symbolTable_slot) return nullptr;
 
-//Load the variable’s value 
-Value *loaded = ChoreoBuilder.CreateLoad(
+//Load the variable’s value (printf wants a double even for integer variables)
+Value *loaded = toDouble(ChoreoBuilder.CreateLoad(
   symbolTable_slot->getAllocatedType(),
   symbolTable_slot,
-  Name.c_str()
-);
-
-// 3) Prepare printf("%f\n", val);
-//    (i8* format string, double)
-Value *formatStrPtr = ChoreoBuilder.CreateGlobalStringPtr("%f\n");
+  Name
+), ChoreoBuilder);
+if (EchoMode == EchoLowering::Runtime)
+  return emitRuntimeEchoF64(loaded, ChoreoBuilder, ChoreoModule);
 
-// Build the printf signature: i32 printf(i8*, ...)
-Type *i8Ty    = Type::getInt8Ty(ChoreoContext);
-Type *i8PtrTy = PointerType::getUnqual(i8Ty);
-FunctionType *printfTy = FunctionType::get(
-  ChoreoBuilder.getInt32Ty(),         // returns i32
-  { i8PtrTy },                  // takes one i8* argument 
-  /*isVarArg=*/true
-);
-FunctionCallee printfFunc =
-  ChoreoModule->getOrInsertFunction("printf", printfTy);
-
-//Call printf (formatStr,double)
-return ChoreoBuilder.CreateCall(printfFunc, { formatStrPtr, loaded });
+// 3) printf("%f\n", val) with the pooled format string
+Value *formatStrPtr = internString("%f\n", ChoreoBuilder, ChoreoModule);
+return ChoreoBuilder.CreateCall(printfFor(ChoreoBuilder, ChoreoModule), { formatStrPtr, loaded });
 }
 
 // --------------------------------------------Label: lookup the block of the label, create a branch to it and switch ChoreoBuilder insertion point to it
@@ -127,15 +828,17 @@ Value* Label::codegen(LLVMContext &ChoreoContext,
     IRBuilder<> &ChoreoBuilder,
     Module *ChoreoModule) {
 // Look up the block for this label
-auto lookUp_label_block = LabelBlocks.find(Name);
-if (lookUp_label_block == LabelBlocks.end())
-return nullptr;
-BasicBlock *BB = lookUp_label_block->second;
+if (Slot < 0) return nullptr;
+BasicBlock *BB = labelBlock(Slot, ChoreoBuilder);
+if (currentCompilation().Stream)   // a placeholder of an earlier jump: program order again
+  BB->moveAfter(ChoreoBuilder.GetInsertBlock());
 
 // If the current block has no ret or br instruction, branch to the label
 if (!ChoreoBuilder.GetInsertBlock()->getTerminator())
 ChoreoBuilder.CreateBr(BB);
 ChoreoBuilder.SetInsertPoint(BB);
+if (currentCompilation().ProfileCounters)
+  countLabel(currentCompilation(), Slot, ChoreoBuilder);
 return nullptr;
 }
 
@@ -143,9 +846,8 @@ return nullptr;
 Value* Jump::codegen(LLVMContext &ChoreoContext,
     IRBuilder<> &ChoreoBuilder,
     Module *ChoreoModule) {
-auto lookUp_label_block = LabelBlocks.find(Target);
-if (lookUp_label_block == LabelBlocks.end()) return nullptr;
-ChoreoBuilder.CreateBr(lookUp_label_block->second);
+if (Slot < 0) return nullptr;
+ChoreoBuilder.CreateBr(labelBlock(Slot, ChoreoBuilder));
 // create a dummy basic block so subsequent code(the one written after move to)has somewhere to go cus else it will be lost
 //  and unreachable from our ast:)
 Function *F = ChoreoBuilder.GetInsertBlock()->getParent();
@@ -163,6 +865,19 @@ Value* BinaryExpr::codegen(LLVMContext &ChoreoContext,
 Value *Lval = Left->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
 Value *Rval = Right->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
 if (!Lval || !Rval) return nullptr;
+// both sides integers: plain i64 arithmetic (constants fold, so 2 * i becomes `mul i64 2, %i`)
+if (isIntegral()) {
+  Lval = toInt64(Lval, ChoreoBuilder);
+  Rval = toInt64(Rval, ChoreoBuilder);
+  switch (Op) {
+  case '+': return ChoreoBuilder.CreateAdd(Lval, Rval, "addtmp");
+  case '-': return ChoreoBuilder.CreateSub(Lval, Rval, "subtmp");
+  case '*': return ChoreoBuilder.CreateMul(Lval, Rval, "multmp");
+  default:  return nullptr;
+  }
+}
+Lval = toDouble(Lval, ChoreoBuilder);
+Rval = toDouble(Rval, ChoreoBuilder);
 switch (Op) {
 case '+': return ChoreoBuilder.CreateFAdd(Lval, Rval, "addtmp");
 case '-': return ChoreoBuilder.CreateFSub(Lval, Rval, "subtmp");
@@ -176,12 +891,149 @@ default:  return nullptr;
 //                                             to get the new val e.g x=x+5 ---> for this lhs =x, rhs=x+5->codegen(binaryExp)->right=5->codegen(NumberExp)
 //                                             left=x->codegen(VariableExp)->finally after the lookup x+5 happens in binaryExp and its returned to the V
 //                                             then the current val of x is updated using creatStore instruction( kind of updating the current val of x)
+//----------------------------------------------------------ENSEMBLE storage
+// A plain ENSEMBLE is a global [n x double]; a mapped one a global double* to its data, with
+// the size in a global i64 when it comes from the file. Element accesses and the loads of the
+// pointer / size carry different TBAA tags: the pointer and size are globals like any other,
+// and without the tags every store to an element could have changed them, so a loop over a
+// mapped ENSEMBLE would reload both on every iteration and never vectorize.
+static ModuleConstants& tbaaFor(Module *ChoreoModule) {
+ModuleConstants &mc = constantsFor(ChoreoModule);
+if (!mc.TBAAElement) {
+  MDBuilder mdb(ChoreoModule->getContext());
+  MDNode *root = mdb.createTBAARoot("choreo TBAA");
+  auto access = [&](StringRef Type) {
+    MDNode *node = mdb.createTBAAScalarTypeNode(Type, root);
+    return mdb.createTBAAStructTagNode(node, node, 0);
+  };
+  mc.TBAAElement = access("ENSEMBLE element");
+  mc.TBAAPointer = access("ENSEMBLE data");
+  mc.TBAALength  = access("ENSEMBLE length");
+}
+return mc;
+}
+
+static Instruction* tagged(Instruction *I, MDNode *Access) {
+I->setMetadata(LLVMContext::MD_tbaa, Access);
+return I;
+}
+
+static bool isMapped(GlobalVariable *G) { return G->getValueType()->isPointerTy(); }
+
+// double* to element 0
+static Value* ensembleData(int Slot, IRBuilder<> &ChoreoBuilder, Module *ChoreoModule) {
+GlobalVariable *g = currentCompilation().ArraySlots[Slot];
+if (!isMapped(g))
+  return ChoreoBuilder.CreateConstInBoundsGEP2_64(g->getValueType(), g, 0, 0, g->getName() + "_ptr");
+return tagged(ChoreoBuilder.CreateLoad(g->getValueType(), g, g->getName() + "_data"),
+              tbaaFor(ChoreoModule).TBAAPointer);
+}
+
+// the element count as an i64 (a constant unless the file decides)
+static Value* ensembleLength(int Slot, IRBuilder<> &ChoreoBuilder, Module *ChoreoModule) {
+Value *len = currentCompilation().ArrayLengths[Slot];
+auto *g = dyn_cast<GlobalVariable>(len);
+if (!g) return len;
+return tagged(ChoreoBuilder.CreateLoad(g->getValueType(), g, g->getName()),
+              tbaaFor(ChoreoModule).TBAALength);
+}
+
+static Value* elementPtr(int Slot, Value *Idx, StringRef Name, IRBuilder<> &ChoreoBuilder, Module *ChoreoModule) {
+GlobalVariable *g = currentCompilation().ArraySlots[Slot];
+if (!isMapped(g))
+  return ChoreoBuilder.CreateInBoundsGEP(g->getValueType(), g, { ChoreoBuilder.getInt64(0), Idx }, Name + "_ptr");
+return ChoreoBuilder.CreateInBoundsGEP(ChoreoBuilder.getDoubleTy(), ensembleData(Slot, ChoreoBuilder, ChoreoModule),
+                                       Idx, Name + "_ptr");
+}
+
+static Value* loadElement(int Slot, Value *Idx, StringRef Name, IRBuilder<> &ChoreoBuilder, Module *ChoreoModule) {
+Value *ptr = elementPtr(Slot, Idx, Name, ChoreoBuilder, ChoreoModule);
+return tagged(ChoreoBuilder.CreateLoad(ChoreoBuilder.getDoubleTy(), ptr, Name + "_ld"),
+              tbaaFor(ChoreoModule).TBAAElement);
+}
+
+static Value* storeElement(int Slot, Value *Idx, Value *Val, StringRef Name, IRBuilder<> &ChoreoBuilder,
+                           Module *ChoreoModule) {
+Value *ptr = elementPtr(Slot, Idx, Name, ChoreoBuilder, ChoreoModule);
+return tagged(ChoreoBuilder.CreateStore(Val, ptr), tbaaFor(ChoreoModule).TBAAElement);
+}
+
+// void choreo_check_length(i64 expected, i64 actual, i8* what): stops the script on a mismatch
+static void emitLengthCheck(Value *Expected, Value *Actual, StringRef What, IRBuilder<> &ChoreoBuilder,
+                            Module *ChoreoModule) {
+FunctionCallee fn = ChoreoModule->getOrInsertFunction("choreo_check_length", ChoreoBuilder.getVoidTy(),
+  ChoreoBuilder.getInt64Ty(), ChoreoBuilder.getInt64Ty(), ChoreoBuilder.getInt8PtrTy());
+ChoreoBuilder.CreateCall(fn, { Expected, Actual, internString(What, ChoreoBuilder, ChoreoModule) });
+}
+
+static MDNode* buildLoopMetadata(LLVMContext &Ctx, int64_t TripCount, const LoopHints &Hints,
+                                 const std::vector<ASTNode*> &Body, bool ReorderFP);
+
+// a = <expr> over a whole ENSEMBLE, as the loop
+//   body:  i = phi [0, pre], [i+1, body];  a[i] = <expr at element i>;  br (i+1 < Count) ? body : after
+// When Count is known there is no guard and no bounds check; the loop idioms turn fills of 0
+// and copies into memset / memcpy, the rest gets vectorized. A size that comes from a file is
+// checked against the other ENSEMBLEs (LengthChecks) before the loop, which is then guarded.
+static Value* assignElements(int Target, StringRef Name, const std::vector<int> &LengthChecks,
+                             ASTNode *RHS, LLVMContext &ChoreoContext,
+                             IRBuilder<> &ChoreoBuilder, Module *ChoreoModule) {
+Value *count = ensembleLength(Target, ChoreoBuilder, ChoreoModule);
+for (int slot : LengthChecks)
+  emitLengthCheck(count, ensembleLength(slot, ChoreoBuilder, ChoreoModule),
+                  ("assignment to " + Name).str(), ChoreoBuilder, ChoreoModule);
+auto *knownCount = dyn_cast<ConstantInt>(count);
+if (knownCount && knownCount->isZero()) return nullptr;
+Function *F = ChoreoBuilder.GetInsertBlock()->getParent();
+BasicBlock *preBB   = ChoreoBuilder.GetInsertBlock();
+BasicBlock *bodyBB  = BasicBlock::Create(ChoreoContext, "ens.body", F);
+BasicBlock *afterBB = BasicBlock::Create(ChoreoContext, "ens.after", F);
+if (knownCount)
+  ChoreoBuilder.CreateBr(bodyBB);
+else
+  ChoreoBuilder.CreateCondBr(ChoreoBuilder.CreateICmpSGT(count, ChoreoBuilder.getInt64(0), "ens.nonempty"),
+                             bodyBB, afterBB);
+
+ChoreoBuilder.SetInsertPoint(bodyBB);
+PHINode *idx = ChoreoBuilder.CreatePHI(ChoreoBuilder.getInt64Ty(), 2, Name + ".i");
+idx->addIncoming(ChoreoBuilder.getInt64(0), preBB);
+Compilation &C = currentCompilation();
+C.ElementIndex = idx;
+Value *val = toDouble(RHS->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule), ChoreoBuilder);
+C.ElementIndex = nullptr;
+if (val)
+  storeElement(Target, idx, val, Name, ChoreoBuilder, ChoreoModule);
+Value *next = ChoreoBuilder.CreateAdd(idx, ChoreoBuilder.getInt64(1), "next", /*HasNUW=*/true, /*HasNSW=*/true);
+idx->addIncoming(next, ChoreoBuilder.GetInsertBlock());
+Value *cond = ChoreoBuilder.CreateICmpULT(next, count, "enscond");
+BranchInst *backedge = ChoreoBuilder.CreateCondBr(cond, bodyBB, afterBB);
+
+uint64_t trips = knownCount ? knownCount->getZExtValue() : INT64_MAX;   // unknown: "many"
+if (knownCount && trips > 1) {
+  MDBuilder mdb(ChoreoContext);
+  backedge->setMetadata(LLVMContext::MD_prof,
+    mdb.createBranchWeights((uint32_t)std::min<uint64_t>(trips - 1, UINT32_MAX), 1));
+}
+// every element is computed on its own, so vectorizing reorders no FP math
+if (MDNode *loopID = buildLoopMetadata(ChoreoContext, (int64_t)trips, LoopHints{-1, -1, false, false},
+                                       {}, /*ReorderFP=*/true))
+  backedge->setMetadata(LLVMContext::MD_loop, loopID);
+ChoreoBuilder.SetInsertPoint(afterBB);
+return nullptr;
+}
+
 Value* Assign::codegen(LLVMContext &ChoreoContext,
 IRBuilder<> &ChoreoBuilder,
 Module *ChoreoModule) {
-auto *symbolTable_slot = SymbolTable[LHS];
+if (ArraySlot >= 0) {
+  if (!currentCompilation().ArraySlots[ArraySlot]) return nullptr;
+  return assignElements(ArraySlot, LHS, LengthChecks, RHS, ChoreoContext, ChoreoBuilder, ChoreoModule);
+}
+if (Slot < 0) return nullptr;
+auto *symbolTable_slot = varSlot(Slot, LHS);
 if (!symbolTable_slot) return nullptr;
-Value *V = RHS->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
+Value *V = toType(RHS->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule),
+                  symbolTable_slot->getAllocatedType(), ChoreoBuilder);
+if (!V) return nullptr;
 return ChoreoBuilder.CreateStore(V, symbolTable_slot);
 }
 
@@ -193,6 +1045,14 @@ Value *Lval = Left->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
 Value *Rval = Right->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
 
 if (!Lval||!Rval) return nullptr;
+if (Left->isIntegral() && Right->isIntegral()) {
+  Lval = toInt64(Lval, ChoreoBuilder);
+  Rval = toInt64(Rval, ChoreoBuilder);
+  return Op == "<" ? ChoreoBuilder.CreateICmpSLT(Lval, Rval, "cmptmp")
+                   : ChoreoBuilder.CreateICmpSGT(Lval, Rval, "cmptmp");
+}
+Lval = toDouble(Lval, ChoreoBuilder);
+Rval = toDouble(Rval, ChoreoBuilder);
 if (Op == "<")
 //create floating point comparison instruction fcmp that returns the value i1( 1 bit integer 1 or 0 as a result)
 return ChoreoBuilder.CreateFCmpULT(Lval, Rval, "cmptmp");
@@ -204,12 +1064,12 @@ return ChoreoBuilder.CreateFCmpUGT(Lval, Rval, "cmptmp");
 Value* IfStmt::codegen(LLVMContext &ChoreoContext,
 IRBuilder<> &ChoreoBuilder,
 Module *ChoreoModule) {
-    errs() << "[codegen] IfStmt: jumping to " << Label << "\n";
+if (Verbosity >= 2)
+  errs() << "[codegen] IfStmt: jumping to " << Label << "\n";
 // find blocks
-auto lookUp_label_block = LabelBlocks.find(Label);
-if (lookUp_label_block==LabelBlocks.end()) return nullptr;
-//find the name of the label block that we need ot jump on
-BasicBlock *thenBB = lookUp_label_block->second;
+if (Slot < 0) return nullptr;
+//find the label block that we need ot jump on
+BasicBlock *thenBB = labelBlock(Slot, ChoreoBuilder);
 
 //declare a continuation block that will be executed in case the condition fails
 Function *F = ChoreoBuilder.GetInsertBlock()->getParent();
@@ -217,77 +1077,439 @@ BasicBlock *contBB = BasicBlock::Create(ChoreoContext,"ifcont",F);
 
 // calls codegen on condition(cond->comparisonExpr) condition → i1
 Value *condVal = Cond->codegen(ChoreoContext,ChoreoBuilder,ChoreoModule);
-//Create a branch based on the condVal returned if true return to the thenBB else contBB
-ChoreoBuilder.CreateCondBr(condVal, thenBB, contBB);
+Compilation &C = currentCompilation();
+if (C.ProfileCounters)
+  countSpin(C, Spin, /*FellThrough=*/false, ChoreoBuilder);
+//Create a branch based on the condVal returned if true return to the thenBB else contBB;
+// with --profile-use it carries how often it jumped in the training runs
+BranchInst *br = ChoreoBuilder.CreateCondBr(condVal, thenBB, contBB);
+if (MDNode *weights = spinWeights(C, Spin, ChoreoContext))
+  br->setMetadata(LLVMContext::MD_prof, weights);
 // continue in contBB
 ChoreoBuilder.SetInsertPoint(contBB);
+if (C.ProfileCounters)
+  countSpin(C, Spin, /*FellThrough=*/true, ChoreoBuilder);
 return nullptr;
 }
 
 //------------------------------------loop= REPEAT 4 TIMES:  ENDREPEAT
+// Count is a compile time constant, so the loop is emitted in the canonical bottom-tested form:
+//   pre:    cnt = 0; br (Count > 0) ? body : after      (guard folds away)
+//   body:   ...statements...
+//   latch:  cnt = cnt + 1; br (cnt < Count) ? body : after   !llvm.loop, !prof
+// With the counter alloca in the entry block mem2reg turns it into a phi even for nested loops,
+// and SCEV sees an i64 induction variable with an exact trip count.
+
+// does the body contain anything that makes it a poor unroll / vectorize candidate?
+static bool isSimpleLoopBody(const std::vector<ASTNode*> &Body, bool allowEcho) {
+for (ASTNode *stmt : Body) {
+  if (dynamic_cast<Repeat*>(stmt) || dynamic_cast<Label*>(stmt) ||
+      dynamic_cast<Jump*>(stmt)   || dynamic_cast<IfStmt*>(stmt))
+    return false;
+  if (auto *assign = dynamic_cast<Assign*>(stmt))   // a loop of its own
+    if (assign->assignsElements())
+      return false;
+  if (!allowEcho && (dynamic_cast<EchoStr*>(stmt) || dynamic_cast<EchoVar*>(stmt) ||
+                     dynamic_cast<EchoIndexedVar*>(stmt)))
+    return false;
+}
+return true;
+}
+
+// !llvm.loop !{self, hints...}; returns null when there is nothing to say.
+// ReorderFP: the body's FP math may be reassociated (fast-math), see below
+static MDNode* buildLoopMetadata(LLVMContext &Ctx, int64_t TripCount, const LoopHints &Hints,
+                                 const std::vector<ASTNode*> &Body, bool ReorderFP) {
+std::vector<Metadata*> ops{ nullptr };   // slot 0 = self reference
+auto flag = [&](const char *name) {
+  ops.push_back(MDNode::get(Ctx, MDString::get(Ctx, name)));
+};
+auto intOpt = [&](const char *name, Type *ty, int64_t v) {
+  ops.push_back(MDNode::get(Ctx, { MDString::get(Ctx, name),
+                                   ConstantAsMetadata::get(ConstantInt::get(ty, v)) }));
+};
+Type *i1 = Type::getInt1Ty(Ctx), *i32 = Type::getInt32Ty(Ctx);
+
+// unroll: explicit UNROLL k wins, otherwise fully unroll tiny straight-line loops
+if (Hints.Unroll == 0 || Hints.Unroll == 1)
+  flag("llvm.loop.unroll.disable");
+else if (Hints.Unroll > 1 && Hints.Unroll < TripCount)
+  intOpt("llvm.loop.unroll.count", i32, Hints.Unroll);
+else if (Hints.Unroll >= TripCount || (TripCount <= 8 && isSimpleLoopBody(Body, true)))
+  flag("llvm.loop.unroll.full");
+
+// vectorize: explicit VECTORIZE w wins, otherwise ask for it on loops that only compute.
+// A forced vectorize.enable also lets LLVM reorder FP reductions (s = s + a[i]), so it is only
+// asked for on our own where fast-math allows that anyway; elsewhere the cost model decides
+if (Hints.Vectorize == 0 || Hints.Vectorize == 1) {
+  intOpt("llvm.loop.vectorize.enable", i1, 0);
+} else if (Hints.Vectorize > 1) {
+  intOpt("llvm.loop.vectorize.enable", i1, 1);
+  intOpt("llvm.loop.vectorize.width", i32, Hints.Vectorize);
+} else if (TripCount > 8 && ReorderFP && isSimpleLoopBody(Body, false)) {
+  intOpt("llvm.loop.vectorize.enable", i1, 1);
+}
+
+if (ops.size() == 1) return nullptr;
+MDNode *loopID = MDNode::getDistinct(Ctx, ops);
+loopID->replaceOperandWith(0, loopID);
+return loopID;
+}
+
 Value* Repeat::codegen(LLVMContext &ChoreoContext,
     IRBuilder<> &ChoreoBuilder,
     Module *ChoreoModule) {
+if (Hints.Parallel)
+  return codegenParallel(ChoreoContext, ChoreoBuilder, ChoreoModule);
 Function *F = ChoreoBuilder.GetInsertBlock()->getParent();
+int64_t tripCount = trips();
 
-//variable loop count that must be decremented everytime a loop block executes
-AllocaInst *loopVariable = ChoreoBuilder.CreateAlloca(
-Type::getDoubleTy(ChoreoContext), nullptr, "rep.loopVariable");
-ChoreoBuilder.CreateStore(ConstantFP::get(ChoreoContext, APFloat(0.0)), loopVariable);
+//i64 loop counter, allocated in the entry block like VarDecl so nested loops don't grow the stack
+IRBuilder<> tmpBuilder(&F->getEntryBlock(), F->getEntryBlock().begin());
+AllocaInst *loopVariable = tmpBuilder.CreateAlloca(
+Type::getInt64Ty(ChoreoContext), nullptr, "rep.loopVariable");
+// a loop --interp tiers up resumes at the iteration the interpreter got to
+Compilation &C = currentCompilation();
+Value *start = C.RepeatStart ? C.RepeatStart : ChoreoBuilder.getInt64(0);
+C.RepeatStart = nullptr;   // nested loops start at 0
+ChoreoBuilder.CreateStore(start, loopVariable);
 
 // create blocks
-BasicBlock *condBB  = BasicBlock::Create(ChoreoContext, "rep.cond", F);
 BasicBlock *bodyBB  = BasicBlock::Create(ChoreoContext, "rep.body", F);
+BasicBlock *latchBB = BasicBlock::Create(ChoreoContext, "rep.latch", F);
 BasicBlock *afterBB = BasicBlock::Create(ChoreoContext, "rep.after", F);
 
-// jump to condition to check the loop variable. 
-ChoreoBuilder.CreateBr(condBB);
-
-// condition block
-ChoreoBuilder.SetInsertPoint(condBB);
-Type *elemTy = loopVariable->getAllocatedType();           // the element type (double)
-Value *cur   = ChoreoBuilder.CreateLoad(elemTy, loopVariable, "cur");
-//get the limit of the loop from the count varible
-Value *limit = ConstantFP::get(ChoreoContext, APFloat(Count));
-//if false meaning if current value have exceeded the limit then create the branh to afterBB  else conitnue to the body block by seting inserting point to it 
-Value *cond  = ChoreoBuilder.CreateFCmpULT(cur, limit, "repcond");
-ChoreoBuilder.CreateCondBr(cond, bodyBB, afterBB);
+// guard: a loop with a count of 0 never enters the body
+ChoreoBuilder.CreateCondBr(ChoreoBuilder.CreateICmpSLT(start, ChoreoBuilder.getInt64(tripCount)), bodyBB, afterBB);
 
 //bodyBB
 ChoreoBuilder.SetInsertPoint(bodyBB);
+bool reorderFP;
+{
+// FASTMATH: the builder stamps the flags on every FP op of the body (nested loops included)
+IRBuilder<>::FastMathFlagGuard fmfGuard(ChoreoBuilder);
+if (Hints.FastMath) {
+  FastMathFlags fmf = ChoreoBuilder.getFastMathFlags();
+  fmf |= BlockFastMath;
+  ChoreoBuilder.setFastMathFlags(fmf);
+}
+reorderFP = ChoreoBuilder.getFastMathFlags().allowReassoc();
 //here we have kept a vector or ASTNode representing the body meaning multiple statements. it makes it recursive and so nested repeat is supported
 for (ASTNode* stmt : Body)
 stmt->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
+}
+ChoreoBuilder.CreateBr(latchBB);
 
-//increment the current variable from loopVarible and then store that next value in the loopVariable
-cur = ChoreoBuilder.CreateLoad(elemTy, loopVariable, "cur");    // reload
-Value *next = ChoreoBuilder.CreateFAdd(
-cur, ConstantFP::get(ChoreoContext, APFloat(1.0)), "next");
+//latch: increment the loop variable and go around again while it is below Count
+ChoreoBuilder.SetInsertPoint(latchBB);
+Type *elemTy = loopVariable->getAllocatedType();           // the element type (i64)
+Value *cur   = ChoreoBuilder.CreateLoad(elemTy, loopVariable, "cur");
+Value *next  = ChoreoBuilder.CreateNSWAdd(cur, ChoreoBuilder.getInt64(1), "next");
 ChoreoBuilder.CreateStore(next, loopVariable);
-ChoreoBuilder.CreateBr(condBB);
+Value *cond  = ChoreoBuilder.CreateICmpSLT(next, ChoreoBuilder.getInt64(tripCount), "repcond");
+BranchInst *backedge = ChoreoBuilder.CreateCondBr(cond, bodyBB, afterBB);
+
+// the trip count as branch weights (taken Count-1 times, exits once) plus the loop hints
+if (tripCount > 1) {
+  MDBuilder mdb(ChoreoContext);
+  backedge->setMetadata(LLVMContext::MD_prof,
+    mdb.createBranchWeights((uint32_t)std::min<int64_t>(tripCount - 1, UINT32_MAX), 1));
+}
+if (MDNode *loopID = buildLoopMetadata(ChoreoContext, tripCount, Hints, Body, reorderFP))
+  backedge->setMetadata(LLVMContext::MD_loop, loopID);
 
 //set the insertion poin to the after boby block
 ChoreoBuilder.SetInsertPoint(afterBB);
 return nullptr;
 }
 
+//------------------------------------REPEAT n TIMES PARALLEL
+// The body becomes an internal function that runs one chunk of the iterations:
+//   void main.parallel(i64 begin, i64 end, i64 chunk, i8* ctx)
+//     entry:  a private copy of every variable the body uses (see ParallelVar), from ctx
+//     loop:   the body for begin <= k < end, as in Repeat::codegen
+//     exit:   reductions -> partials[chunk]; the chunk with the last iteration writes the
+//             private variables back to ctx
+// and the loop itself becomes choreo_parallel_for(n, chunks, main.parallel, ctx, threads) with
+// the partials combined in chunk order afterwards. The chunk count only depends on n, so the
+// reductions give the same result with any number of threads.
+static const int64_t ParallelChunks = 256;
+
+Value* Repeat::codegenParallel(LLVMContext &ChoreoContext,
+    IRBuilder<> &ChoreoBuilder,
+    Module *ChoreoModule) {
+int64_t tripCount = trips();
+if (tripCount <= 0) return nullptr;
+int64_t chunks = std::min(tripCount, ParallelChunks);
+Compilation &C = currentCompilation();
+Function *F = ChoreoBuilder.GetInsertBlock()->getParent();
+Type *i64 = ChoreoBuilder.getInt64Ty();
+
+// ctx: one field per variable (value in, private value out), then a partials pointer per reduction
+std::vector<AllocaInst*> shared;   // the variables' own slots
+std::vector<Type*> fields;
+for (const ParallelVar &v : ParallelVars) {
+  AllocaInst *slot = varSlot(v.Slot, StringRef());
+  if (!slot) return nullptr;
+  shared.push_back(slot);
+  fields.push_back(slot->getAllocatedType());
+}
+std::vector<unsigned> partialsField(ParallelVars.size(), 0);
+for (size_t k = 0; k < ParallelVars.size(); ++k)
+  if (ParallelVars[k].Use == ParallelVar::Reduction) {
+    partialsField[k] = fields.size();
+    fields.push_back(fields[k]->getPointerTo());
+  }
+StructType *ctxTy = StructType::get(ChoreoContext, fields);
+
+IRBuilder<> tmpBuilder(&F->getEntryBlock(), F->getEntryBlock().begin());
+AllocaInst *ctx = tmpBuilder.CreateAlloca(ctxTy, nullptr, "par.ctx");
+std::vector<AllocaInst*> partials(ParallelVars.size(), nullptr);
+for (size_t k = 0; k < ParallelVars.size(); ++k) {
+  if (ParallelVars[k].Use == ParallelVar::Reduction) {
+    partials[k] = tmpBuilder.CreateAlloca(ArrayType::get(fields[k], chunks), nullptr,
+                                          shared[k]->getName() + ".partials");
+    ChoreoBuilder.CreateStore(ChoreoBuilder.CreateConstInBoundsGEP2_64(partials[k]->getAllocatedType(),
+                                                                      partials[k], 0, 0),
+                              ChoreoBuilder.CreateStructGEP(ctxTy, ctx, partialsField[k]));
+  }
+  if (ParallelVars[k].Use != ParallelVar::Private)
+    ChoreoBuilder.CreateStore(ChoreoBuilder.CreateLoad(fields[k], shared[k], shared[k]->getName() + "_ld"),
+                              ChoreoBuilder.CreateStructGEP(ctxTy, ctx, k));
+}
+
+// the chunk function
+FunctionType *chunkTy = FunctionType::get(ChoreoBuilder.getVoidTy(),
+  { i64, i64, i64, ChoreoBuilder.getInt8PtrTy() }, /*isVarArg=*/false);
+Function *chunkF = Function::Create(chunkTy, Function::InternalLinkage, F->getName() + ".parallel", ChoreoModule);
+chunkF->addFnAttr(Attribute::NoUnwind);
+Value *begin = chunkF->getArg(0), *end = chunkF->getArg(1), *chunk = chunkF->getArg(2);
+begin->setName("begin");
+end->setName("end");
+chunk->setName("chunk");
+chunkF->getArg(3)->setName("ctx");
+{
+IRBuilderBase::InsertPointGuard ipGuard(ChoreoBuilder);
+BasicBlock *entryBB = BasicBlock::Create(ChoreoContext, "entry", chunkF);
+ChoreoBuilder.SetInsertPoint(entryBB);
+Value *chunkCtx = ChoreoBuilder.CreateBitCast(chunkF->getArg(3), ctxTy->getPointerTo());
+
+// private copies; the body's statements find them through VarSlots
+std::vector<AllocaInst*> priv;
+for (size_t k = 0; k < ParallelVars.size(); ++k) {
+  const ParallelVar &v = ParallelVars[k];
+  Type *ty = fields[k];
+  AllocaInst *copy = ChoreoBuilder.CreateAlloca(ty, nullptr, shared[k]->getName());
+  priv.push_back(copy);
+  C.VarSlots[v.Slot] = copy;
+  Value *in = v.Use == ParallelVar::Private ? nullptr
+            : ChoreoBuilder.CreateLoad(ty, ChoreoBuilder.CreateStructGEP(ctxTy, chunkCtx, k));
+  if (v.Use == ParallelVar::Shared) {
+    ChoreoBuilder.CreateStore(in, copy);
+  } else if (v.Use == ParallelVar::Induction) {   // where the first iteration of the chunk starts
+    Value *offset = ty->isDoubleTy()
+      ? ChoreoBuilder.CreateFMul(toDouble(begin, ChoreoBuilder), ConstantFP::get(ty, v.Step))
+      : ChoreoBuilder.CreateMul(begin, ConstantInt::get(ty, (int64_t)v.Step, true));
+    ChoreoBuilder.CreateStore(ty->isDoubleTy() ? ChoreoBuilder.CreateFAdd(in, offset)
+                                               : ChoreoBuilder.CreateAdd(in, offset), copy);
+  } else if (v.Use == ParallelVar::Reduction) {
+    int identity = v.Op == '*' ? 1 : 0;
+    ChoreoBuilder.CreateStore(ty->isDoubleTy() ? ConstantFP::get(ty, identity)
+                                               : ConstantInt::get(ty, identity), copy);
+  }
+}
+
+AllocaInst *loopVariable = ChoreoBuilder.CreateAlloca(i64, nullptr, "rep.loopVariable");
+ChoreoBuilder.CreateStore(begin, loopVariable);
+BasicBlock *bodyBB  = BasicBlock::Create(ChoreoContext, "rep.body", chunkF);
+BasicBlock *latchBB = BasicBlock::Create(ChoreoContext, "rep.latch", chunkF);
+BasicBlock *exitBB  = BasicBlock::Create(ChoreoContext, "rep.after", chunkF);
+ChoreoBuilder.CreateCondBr(ChoreoBuilder.CreateICmpSLT(begin, end), bodyBB, exitBB);
+
+ChoreoBuilder.SetInsertPoint(bodyBB);
+bool reorderFP;
+{
+IRBuilder<>::FastMathFlagGuard fmfGuard(ChoreoBuilder);
+if (Hints.FastMath) {
+  FastMathFlags fmf = ChoreoBuilder.getFastMathFlags();
+  fmf |= BlockFastMath;
+  ChoreoBuilder.setFastMathFlags(fmf);
+}
+reorderFP = ChoreoBuilder.getFastMathFlags().allowReassoc();
+for (ASTNode* stmt : Body)
+  stmt->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
+}
+ChoreoBuilder.CreateBr(latchBB);
+
+ChoreoBuilder.SetInsertPoint(latchBB);
+Value *cur  = ChoreoBuilder.CreateLoad(i64, loopVariable, "cur");
+Value *next = ChoreoBuilder.CreateNSWAdd(cur, ChoreoBuilder.getInt64(1), "next");
+ChoreoBuilder.CreateStore(next, loopVariable);
+BranchInst *backedge = ChoreoBuilder.CreateCondBr(ChoreoBuilder.CreateICmpSLT(next, end, "repcond"),
+                                                  bodyBB, exitBB);
+// chunks differ by an iteration, so the trip count of one is not a constant LLVM could fully
+// unroll by: describe it as unknown
+if (MDNode *loopID = buildLoopMetadata(ChoreoContext, INT64_MAX, Hints, Body, reorderFP))
+  backedge->setMetadata(LLVMContext::MD_loop, loopID);
+
+// partial results out, and the private values of the last iteration
+ChoreoBuilder.SetInsertPoint(exitBB);
+bool lastPrivate = false;
+for (size_t k = 0; k < ParallelVars.size(); ++k) {
+  lastPrivate |= ParallelVars[k].Use == ParallelVar::Private;
+  if (ParallelVars[k].Use != ParallelVar::Reduction)
+    continue;
+  Value *base = ChoreoBuilder.CreateLoad(fields[k]->getPointerTo(),
+                                         ChoreoBuilder.CreateStructGEP(ctxTy, chunkCtx, partialsField[k]));
+  ChoreoBuilder.CreateStore(ChoreoBuilder.CreateLoad(fields[k], priv[k]),
+                            ChoreoBuilder.CreateInBoundsGEP(fields[k], base, chunk));
+}
+if (lastPrivate) {
+  BasicBlock *lastBB = BasicBlock::Create(ChoreoContext, "par.last", chunkF);
+  BasicBlock *retBB  = BasicBlock::Create(ChoreoContext, "par.ret", chunkF);
+  ChoreoBuilder.CreateCondBr(ChoreoBuilder.CreateICmpEQ(end, ChoreoBuilder.getInt64(tripCount)), lastBB, retBB);
+  ChoreoBuilder.SetInsertPoint(lastBB);
+  for (size_t k = 0; k < ParallelVars.size(); ++k)
+    if (ParallelVars[k].Use == ParallelVar::Private)
+      ChoreoBuilder.CreateStore(ChoreoBuilder.CreateLoad(fields[k], priv[k]),
+                                ChoreoBuilder.CreateStructGEP(ctxTy, chunkCtx, k));
+  ChoreoBuilder.CreateBr(retBB);
+  ChoreoBuilder.SetInsertPoint(retBB);
+}
+ChoreoBuilder.CreateRetVoid();
+for (size_t k = 0; k < ParallelVars.size(); ++k)
+  C.VarSlots[ParallelVars[k].Slot] = shared[k];
+}
+
+// the loop: hand the chunks to the runtime
+ModuleConstants &mc = constantsFor(ChoreoModule);
+if (!mc.ParallelFor)
+  mc.ParallelFor = ChoreoModule->getOrInsertFunction("choreo_parallel_for",
+    ChoreoBuilder.getVoidTy(), i64, i64, chunkTy->getPointerTo(), ChoreoBuilder.getInt8PtrTy(),
+    ChoreoBuilder.getInt32Ty());
+ChoreoBuilder.CreateCall(mc.ParallelFor, { ChoreoBuilder.getInt64(tripCount), ChoreoBuilder.getInt64(chunks), chunkF,
+                                           ChoreoBuilder.CreateBitCast(ctx, ChoreoBuilder.getInt8PtrTy()),
+                                           ChoreoBuilder.getInt32(ParallelThreads) });
+
+// the variables after the loop: i + n*k, the last private values, s (op) partials[0] (op) partials[1] ...
+std::vector<size_t> reductions;
+for (size_t k = 0; k < ParallelVars.size(); ++k) {
+  const ParallelVar &v = ParallelVars[k];
+  Type *ty = fields[k];
+  if (v.Use == ParallelVar::Induction) {
+    Value *old = ChoreoBuilder.CreateLoad(ty, shared[k], shared[k]->getName() + "_ld");
+    ChoreoBuilder.CreateStore(ty->isDoubleTy()
+      ? ChoreoBuilder.CreateFAdd(old, ConstantFP::get(ty, (double)tripCount * v.Step))
+      : ChoreoBuilder.CreateAdd(old, ConstantInt::get(ty, tripCount * (int64_t)v.Step, true)), shared[k]);
+  } else if (v.Use == ParallelVar::Private) {
+    ChoreoBuilder.CreateStore(ChoreoBuilder.CreateLoad(ty, ChoreoBuilder.CreateStructGEP(ctxTy, ctx, k)), shared[k]);
+  } else if (v.Use == ParallelVar::Reduction) {
+    reductions.push_back(k);
+  }
+}
+if (reductions.empty())
+  return nullptr;
+
+std::vector<Value*> initial;
+for (size_t k : reductions)
+  initial.push_back(ChoreoBuilder.CreateLoad(fields[k], shared[k], shared[k]->getName() + "_ld"));
+BasicBlock *preBB     = ChoreoBuilder.GetInsertBlock();
+BasicBlock *combineBB = BasicBlock::Create(ChoreoContext, "par.combine", F);
+BasicBlock *afterBB   = BasicBlock::Create(ChoreoContext, "par.after", F);
+ChoreoBuilder.CreateBr(combineBB);
+ChoreoBuilder.SetInsertPoint(combineBB);
+PHINode *idx = ChoreoBuilder.CreatePHI(i64, 2, "par.chunk");
+idx->addIncoming(ChoreoBuilder.getInt64(0), preBB);
+std::vector<PHINode*> accs;
+for (size_t r = 0; r < reductions.size(); ++r) {
+  PHINode *acc = ChoreoBuilder.CreatePHI(fields[reductions[r]], 2, shared[reductions[r]]->getName() + ".acc");
+  acc->addIncoming(initial[r], preBB);
+  accs.push_back(acc);
+}
+std::vector<Value*> combined;
+for (size_t r = 0; r < reductions.size(); ++r) {
+  size_t k = reductions[r];
+  Type *ty = fields[k];
+  Value *part = ChoreoBuilder.CreateLoad(ty, ChoreoBuilder.CreateInBoundsGEP(
+    partials[k]->getAllocatedType(), partials[k], { ChoreoBuilder.getInt64(0), idx }));
+  bool isFP = ty->isDoubleTy(), mul = ParallelVars[k].Op == '*';
+  combined.push_back(isFP ? (mul ? ChoreoBuilder.CreateFMul(accs[r], part) : ChoreoBuilder.CreateFAdd(accs[r], part))
+                          : (mul ? ChoreoBuilder.CreateMul(accs[r], part) : ChoreoBuilder.CreateAdd(accs[r], part)));
+}
+Value *nextIdx = ChoreoBuilder.CreateAdd(idx, ChoreoBuilder.getInt64(1), "next", /*HasNUW=*/true, /*HasNSW=*/true);
+for (size_t r = 0; r < reductions.size(); ++r)
+  accs[r]->addIncoming(combined[r], combineBB);
+idx->addIncoming(nextIdx, combineBB);
+ChoreoBuilder.CreateCondBr(ChoreoBuilder.CreateICmpULT(nextIdx, ChoreoBuilder.getInt64(chunks)), combineBB, afterBB);
+ChoreoBuilder.SetInsertPoint(afterBB);
+for (size_t r = 0; r < reductions.size(); ++r)
+  ChoreoBuilder.CreateStore(combined[r], shared[reductions[r]]);
+return nullptr;
+}
+
 //---------------------------------ARRAY NODESSS
+const size_t ArrayDecl::FileSized;
+
 Value* ArrayDecl::codegen(LLVMContext &ChoreoContext,
     IRBuilder<> &ChoreoBuilder,
     Module *ChoreoModule) {
+        Compilation &C = currentCompilation();
+        if (C.ArraySlots[Slot])   // --interp tier-up: the interpreter's buffer
+          return C.ArraySlots[Slot];
+        if (!Path.empty())
+          return codegenMapped(ChoreoBuilder, ChoreoModule);
         ArrayType *ensemble = ArrayType::get(Type::getDoubleTy(ChoreoContext), Count); //creates an array type variable double values of size count
         Constant *init   = ConstantAggregateZero::get(ensemble);   //initialized that array to 0
         auto *g = new GlobalVariable(                   //creates a new global variable in the ChoreoModule of arrayType which is mutable 
-                                                      //external linkage mean any ChoreoModule outside this can see this global variable and woudl be refering to the same memory
+                                                      //internal and prefixed: linked with libc and the runtime, `ENSEMBLE write[4]` must not become write()
             *ChoreoModule, ensemble, false,
-            GlobalValue::ExternalLinkage,
-            init, Name);              
+            GlobalValue::InternalLinkage,
+            init, "ensemble." + Name);              
       
         
-        ArrayTable[Name] = g;
+        C.ArraySlots[Slot] = g;
+        C.ArrayLengths[Slot] = ChoreoBuilder.getInt64(Count);
         return g;
 }
 
+// a = choreo_map_f64("file", n or -1, &a.len or null); the runtime stops the script when the
+// file is missing or too short, so there is nothing to check here
+Value* ArrayDecl::codegenMapped(IRBuilder<> &ChoreoBuilder, Module *ChoreoModule) {
+Compilation &C = currentCompilation();
+PointerType *dataTy = ChoreoBuilder.getDoubleTy()->getPointerTo();
+// internal and prefixed like the arrays of ArrayDecl::codegen: `ENSEMBLE open FROM ...` is not open()
+auto *g = new GlobalVariable(*ChoreoModule, dataTy, false, GlobalValue::InternalLinkage,
+                             ConstantPointerNull::get(dataTy), "ensemble." + Name);
+GlobalVariable *len = nullptr;
+if (Count == FileSized)
+  len = new GlobalVariable(*ChoreoModule, ChoreoBuilder.getInt64Ty(), false, GlobalValue::InternalLinkage,
+                           ChoreoBuilder.getInt64(0), "ensemble." + Name + ".len");
+PointerType *lenPtrTy = ChoreoBuilder.getInt64Ty()->getPointerTo();
+FunctionCallee map = ChoreoModule->getOrInsertFunction("choreo_map_f64", dataTy,
+  ChoreoBuilder.getInt8PtrTy(), ChoreoBuilder.getInt64Ty(), lenPtrTy);
+Value *data = ChoreoBuilder.CreateCall(map, {
+  internString(Path, ChoreoBuilder, ChoreoModule),
+  ChoreoBuilder.getInt64(Count == FileSized ? -1 : (int64_t)Count),
+  len ? (Value*)len : ConstantPointerNull::get(lenPtrTy) }, Name + "_data");
+tagged(ChoreoBuilder.CreateStore(data, g), tbaaFor(ChoreoModule).TBAAPointer);
+C.ArraySlots[Slot] = g;
+C.ArrayLengths[Slot] = len ? (Value*)len : ChoreoBuilder.getInt64(Count);
+return g;
+}
+
+// choreo_save_f64("file", &a[0], len)
+Value* SaveArray::codegen(LLVMContext &ChoreoContext,
+    IRBuilder<> &ChoreoBuilder,
+    Module *ChoreoModule) {
+if (Slot < 0 || !currentCompilation().ArraySlots[Slot]) return nullptr;
+FunctionCallee save = ChoreoModule->getOrInsertFunction("choreo_save_f64", ChoreoBuilder.getVoidTy(),
+  ChoreoBuilder.getInt8PtrTy(), ChoreoBuilder.getDoubleTy()->getPointerTo(), ChoreoBuilder.getInt64Ty());
+return ChoreoBuilder.CreateCall(save, {
+  internString(Path, ChoreoBuilder, ChoreoModule),
+  ensembleData(Slot, ChoreoBuilder, ChoreoModule),
+  ensembleLength(Slot, ChoreoBuilder, ChoreoModule) });
+}
+
 
 //--------------------IndexExpr arr[index] here index cud be any expression and it fetches the returns that value
 Value* IndexExpr::codegen(LLVMContext &ChoreoContext,
@@ -295,51 +1517,85 @@ Value* IndexExpr::codegen(LLVMContext &ChoreoContext,
     Module *ChoreoModule) {
 
 
- auto arr = ArrayTable.find(Name);       //find the global array from the ArrayTable
- if (arr == ArrayTable.end())
+ if (Slot < 0) return nullptr;
+ if (!currentCompilation().ArraySlots[Slot])       //find the global array of this ENSEMBLE slot
    return nullptr;
- GlobalVariable *g = arr->second;
 
- //compute the index (double → int) i sreturned by evaluating the expression
- Value *idxFP = Idx->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
- // Convert that double to a 32‐bit integer for GEP
- Value *idx   = ChoreoBuilder.CreateFPToSI(
-                  idxFP, Type::getInt32Ty(ChoreoContext), "idx_i");
+ //compute the index i sreturned by evaluating the expression; integer indices are used as they are,
+ // only a double index gets converted for GEP
+ Value *idx = toInt64(Idx->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule), ChoreoBuilder);
+ if (!idx) return nullptr;
+
+ // GEP into the ENSEMBLE and load the element at that index
+ return loadElement(Slot, idx, Name, ChoreoBuilder, ChoreoModule);
+}
+
+//--------------------------------ReduceExpr: SUM(a) = choreo_sum_f64(&a[0], len), DOT(a, b) = choreo_dot_f64(&a[0], &b[0], len)
+// The kernels only read their arrays, so loads / stores of other ENSEMBLEs and variables
+// around the call stay where they are. Not readonly as a whole: the first call picks the kernels
+// (getenv, and a store to the runtime's own state), which is memory the module cannot see.
+static FunctionCallee reductionFor(ReduceExpr::Kind Op, IRBuilder<> &ChoreoBuilder, Module *ChoreoModule) {
+FunctionCallee &fn = constantsFor(ChoreoModule).Reductions[Op];
+if (fn) return fn;
+static const char *names[] = { "choreo_sum_f64", "choreo_min_f64", "choreo_max_f64", "choreo_dot_f64" };
+unsigned numArrays = Op == ReduceExpr::Dot ? 2 : 1;
+std::vector<Type*> params(numArrays, ChoreoBuilder.getDoubleTy()->getPointerTo());
+params.push_back(ChoreoBuilder.getInt64Ty());
+fn = ChoreoModule->getOrInsertFunction(names[Op],
+  FunctionType::get(ChoreoBuilder.getDoubleTy(), params, /*isVarArg=*/false));
+if (auto *decl = dyn_cast<Function>(fn.getCallee())) {
+  decl->setOnlyAccessesInaccessibleMemOrArgMem();
+  decl->setDoesNotThrow();
+  decl->setWillReturn();
+  for (unsigned a = 0; a < numArrays; ++a) {
+    decl->addParamAttr(a, Attribute::NoCapture);
+    decl->addParamAttr(a, Attribute::ReadOnly);
+  }
+}
+return fn;
+}
+
+Value* ReduceExpr::codegen(LLVMContext &ChoreoContext,
+    IRBuilder<> &ChoreoBuilder,
+    Module *ChoreoModule) {
+if (Slot < 0 || (Op == Dot && Slot2 < 0)) return nullptr;
+Compilation &C = currentCompilation();
+if (!C.ArraySlots[Slot] || (Op == Dot && !C.ArraySlots[Slot2])) return nullptr;
 
- // 3) GEP into g
- Value *zero = ConstantInt::get(Type::getInt32Ty(ChoreoContext), 0);
- Value *gep  = ChoreoBuilder.CreateInBoundsGEP(
-                  g->getValueType(),  // this is [N x double]
-                  g,  //pointer to the global name of array
-                  { zero, idx },  //// indices: array base, element offset
-                  Name + "_ptr");
+Value *count = ensembleLength(Slot, ChoreoBuilder, ChoreoModule);
+if (Op == Dot) {
+  // the resolver compared the sizes it knew; one from a file is compared here
+  Value *count2 = ensembleLength(Slot2, ChoreoBuilder, ChoreoModule);
+  if (!isa<ConstantInt>(count) || !isa<ConstantInt>(count2))
+    emitLengthCheck(count, count2, ("DOT(" + Name + ", " + Name2 + ")").str(), ChoreoBuilder, ChoreoModule);
+}
+auto *knownCount = dyn_cast<ConstantInt>(count);
+if (knownCount && knownCount->isZero())   // the kernels' results for no elements
+  return ConstantFP::get(ChoreoBuilder.getDoubleTy(),
+                         Op == Min ? INFINITY : Op == Max ? -INFINITY : 0.0);
 
- // 4) load the element at that index
- return ChoreoBuilder.CreateLoad(Type::getDoubleTy(ChoreoContext), gep, Name + "_ld");
+std::vector<Value*> args{ ensembleData(Slot, ChoreoBuilder, ChoreoModule) };
+if (Op == Dot)
+  args.push_back(ensembleData(Slot2, ChoreoBuilder, ChoreoModule));
+args.push_back(count);
+static const char *names[] = { "sum", "min", "max", "dot" };
+return ChoreoBuilder.CreateCall(reductionFor(Op, ChoreoBuilder, ChoreoModule), args, names[Op]);
 }
 
 //--------------------------------StoreToIndex: GEP + store     store the value at arr[index]
 Value* StoreToIndex::codegen(LLVMContext &ChoreoContext,
        IRBuilder<> &ChoreoBuilder,
        Module *ChoreoModule) {
-        auto it = ArrayTable.find(Name);
-        if (it == ArrayTable.end())
+        if (Slot < 0) return nullptr;
+        if (!currentCompilation().ArraySlots[Slot])
           return nullptr;
-        GlobalVariable *g = it->second;
-      
-        Value *idxFP = Idx->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
-        Value *idx   = ChoreoBuilder.CreateFPToSI(
-                         idxFP, Type::getInt32Ty(ChoreoContext), "idx_i");
       
-        Value *zero = ConstantInt::get(Type::getInt32Ty(ChoreoContext), 0);
-        Value *gep  = ChoreoBuilder.CreateInBoundsGEP(
-                         g->getValueType(),
-                         g,
-                         { zero, idx },
-                         Name + "_ptr");
+        Value *idx = toInt64(Idx->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule), ChoreoBuilder);
+        if (!idx) return nullptr;
       
-        Value *val = RHS->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
-        return ChoreoBuilder.CreateStore(val, gep);
+        Value *val = toDouble(RHS->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule), ChoreoBuilder);
+        if (!val) return nullptr;
+        return storeElement(Slot, idx, val, Name, ChoreoBuilder, ChoreoModule);
 }
 
 //---------------------------prints the value of arr[index]
@@ -347,44 +1603,21 @@ Value* EchoIndexedVar::codegen(LLVMContext &ChoreoContext,
     IRBuilder<> &ChoreoBuilder,
     Module *ChoreoModule) {
 //
-auto it = ArrayTable.find(Name);
-if (it == ArrayTable.end()) return nullptr;
-GlobalVariable *g = it->second;
+if (Slot < 0) return nullptr;
+if (!currentCompilation().ArraySlots[Slot]) return nullptr;
 
 //
-Value *idxFP = Idx->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule);
-Value *idx   = ChoreoBuilder.CreateFPToSI(
-idxFP,
-Type::getInt32Ty(ChoreoContext),
-Name+"_idx");
+Value *idx = toInt64(Idx->codegen(ChoreoContext, ChoreoBuilder, ChoreoModule), ChoreoBuilder);
+if (!idx) return nullptr;
 
 //
-Value *zero = ConstantInt::get(Type::getInt32Ty(ChoreoContext), 0);
-Value *gep  = ChoreoBuilder.CreateInBoundsGEP(
-g->getValueType(),  // array type
-g,
-{ zero, idx },
-Name+"_ptr");
+Value *val = loadElement(Slot, idx, Name, ChoreoBuilder, ChoreoModule);
+if (EchoMode == EchoLowering::Runtime)
+  return emitRuntimeEchoF64(val, ChoreoBuilder, ChoreoModule);
 
-//
-Value *val = ChoreoBuilder.CreateLoad(
-Type::getDoubleTy(ChoreoContext),
-gep,
-Name+"_ld");
-
-//
-Type *i8Ty    = Type::getInt8Ty(ChoreoContext);
-Type *i8PtrTy = PointerType::getUnqual(i8Ty);
-FunctionType *printfTy = FunctionType::get(
-  ChoreoBuilder.getInt32Ty(),         // returns i32
-  { i8PtrTy },                  // takes one i8* argument (then varargs)
-  /*isVarArg=*/true
-);
-auto printfFunc = ChoreoModule->getOrInsertFunction("printf", printfTy);
-
-// make a constant "%f\n"
-Value *fmt = ChoreoBuilder.CreateGlobalStringPtr("%f\n", "fmt");
-return ChoreoBuilder.CreateCall(printfFunc, { fmt, val });
+// printf("%f\n", val) with the pooled format string
+Value *fmt = internString("%f\n", ChoreoBuilder, ChoreoModule);
+return ChoreoBuilder.CreateCall(printfFor(ChoreoBuilder, ChoreoModule), { fmt, val });
 }
 
 
@@ -4,14 +4,29 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <memory>
 #include <vector>
 #include <cstdint>    
+#include <cmath>
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/ADT/StringRef.h"
 using namespace llvm;
+class Resolver;
+class BytecodeCompiler;
+struct Compilation;
+struct ValueRange;
+
+// --interp: the register an expression's bytecode leaves its value in, and whether it holds an
+// i64 (comparisons: 0 / 1) or a double; Reg < 0 for statements (see interp.cpp)
+struct BCValue {
+  int Reg = -1;
+  bool Int = false;
+};
+
 // Base AST node
 struct ASTNode {
   virtual ~ASTNode() = default;
@@ -19,6 +34,72 @@ struct ASTNode {
                                llvm::IRBuilder<> &ChoreoBuilder,
                                llvm::Module *ChoreoModule) = 0;
   virtual void print(int indent = 0) const = 0;
+
+  // integer type inference (see inferIntegerVariables): false unless this expression always
+  // yields an integer in Range, and so do all the + - * computing it, every one below 2^53 in
+  // magnitude (where i64 and double arithmetic agree)
+  virtual bool valueRange(ValueRange &Range) const { return false; }
+  // ... computed in i64 then
+  bool isIntegral() const;
+
+  // name resolution (see resolveNames): bind every name to its dense slot
+  virtual void resolve(Resolver &R) {}
+
+  // --interp: append the bytecode of this statement / expression (see interp.cpp)
+  virtual BCValue bytecode(BytecodeCompiler &B) = 0;
+};
+
+// How ECCO / ECCO_D are lowered (driver option --echo=printf|runtime):
+// one printf call per statement, or the buffered choreo_echo_* functions of runtime/
+enum class EchoLowering { Printf, Runtime };
+extern EchoLowering EchoMode;
+
+// Threads of a `REPEAT n TIMES PARALLEL` loop (driver option --threads=<n>; 0 = one per cpu,
+// CHOREO_THREADS overrides either when the program runs)
+extern int ParallelThreads;
+
+// Fast-math flags on the FP arithmetic and comparisons (driver option --fast-math[=<flags>]):
+// ProgramFastMath on all of them, BlockFastMath added inside `REPEAT n TIMES FASTMATH` bodies
+// (the --fast-math flags, or reassoc/contract/nsz/arcp without the option). reassoc is what
+// lets the vectorizer split `s = s + a[i]` into partial sums, contract allows FMAs.
+extern llvm::FastMathFlags ProgramFastMath, BlockFastMath;
+// "reassoc,contract,nnan,..." or "fast" (everything); false on an unknown flag name
+bool parseFastMathFlags(llvm::StringRef List, llvm::FastMathFlags &Flags);
+// EchoMode, ParallelThreads, ProgramFastMath and BlockFastMath back to their defaults, as before
+// any option (--serve: a request must not inherit the server's command line)
+void resetCodegenOptions();
+
+// First pass before codegen: gives every ENTER, label and ENSEMBLE of C.Program a dense slot
+// number and binds each use to one, so codegen indexes flat vectors instead of searching maps.
+// Undefined names and duplicate labels are reported here; returns the number of errors.
+unsigned resolveNames(Compilation &C);
+// after resolveNames: one basic block per label, created in F in program order
+void createLabelBlocks(Compilation &C, llvm::Function *F);
+
+// Runs after resolveNames: finds the variables that provably only ever hold integers of less
+// than 2^53 so they get an i64 slot instead of a double (loop counters, array indices, ...)
+// without changing a result.
+void inferIntegerVariables(Compilation &C);
+// after inference: does variable slot Slot live in an i64?
+bool isIntegerVar(int Slot);
+
+// --stream: instead of the passes above over the whole C.Program, every top-level statement is
+// resolved and generated into main as soon as the parser reduces it, and its nodes are dropped
+// (ASTArena::releaseNodes), so the AST never holds more than one statement. A label gets its
+// block on first mention: a jump to a label further down branches to that placeholder, which
+// moves into place once the label is reached. Integer inference needs the whole program, so
+// every variable is a double.
+class StreamingCodegen {
+  Compilation &C;
+  llvm::Module &M;
+  llvm::IRBuilder<> &Builder;
+  std::unique_ptr<Resolver> R;
+public:
+  StreamingCodegen(Compilation &C, llvm::Module &M, llvm::IRBuilder<> &Builder);
+  ~StreamingCodegen();
+  void statement(ASTNode *Stmt);
+  // at EXIT: labels that were jumped to but never defined; returns the errors of the whole program
+  unsigned finish();
 };
 
 // Numeric literal
@@ -29,6 +110,9 @@ public:
   llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                        llvm::IRBuilder<> &ChoreoBuilder,
                        llvm::Module *ChoreoModule) override;
+  BCValue bytecode(BytecodeCompiler &B) override;
+  // 3 or 3.0 are integers (-0.0 is not), but only while a double still represents them exactly
+  bool valueRange(ValueRange &Range) const override;
   void print(int indent = 0) const override {
     std::cout << std::string(indent, ' ')
               << "NumberExpr: " << Val << "\n";
@@ -44,38 +128,49 @@ public:
     // create a 64-bit integer constant
     return llvm::ConstantInt::get(llvm::Type::getInt64Ty(ChoreoContext), Val, true);
   }
+  BCValue bytecode(BytecodeCompiler &B) override;
+  bool valueRange(ValueRange &Range) const override;
   void print(int indent = 0) const override {
     std::cout << std::string(indent,' ')
               << "IntegerExpr: " << Val << "\n";
   }
 };
 // Variable reference
+// (names and string literals are StringRefs to the interned texts in the arena of their Compilation)
 class VariableExpr : public ASTNode {
 public:
-  std::string Name;
-  VariableExpr(const std::string &name) : Name(name) {}
+  llvm::StringRef Name;
+  int Slot = -1;   // dense variable slot from resolveNames()
+  int ArraySlot = -1;   // or: an ENSEMBLE on the right of a whole-ENSEMBLE assignment, read element by element
+  VariableExpr(llvm::StringRef name) : Name(name) {}
   llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                        llvm::IRBuilder<> &ChoreoBuilder,
                        llvm::Module *ChoreoModule) override;
+  BCValue bytecode(BytecodeCompiler &B) override;
+  void resolve(Resolver &R) override;
+  bool valueRange(ValueRange &Range) const override;
   void print(int indent = 0) const override {
     std::cout << std::string(indent, ' ')
-              << "VariableExpr: " << Name << "\n";
+              << "VariableExpr: " << Name.str() << "\n";
   }
 };
 
 // Variable declaration
 class VarDecl : public ASTNode {
 public:
-  std::string Name;
+  llvm::StringRef Name;
+  int Slot = -1;
   ASTNode *Init;
-  VarDecl(const std::string &name, ASTNode *init)
+  VarDecl(llvm::StringRef name, ASTNode *init)
     : Name(name), Init(init) {}
   llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                        llvm::IRBuilder<> &ChoreoBuilder,
                        llvm::Module *ChoreoModule) override;
+  BCValue bytecode(BytecodeCompiler &B) override;
+  void resolve(Resolver &R) override;
   void print(int indent = 0) const override {
     std::cout << std::string(indent, ' ')
-              << "VarDecl: " << Name << "\n";
+              << "VarDecl: " << Name.str() << "\n";
     Init->print(indent+2);
   }
 };
@@ -83,54 +178,64 @@ public:
 // Echo a string literal
 class EchoStr : public ASTNode {
 public:
-  std::string Str;
-  EchoStr(const std::string &s) : Str(s) {}
+  llvm::StringRef Str;
+  EchoStr(llvm::StringRef s) : Str(s) {}
   llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                        llvm::IRBuilder<> &ChoreoBuilder,
                        llvm::Module *ChoreoModule) override;
+  BCValue bytecode(BytecodeCompiler &B) override;
   void print(int indent = 0) const override {
     std::cout << std::string(indent, ' ')
-              << "EchoStr: \"" << Str << "\"\n";
+              << "EchoStr: \"" << Str.str() << "\"\n";
   }
 };
 
 // Echo a variable’s value
 class EchoVar : public ASTNode {
 public:
-  std::string Name;
-  EchoVar(const std::string &n) : Name(n) {}
+  llvm::StringRef Name;
+  int Slot = -1;
+  EchoVar(llvm::StringRef n) : Name(n) {}
   llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                        llvm::IRBuilder<> &ChoreoBuilder,
                        llvm::Module *ChoreoModule) override;
+  BCValue bytecode(BytecodeCompiler &B) override;
+  void resolve(Resolver &R) override;
   void print(int indent = 0) const override {
     std::cout << std::string(indent, ' ')
-              << "EchoVar: " << Name << "\n";
+              << "EchoVar: " << Name.str() << "\n";
   }
 };
 
 //Label block label:
 class Label : public ASTNode {
   public:
-    std::string Name;
-    Label(const std::string &n) : Name(n) {}
+    llvm::StringRef Name;
+    int Slot = -1;   // dense label slot
+    Label(llvm::StringRef n) : Name(n) {}
     llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                          llvm::IRBuilder<> &ChoreoBuilder,
                          llvm::Module *ChoreoModule) override;
+    BCValue bytecode(BytecodeCompiler &B) override;
+    void resolve(Resolver &R) override;
     void print(int indent = 0) const override {
-      std::cout<<std::string(indent,' ')<<"Label: "<<Name<<"\n";
+      std::cout<<std::string(indent,' ')<<"Label: "<<Name.str()<<"\n";
     }
   };
   
   // unconditional jump saying MOVE TO: label
   class Jump : public ASTNode {
   public:
-    std::string Target;
-    Jump(const std::string &t) : Target(t) {}
+    llvm::StringRef Target;
+    int Slot = -1;   // label slot of Target
+    Jump(llvm::StringRef t) : Target(t) {}
     llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                          llvm::IRBuilder<> &ChoreoBuilder,
                          llvm::Module *ChoreoModule) override;
+    BCValue bytecode(BytecodeCompiler &B) override;
+    void resolve(Resolver &R) override;
     void print(int indent = 0) const override {
-      std::cout<<std::string(indent,' ')<<"Jump to: "<<Target<<"\n";
+      std::cout<<std::string(indent,' ')<<"Jump to: "<<Target.str()<<"\n";
     }
   };
 
@@ -141,9 +246,16 @@ class BinaryExpr : public ASTNode {
 public:
   BinaryExpr(char op, ASTNode *l, ASTNode *r)
     : Op(op), Left(l), Right(r) {}
+  char op() const { return Op; }
+  const ASTNode *lhs() const { return Left; }
+  const ASTNode *rhs() const { return Right; }
   llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                        llvm::IRBuilder<> &ChoreoBuilder,
                        llvm::Module *ChoreoModule) override;
+  BCValue bytecode(BytecodeCompiler &B) override;
+  void resolve(Resolver &R) override;
+  // '/' keeps FP semantics (7 / 2 is 3.5), + - * of integers stay integers while they fit
+  bool valueRange(ValueRange &Range) const override;
   void print(int indent=0) const override {
     std::cout<<std::string(indent,' ')<<"BinaryExpr: "<<Op<<"\n";
     Left->print(indent+2);
@@ -152,17 +264,28 @@ public:
 };
 
 // Assignment: x = expr
+// When x names an ENSEMBLE (and no variable) the assignment covers every element: the RHS is
+// evaluated once per element, ENSEMBLEs in it read the same element and scalars are broadcast,
+// so `a = 0` fills, `a = b` copies and `a = b + c * 2` works element-wise.
 class Assign : public ASTNode {
-  std::string LHS;
+  llvm::StringRef LHS;
+  int Slot = -1;
+  int ArraySlot = -1;   // whole-ENSEMBLE assignment: the ENSEMBLE slot of LHS
   ASTNode *RHS;
+  std::vector<int> LengthChecks;   // ENSEMBLEs on the right whose size is only known at run time
 public:
-  Assign(const std::string &lhs, ASTNode *rhs)
+  Assign(llvm::StringRef lhs, ASTNode *rhs)
     : LHS(lhs), RHS(rhs) {}
   llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                        llvm::IRBuilder<> &ChoreoBuilder,
                        llvm::Module *ChoreoModule) override;
+  BCValue bytecode(BytecodeCompiler &B) override;
+  void resolve(Resolver &R) override;
+  bool assignsElements() const { return ArraySlot >= 0; }   // after resolveNames
+  int slot() const { return Slot; }
+  const ASTNode *rhs() const { return RHS; }
   void print(int indent=0) const override {
-    std::cout<<std::string(indent,' ')<<"Assign: "<<LHS<<"\n";
+    std::cout<<std::string(indent,' ')<<(ArraySlot >= 0 ? "Assign (all elements): " : "Assign: ")<<LHS.str()<<"\n";
     RHS->print(indent+2);
   }
 };
@@ -177,6 +300,8 @@ public:
   llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                        llvm::IRBuilder<> &ChoreoBuilder,
                        llvm::Module *ChoreoModule) override;
+  BCValue bytecode(BytecodeCompiler &B) override;
+  void resolve(Resolver &R) override;
   void print(int indent=0) const override {
     std::cout<<std::string(indent,' ')
              <<"ComparisonExpr: "<<Op<<"\n";
@@ -188,83 +313,191 @@ public:
 // IfStmt: SPIN cond THEN MOVE TO label
 class IfStmt : public ASTNode {
   ASTNode *Cond;
-  std::string Label;
+  llvm::StringRef Label;
+  int Slot = -1;   // label slot of Label
+  int Spin = -1;   // SPIN number, in program order (profile counters and weights)
 public:
-  IfStmt(ASTNode *c, const std::string &lbl)
+  IfStmt(ASTNode *c, llvm::StringRef lbl)
     : Cond(c), Label(lbl) {}
+  int target() const { return Slot; }
   llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                        llvm::IRBuilder<> &ChoreoBuilder,
                        llvm::Module *ChoreoModule) override;
+  BCValue bytecode(BytecodeCompiler &B) override;
+  void resolve(Resolver &R) override;
   void print(int indent=0) const override {
     std::cout<<std::string(indent,' ')
-             <<"IfStmt: jump to "<<Label<<" if\n";
+             <<"IfStmt: jump to "<<Label.str()<<" if\n";
     Cond->print(indent+2);
   }
 };
+// Per-loop hints written after TIMES: `REPEAT 100 TIMES UNROLL 4 VECTORIZE 8`
+// -1 = let the compiler decide, 0/1 = disable, k = unroll count / vector width;
+// FASTMATH turns on BlockFastMath for the FP arithmetic of the body,
+// PARALLEL spreads the iterations over threads (see Repeat)
+// (plain old data so the parser can carry it around in its %union)
+struct LoopHints {
+  int Unroll;
+  int Vectorize;
+  bool FastMath;
+  bool Parallel;
+};
+
+// How a PARALLEL loop body uses a variable (found by resolveNames):
+//   Shared     only read: every thread gets the value from before the loop
+//   Private    written before it is read in every iteration: per thread, the value of the last
+//              iteration is kept after the loop
+//   Induction  one `i = i + k` (k a whole number) per iteration: iteration j starts at i + j*k
+//   Reduction  only `s = s + e` / `s = s - e` (or only `s = s * e`), e not using s: partial
+//              results per chunk, combined in chunk order after the loop
+struct ParallelVar {
+  enum Kind { Shared, Private, Induction, Reduction };
+  int Slot;
+  Kind Use;
+  char Op;       // Reduction: '+' (also covers '-') or '*'
+  double Step;   // Induction
+};
+
 //Repeat a block of statements Count times
 class Repeat : public ASTNode {
   public:
     double  Count;
     std::vector<ASTNode*> Body;
-    Repeat(int  c, std::vector<ASTNode*> *body)
-      : Count(c), Body(std::move(*body)) {}
+    LoopHints Hints;
+    std::vector<ParallelVar> ParallelVars;   // PARALLEL: every variable the body uses
+    Repeat(double c, std::vector<ASTNode*> *body, LoopHints hints = LoopHints{-1, -1, false, false})
+      : Count(c), Body(std::move(*body)), Hints(hints) {}
     llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                          llvm::IRBuilder<> &ChoreoBuilder,
                          llvm::Module *ChoreoModule) override;
+    BCValue bytecode(BytecodeCompiler &B) override;
+    void resolve(Resolver &R) override;
+    // PARALLEL: the body as a function of a chunk of iterations, run by choreo_parallel_for
+    llvm::Value* codegenParallel(llvm::LLVMContext &ChoreoContext,
+                                 llvm::IRBuilder<> &ChoreoBuilder,
+                                 llvm::Module *ChoreoModule);
+    // the loop runs while its counter is below Count: REPEAT 2.5 TIMES is 3 trips
+    // (resolveNames rejects counts beyond an i64)
+    int64_t trips() const { return Count > 0 ? (int64_t)std::ceil(Count) : 0; }
     void print(int indent=0) const override {
       std::cout<<std::string(indent,' ')
-               <<"Repeat "<<Count<<" times\n";
+               <<"Repeat "<<Count<<" times";
+      if (Hints.Unroll >= 0)    std::cout<<" unroll "<<Hints.Unroll;
+      if (Hints.Vectorize >= 0) std::cout<<" vectorize "<<Hints.Vectorize;
+      if (Hints.FastMath)       std::cout<<" fastmath";
+      if (Hints.Parallel)       std::cout<<" parallel";
+      std::cout<<"\n";
       for (auto *stmt : Body)
         stmt->print(indent+2);
     }
   };
 
 
+  // ENSEMBLE a[n]: a zero-initialized global [n x double].
+  // ENSEMBLE a[n] FROM "file" / ENSEMBLE a FROM "file": the file mapped at run time (see
+  // runtime/mapfile.c); the global is then a double* to the data, plus an i64 a.len when the
+  // size comes from the file.
   class ArrayDecl : public ASTNode {
-    std::string Name;
+    llvm::StringRef Name;
+    int Slot = -1;   // dense array slot
     size_t      Count;
+    llvm::StringRef Path;   // FROM "file", empty for a plain ENSEMBLE
+    llvm::Value* codegenMapped(IRBuilder<> &ChoreoBuilder, Module *M);
   public:
-    ArrayDecl(const std::string &n, size_t c)
-      : Name(n), Count(c) {}
+    static const size_t FileSized = SIZE_MAX;   // Count of `ENSEMBLE a FROM "file"`
+    ArrayDecl(llvm::StringRef n, size_t c, llvm::StringRef path = llvm::StringRef())
+      : Name(n), Count(c), Path(path) {}
     llvm::Value* codegen(LLVMContext &ChoreoContext,
                          IRBuilder<> &ChoreoBuilder,
                          Module *M) override;
+    BCValue bytecode(BytecodeCompiler &B) override;
+    void resolve(Resolver &R) override;
+    void print(int indent=0) const override {
+      std::cout<<std::string(indent,' ')<<"ArrayDecl: "<<Name.str();
+      if (Count != FileSized) std::cout<<"["<<Count<<"]";
+      if (!Path.empty())      std::cout<<" from \""<<Path.str()<<"\"";
+      std::cout<<"\n";
+    }
+  };
+
+  // SAVE a TO "file": every element as a raw little-endian double
+  class SaveArray : public ASTNode {
+    llvm::StringRef Name, Path;
+    int Slot = -1;
+  public:
+    SaveArray(llvm::StringRef n, llvm::StringRef path) : Name(n), Path(path) {}
+    llvm::Value* codegen(LLVMContext &ChoreoContext,
+                         IRBuilder<> &ChoreoBuilder,
+                         Module *M) override;
+    BCValue bytecode(BytecodeCompiler &B) override;
+    void resolve(Resolver &R) override;
     void print(int indent=0) const override {
       std::cout<<std::string(indent,' ')
-               <<"ArrayDecl: "<<Name<<"["<<Count<<"]\n";
+               <<"SaveArray: "<<Name.str()<<" to \""<<Path.str()<<"\"\n";
     }
   };
   
   // arr[idx] so idx can be a expression here so we need ot keep it as a node cus expression is a node
   class IndexExpr : public ASTNode {
-    std::string Name;
+    llvm::StringRef Name;
+    int Slot = -1;
     ASTNode    *Idx;
   public:
-    IndexExpr(const std::string &n, ASTNode *i)
+    IndexExpr(llvm::StringRef n, ASTNode *i)
       : Name(n), Idx(i) {}
     llvm::Value* codegen(LLVMContext &ChoreoContext,
                          IRBuilder<> &ChoreoBuilder,
                          Module *M) override;
+    BCValue bytecode(BytecodeCompiler &B) override;
+    void resolve(Resolver &R) override;
     void print(int indent=0) const override {
       std::cout<<std::string(indent,' ')
-               <<"IndexExpr: "<<Name<<"[]\n";
+               <<"IndexExpr: "<<Name.str()<<"[]\n";
       Idx->print(indent+2);
     }
   };
   
+  // SUM(a), MIN(a), MAX(a), DOT(a, b): one call into the kernels of runtime/ensemble.c
+  class ReduceExpr : public ASTNode {
+  public:
+    enum Kind { Sum, Min, Max, Dot };
+  private:
+    Kind Op;
+    llvm::StringRef Name, Name2;   // Name2: second operand of DOT
+    int Slot = -1, Slot2 = -1;
+  public:
+    ReduceExpr(Kind op, llvm::StringRef n, llvm::StringRef n2 = llvm::StringRef())
+      : Op(op), Name(n), Name2(n2) {}
+    llvm::Value* codegen(LLVMContext &ChoreoContext,
+                         IRBuilder<> &ChoreoBuilder,
+                         Module *M) override;
+    BCValue bytecode(BytecodeCompiler &B) override;
+    void resolve(Resolver &R) override;
+    void print(int indent=0) const override {
+      static const char *names[] = { "SUM", "MIN", "MAX", "DOT" };
+      std::cout<<std::string(indent,' ')
+               <<"ReduceExpr: "<<names[Op]<<"("<<Name.str();
+      if (Op == Dot) std::cout<<", "<<Name2.str();
+      std::cout<<")\n";
+    }
+  };
+
   /// name[index] = rhs
   class StoreToIndex : public ASTNode {
-    std::string Name;
+    llvm::StringRef Name;
+    int Slot = -1;
     ASTNode *Idx, *RHS;
   public:
-    StoreToIndex(const std::string &n, ASTNode *i, ASTNode *r)
+    StoreToIndex(llvm::StringRef n, ASTNode *i, ASTNode *r)
       : Name(n), Idx(i), RHS(r) {}
     llvm::Value* codegen(LLVMContext &ChoreoContext,
                          IRBuilder<> &ChoreoBuilder,
                          Module *M) override;
+    BCValue bytecode(BytecodeCompiler &B) override;
+    void resolve(Resolver &R) override;
     void print(int indent=0) const override {
       std::cout<<std::string(indent,' ')
-               <<"StoreToIndex: "<<Name<<"[] =\n";
+               <<"StoreToIndex: "<<Name.str()<<"[] =\n";
       Idx->print(indent+2);
       RHS->print(indent+2);
     }
@@ -272,17 +505,20 @@ class Repeat : public ASTNode {
 
 
   class EchoIndexedVar : public ASTNode {
-    std::string Name;
+    llvm::StringRef Name;
+    int Slot = -1;
     ASTNode    *Idx;
   public:
-    EchoIndexedVar(const std::string &n, ASTNode *idx)
+    EchoIndexedVar(llvm::StringRef n, ASTNode *idx)
       : Name(n), Idx(idx) {}
     llvm::Value* codegen(llvm::LLVMContext &ChoreoContext,
                          llvm::IRBuilder<> &ChoreoBuilder,
                          llvm::Module *M) override;
+    BCValue bytecode(BytecodeCompiler &B) override;
+    void resolve(Resolver &R) override;
     void print(int indent=0) const override {
       std::cout<<std::string(indent,' ')
-               <<"EchoIndexedVar: "<<Name<<"[]\n";
+               <<"EchoIndexedVar: "<<Name.str()<<"[]\n";
       Idx->print(indent+2);
     }
   };
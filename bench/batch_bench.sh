@@ -0,0 +1,45 @@
+#!/bin/sh
+# Batch compilation: FILES generated scripts compiled at -O2 to IR, first with one
+# choreo process per file (the old deploy loop), then in one process with -j 1/2/4/8.
+# usage: bench/batch_bench.sh [choreo binary] [FILES]
+CHOREO=${1:-./choreo}
+FILES=${2:-64}
+DIR=${TMPDIR:-/tmp}/choreo_batch_bench.$$
+mkdir -p "$DIR"
+
+i=0
+while [ $i -lt "$FILES" ]; do
+  awk -v seed=$i 'BEGIN {
+    srand(seed)
+    for (v = 0; v < 200; v++) printf "ENTER v%d = %d\n", v, v
+    print "ENSEMBLE a[64]"
+    for (r = 0; r < 20; r++) {
+      printf "REPEAT %d TIMES\n", 10 + r
+      for (s = 0; s < 10; s++) printf "v%d = v%d + v%d * 3\n", int(rand() * 200), int(rand() * 200), int(rand() * 200)
+      printf "a[v%d - v%d] = v%d\n", r, r, r
+      print "ENDREPEAT"
+      printf "l%d:\nSPIN v%d > 100 THEN MOVE TO m%d\nECCO \"below\"\nm%d:\nECCO_D v%d\n", r, r, r, r, r
+    }
+    print "EXIT"
+  }' > "$DIR/f$i.choreo"
+  i=$((i + 1))
+done
+
+now() { date +%s%N; }
+report() { printf "%-22s %6d ms  %6d files/s\n" "$1" "$2" $(( FILES * 1000 / $2 )); }
+
+start=$(now)
+for f in "$DIR"/f*.choreo; do
+  "$CHOREO" -O2 "$f" > "${f%.choreo}.ll" 2>/dev/null || { echo "compile failed: $f"; exit 1; }
+done
+ms=$(( ($(now) - start) / 1000000 )); [ "$ms" -gt 0 ] || ms=1
+report "process per file" $ms
+
+for j in 1 2 4 8; do
+  start=$(now)
+  "$CHOREO" -O2 -j $j "$DIR"/f*.choreo 2>/dev/null || { echo "batch failed (-j $j)"; exit 1; }
+  ms=$(( ($(now) - start) / 1000000 )); [ "$ms" -gt 0 ] || ms=1
+  report "batch -j $j" $ms
+done
+echo "($(nproc) cores)"
+rm -rf "$DIR"
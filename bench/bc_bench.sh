@@ -0,0 +1,51 @@
+#!/bin/sh
+# IR text vs bitcode (--emit-bc) on large generated programs: time choreo spends writing the
+# module (the "emit" phase of --time-report), output size, and time for a consumer to load it
+# back (`opt -disable-output`: parse + verify, no passes). Best of 3.
+# usage: bench/bc_bench.sh [choreo binary] [SCALE]
+CHOREO=${1:-./choreo}
+SCALE=${2:-1}
+OPT=${OPT:-opt}
+DIR=${TMPDIR:-/tmp}/choreo_bc_bench.$$
+mkdir -p "$DIR"
+GEN="$(dirname "$0")/gen_program.sh"
+
+now() { date +%s%N; }
+# emit phase of one -O0 compile in microseconds; stdout of choreo goes to $1
+emit_us() {
+  out=$1; shift
+  "$CHOREO" --time-report -O0 "$@" 2>&1 >"$out" | awk '$1 == "emit" { printf "%d", $2 * 1000 }'
+}
+load_us() {
+  start=$(now)
+  "$OPT" -disable-output "$1" || { echo "opt failed on $1" >&2; exit 1; }
+  echo $(( ($(now) - start) / 1000 ))
+}
+best_of_3() {
+  best=
+  for k in 1 2 3; do
+    v=$("$@")
+    [ -z "$best" ] || [ "$v" -lt "$best" ] && best=$v
+  done
+  echo "$best"
+}
+# microseconds as ms with one decimal
+ms() { printf "%d.%d" $(( $1 / 1000 )) $(( $1 % 1000 / 100 )); }
+
+printf "%-16s %-5s %10s %10s %10s\n" "program" "form" "emit ms" "KiB" "load ms"
+for spec in exprs:$((2000 * SCALE)) mixed:$((200 * SCALE)) labels:$((1000 * SCALE)); do
+  shape=${spec%%:*}; size=${spec#*:}
+  sh "$GEN" "$shape" "$size" > "$DIR/p.choreo"
+  for form in text bc; do
+    if [ $form = text ]; then
+      out="$DIR/p.ll"
+      emit=$(best_of_3 emit_us "$out" "$DIR/p.choreo")
+    else
+      out="$DIR/p.bc"
+      emit=$(best_of_3 emit_us /dev/null --emit-bc -o "$out" "$DIR/p.choreo")
+    fi
+    load=$(best_of_3 load_us "$out")
+    printf "%-16s %-5s %10s %10d %10s\n" "$spec" $form "$(ms "$emit")" $(( $(wc -c < "$out") / 1024 )) "$(ms "$load")"
+  done
+done
+rm -rf "$DIR"
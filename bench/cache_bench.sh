@@ -0,0 +1,35 @@
+#!/bin/sh
+# --cache: cold (empty cache, compile + store) vs warm (hit, no frontend / backend) for a
+# generated program of SIZE, for each output kind the cache stores.
+# usage: bench/cache_bench.sh [choreo binary] [SIZE]
+CHOREO=${1:-./choreo}
+SIZE=${2:-200}
+DIR=${TMPDIR:-/tmp}/choreo_cache_bench.$$
+mkdir -p "$DIR"
+export CHOREO_CACHE_DIR="$DIR/cache"
+sh "$(dirname "$0")/gen_program.sh" mixed "$SIZE" > "$DIR/p.choreo"
+
+now() { date +%s%N; }
+# best of 3, so a warm run is really warm and a cold run really cold
+time_ms() {
+  mode=$1; shift
+  best=
+  for k in 1 2 3; do
+    [ "$mode" = cold ] && rm -rf "$CHOREO_CACHE_DIR"
+    start=$(now)
+    "$CHOREO" "$@" "$DIR/p.choreo" > /dev/null 2>&1 || { echo "failed: $*" >&2; exit 1; }
+    ms=$(( ($(now) - start) / 1000000 ))
+    [ -z "$best" ] || [ "$ms" -lt "$best" ] && best=$ms
+  done
+  echo "$best"
+}
+
+echo "mixed:$SIZE ($(wc -l < "$DIR/p.choreo") lines)"
+printf "%-28s %10s %10s %8s\n" "" "cold ms" "warm ms" "speedup"
+for args in "-O2" "-O2 --emit-obj -o $DIR/p.o" "-O2 --run" "-O0 --run"; do
+  cold=$(time_ms cold --cache $args)
+  warm=$(time_ms warm --cache $args)
+  [ "$warm" -gt 0 ] || warm=1
+  printf "%-28s %10d %10d %7dx\n" "$(echo "$args" | sed "s|$DIR/||")" "$cold" "$warm" $(( cold / warm ))
+done
+rm -rf "$DIR"
@@ -0,0 +1,118 @@
+#!/bin/sh
+# Behaviour check: the README example, the gen_program.sh shapes and the regression inputs below
+# are run every way choreo can run a program, -O0 and -O2 each. Every run must exit 0, and every
+# output must equal the one of plain --run -O0, which must be <name>.expected where there is one.
+# Only the sign of a NaN may differ: LLVM folds inf - inf to +nan where the FPU computes -nan,
+# and neither is specified.
+# Regression inputs:
+#   exprs-repeat  the exprs shape in REPEAT 3 TIMES: -O2 overflowed the stack in ScalarEvolution
+#                 on its long i64 chains (values that grow are doubles now)
+#   bounds        values past 2^53 (x * 2 seventy times, 25!), REPEAT 2.5 TIMES (3 trips)
+#   symbols       ENSEMBLEs named write, printf, malloc, choreo_echo_f64: they must not take over
+#                 the libc / runtime functions, in process (--echo=printf too) or linked (exe)
+#   mapped        the same for ENSEMBLEs FROM a file (open, close, mmap) and their lengths
+# usage: bench/check.sh [choreo binary]
+CHOREO=${1:-./choreo}
+HERE=$(dirname "$0")
+WORK=${TMPDIR:-/tmp}/choreo_check.$$
+mkdir -p "$WORK"
+
+awk '/^```choreo/ { on = 1; next } /^```/ { on = 0 } on' "$HERE/../README.md" > "$WORK/readme.choreo"
+sh "$HERE/gen_program.sh" nested 10 > "$WORK/nested.choreo"
+sh "$HERE/gen_program.sh" labels 50 > "$WORK/labels.choreo"
+sh "$HERE/gen_program.sh" ensemble 100 > "$WORK/ensemble.choreo"
+sh "$HERE/gen_program.sh" exprs 200 > "$WORK/exprs.choreo"
+sh "$HERE/gen_program.sh" mixed 100 > "$WORK/mixed.choreo"
+REPEAT=3 sh "$HERE/gen_program.sh" exprs 1000 > "$WORK/exprs-repeat.choreo"
+cat > "$WORK/bounds.choreo" <<'EOF'
+ENTER x = 1
+REPEAT 70 TIMES
+x = x * 2
+ENDREPEAT
+ECCO_D x
+ENTER f = 1
+ENTER k = 1
+REPEAT 25 TIMES
+f = f * k
+k = k + 1
+ENDREPEAT
+ECCO_D f
+REPEAT 2.5 TIMES
+ECCO_D k
+ENDREPEAT
+EXIT
+EOF
+printf "%s.000000\n" 1180591620717411303424 15511210043330986055303168 26 26 26 > "$WORK/bounds.expected"
+cat > "$WORK/symbols.choreo" <<'EOF'
+ENSEMBLE write[4]
+ENSEMBLE printf[4]
+ENSEMBLE malloc[4]
+ENSEMBLE choreo_echo_f64[4]
+write[0] = 3
+printf[1] = write[0] + 1
+malloc[2] = printf[1] + 1
+choreo_echo_f64[3] = malloc[2] + 1
+ECCO_D write[0]
+ECCO_D printf[1]
+ECCO_D malloc[2]
+ECCO_D choreo_echo_f64[3]
+EXIT
+EOF
+printf "%s.000000\n" 3 4 5 6 > "$WORK/symbols.expected"
+cat > "$WORK/mapped.choreo" <<EOF
+ENSEMBLE data[3]
+data[0] = 1
+data[1] = 2
+data[2] = 4
+SAVE data TO "$WORK/data.bin"
+ENSEMBLE open FROM "$WORK/data.bin"
+ENSEMBLE close FROM "$WORK/data.bin"
+ENSEMBLE mmap[2] FROM "$WORK/data.bin"
+ENTER s = 0
+s = SUM(open) + SUM(close) + DOT(mmap, mmap)
+ECCO_D s
+EXIT
+EOF
+printf "%s.000000\n" 19 > "$WORK/mapped.expected"
+
+# the ways to run a program ('+' for a space): in process, and for symbols / mapped also linked to an executable
+MODES="--run --run+--stream --interp+--tier-up=0 --interp+--tier-up=1 --run+--split=20+-j4"
+# run <program> <mode> <-O>: its output in out.txt, its exit status in $status
+run() {
+  if [ "$2" = exe ]; then
+    "$CHOREO" $3 -o "$WORK/a.out" "$WORK/$1.choreo" 2> "$WORK/err.txt" && "$WORK/a.out" > "$WORK/raw.txt" 2>> "$WORK/err.txt"
+  else
+    "$CHOREO" $(echo "$2" | tr + ' ') $3 "$WORK/$1.choreo" > "$WORK/raw.txt" 2> "$WORK/err.txt"
+  fi
+  status=$?
+  sed 's/-nan/nan/g' "$WORK/raw.txt" > "$WORK/out.txt"
+}
+
+failed=0
+for p in readme nested labels ensemble exprs mixed exprs-repeat bounds symbols mapped; do
+  modes=$MODES
+  [ $p = symbols ] || [ $p = mapped ] && modes="$MODES --run+--echo=printf exe"
+  ref=
+  for opt in -O0 -O2; do
+    for mode in $modes; do
+      run $p $mode $opt
+      mode=$(echo "$mode" | tr + ' ')
+      if [ $status != 0 ]; then
+        echo "FAIL $p: $mode $opt exited with $status"; sed 's/^/  /' "$WORK/err.txt" | head -5
+        failed=$((failed + 1))
+      elif [ -z "$ref" ]; then
+        ref="$mode $opt"; mv "$WORK/out.txt" "$WORK/ref.txt"
+      elif ! cmp -s "$WORK/ref.txt" "$WORK/out.txt"; then
+        echo "FAIL $p: $mode $opt differs from $ref"; diff "$WORK/ref.txt" "$WORK/out.txt" | head -5
+        failed=$((failed + 1))
+      fi
+    done
+  done
+  if [ -f "$WORK/$p.expected" ] && [ -n "$ref" ] && ! cmp -s "$WORK/$p.expected" "$WORK/ref.txt"; then
+    echo "FAIL $p: $ref is not what it should print"; diff "$WORK/$p.expected" "$WORK/ref.txt" | head -5
+    failed=$((failed + 1))
+  fi
+  [ -n "$ref" ] && printf "%-13s %5d lines of output\n" "$p" "$(wc -l < "$WORK/ref.txt")"
+done
+rm -rf "$WORK"
+[ $failed = 0 ] && echo "all outputs agree" || { echo "$failed failed"; exit 1; }
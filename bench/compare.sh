@@ -0,0 +1,32 @@
+#!/bin/sh
+# Compares two commits recorded by bench/suite.sh (the last run of each shape per commit).
+# usage: bench/compare.sh [old commit] [new commit]    (default: the last two commits recorded)
+HERE=$(dirname "$0")
+RESULTS=${RESULTS:-$HERE/results.csv}
+[ -f "$RESULTS" ] || { echo "no $RESULTS yet: run make bench first"; exit 1; }
+
+OLD=$1 NEW=$2
+if [ -z "$NEW" ]; then
+  commits=$(awk -F, 'NR > 1 && !seen[$1]++ { print $1 }' "$RESULTS" | tail -2)
+  [ -n "$OLD" ] || OLD=$(echo "$commits" | head -1)
+  NEW=$(echo "$commits" | tail -1)
+fi
+
+awk -F, -v old="$OLD" -v new="$NEW" '
+function pct(a, b) { return a > 0 ? sprintf("%+.1f%%", (b - a) * 100 / a) : "-" }
+NR > 1 && ($1 == old || $1 == new) {
+  if (!($3 in order)) { order[$3] = ++n; shapes[n] = $3 }
+  compile[$1, $3] = $7; rss[$1, $3] = $9; run[$1, $3] = $10
+}
+END {
+  printf "%s -> %s\n", old, new
+  printf "%-9s %12s %12s %8s %10s %10s %8s %10s %10s %8s\n", "shape", "compile_ms", "", "", "rss_KiB", "", "", "run_ms", "", ""
+  for (i = 1; i <= n; i++) {
+    s = shapes[i]
+    if (!((old, s) in compile) || !((new, s) in compile)) continue
+    printf "%-9s %12s %12s %8s %10s %10s %8s %10s %10s %8s\n", s,
+      compile[old, s], compile[new, s], pct(compile[old, s], compile[new, s]),
+      rss[old, s], rss[new, s], pct(rss[old, s], rss[new, s]),
+      run[old, s], run[new, s], pct(run[old, s], run[new, s])
+  }
+}' "$RESULTS"
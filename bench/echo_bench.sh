@@ -0,0 +1,21 @@
+#!/bin/sh
+# Output throughput of compiled programs: ECCO lowered to one printf per
+# statement (--echo=printf) vs the buffered runtime (--echo=runtime).
+# usage: bench/echo_bench.sh [choreo binary] [script]
+CHOREO=${1:-./choreo}
+SCRIPT=${2:-bench/echo.choreo}
+OUT=${TMPDIR:-/tmp}/choreo_echo_bench.$$
+
+now() { date +%s%N; }
+
+for mode in printf runtime; do
+  "$CHOREO" -O2 --echo=$mode "$SCRIPT" -o "$OUT" 2>/dev/null || { echo "compile failed ($mode)"; exit 1; }
+  lines=$("$OUT" | wc -l)
+  start=$(now)
+  "$OUT" > /dev/null
+  end=$(now)
+  ms=$(( (end - start) / 1000000 ))
+  [ "$ms" -gt 0 ] || ms=1
+  printf "%-8s %10d lines  %6d ms  %10d lines/s\n" "$mode" "$lines" "$ms" $(( lines * 1000 / ms ))
+done
+rm -f "$OUT"
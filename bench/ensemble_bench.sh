@@ -0,0 +1,75 @@
+#!/bin/sh
+# Whole-ENSEMBLE statements against the hand-written REPEAT loops they replace: element-wise
+# arithmetic, fill, copy, SUM and DOT over N-element ENSEMBLEs, repeated OUTER times (b[0] is
+# bumped every round so nothing is loop invariant). Run with --run -O2 -march=native; the
+# reductions once per kernel path of runtime/ensemble.c (CHOREO_SIMD). Execute time, best of 3,
+# and the printed result.
+# usage: bench/ensemble_bench.sh [choreo binary] [N] [OUTER]
+CHOREO=${1:-./choreo}
+N=${2:-4096}
+OUTER=${3:-100000}
+DIR=${TMPDIR:-/tmp}/choreo_ensemble_bench.$$
+mkdir -p "$DIR"
+
+# $1 = the statements of one round; the hand-written forms use i as the index
+gen() {
+  cat <<EOS
+ENSEMBLE a[$N]
+ENSEMBLE b[$N]
+ENSEMBLE c[$N]
+ENTER i = 0
+REPEAT $N TIMES
+b[i] = i / 7
+c[i] = i / 3
+i = i + 1
+ENDREPEAT
+ENTER s = 0
+REPEAT $OUTER TIMES
+b[0] = b[0] + 1
+$1
+ENDREPEAT
+s = s + a[$((N - 1))]
+ECCO_D s
+EXIT
+EOS
+}
+# $1 = body of a REPEAT N TIMES over i
+loop() {
+  printf "i = 0\nREPEAT %s TIMES\n%s\ni = i + 1\nENDREPEAT" "$N" "$1"
+}
+
+# $1 = label, $2 = source, the rest = environment
+run() {
+  label=$1; src=$2; shift 2
+  best=
+  for k in 1 2 3; do
+    ms=$(env "$@" "$CHOREO" --run -O2 -march=native --time-report "$src" 2>&1 >"$DIR/out" |
+         awk '$1 == "execute" { printf "%d", $2 }')
+    [ -n "$ms" ] || { echo "run failed: $label" >&2; exit 1; }
+    [ -z "$best" ] || [ "$ms" -lt "$best" ] && best=$ms
+  done
+  printf "  %-22s %8d ms   %s\n" "$label" "$best" "$(cat "$DIR/out")"
+}
+
+echo "N=$N OUTER=$OUTER ($(( N * OUTER / 1000000 ))M elements per case)"
+for case in "elementwise|a[i] = b[i] + c[i] * 2|a = b + c * 2" \
+            "fill|a[i] = 0|a = 0" \
+            "copy|a[i] = b[i]|a = b"; do
+  name=${case%%|*}; rest=${case#*|}
+  echo "$name"
+  gen "$(loop "${rest%%|*}")" > "$DIR/loop.choreo"
+  gen "${rest#*|}" > "$DIR/stmt.choreo"
+  run "REPEAT loop" "$DIR/loop.choreo"
+  run "${rest#*|}" "$DIR/stmt.choreo"
+done
+for case in "sum|s = s + b[i]|s = s + SUM(b)" "dot|s = s + b[i] * c[i]|s = s + DOT(b, c)"; do
+  name=${case%%|*}; rest=${case#*|}
+  echo "$name"
+  gen "$(loop "${rest%%|*}")" > "$DIR/loop.choreo"
+  gen "${rest#*|}" > "$DIR/stmt.choreo"
+  run "REPEAT loop" "$DIR/loop.choreo"
+  for simd in scalar sse2 avx2; do
+    run "${rest#*|} $simd" "$DIR/stmt.choreo" CHOREO_SIMD=$simd
+  done
+done
+rm -rf "$DIR"
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Fast-math on reduction loops: sum, dot product and sum of squares over two N-element
+# ENSEMBLEs, repeated OUTER times, run (--run -O2 -march=native) with strict FP, with
+# --fast-math, with a FASTMATH hint on the inner loop only, and with --fast-math=fast.
+# Prints the execute time (best of 3) and the result, which strict FP keeps bit-exact.
+# usage: bench/fastmath_bench.sh [choreo binary] [N] [OUTER]
+CHOREO=${1:-./choreo}
+N=${2:-4096}
+OUTER=${3:-100000}
+DIR=${TMPDIR:-/tmp}/choreo_fastmath_bench.$$
+mkdir -p "$DIR"
+
+# $1 = statement accumulating into s, $2 = hint after TIMES
+gen() {
+  cat <<EOS
+ENSEMBLE a[$N]
+ENSEMBLE b[$N]
+ENTER i = 0
+REPEAT $N TIMES
+a[i] = i / 7
+b[i] = i / 3
+i = i + 1
+ENDREPEAT
+ENTER s = 0
+REPEAT $OUTER TIMES
+i = 0
+REPEAT $N TIMES $2
+$1
+i = i + 1
+ENDREPEAT
+ENDREPEAT
+ECCO_D s
+EXIT
+EOS
+}
+
+# $1 = label, the rest = choreo arguments
+run() {
+  label=$1; shift
+  best=
+  for k in 1 2 3; do
+    ms=$("$CHOREO" --run -O2 -march=native --time-report "$@" 2>&1 >"$DIR/out" |
+         awk '$1 == "execute" { printf "%d", $2 }')
+    [ -n "$ms" ] || { echo "run failed: $*" >&2; exit 1; }
+    [ -z "$best" ] || [ "$ms" -lt "$best" ] && best=$ms
+  done
+  printf "  %-18s %8d ms   %s\n" "$label" "$best" "$(cat "$DIR/out")"
+}
+
+echo "N=$N OUTER=$OUTER ($(( N * OUTER / 1000000 ))M iterations per kernel)"
+for kernel in "sum:s = s + a[i]" "dot:s = s + a[i] * b[i]" "squares:s = s + a[i] * a[i] - b[i]"; do
+  name=${kernel%%:*}; stmt=${kernel#*:}
+  echo "$name: $stmt"
+  gen "$stmt" "" > "$DIR/strict.choreo"
+  gen "$stmt" FASTMATH > "$DIR/hint.choreo"
+  run strict "$DIR/strict.choreo"
+  run --fast-math --fast-math "$DIR/strict.choreo"
+  run "FASTMATH hint" "$DIR/hint.choreo"
+  run --fast-math=fast --fast-math=fast "$DIR/strict.choreo"
+done
+rm -rf "$DIR"
@@ -0,0 +1,78 @@
+/* fmt_f64_bench.c -- checks choreo_format_f64 against printf("%f") and times both
+ *
+ * Random doubles from a few distributions scripts actually print (integers,
+ * values with a couple of decimals, and raw bit patterns over the whole exponent
+ * range); every value has to format byte-for-byte like snprintf("%f").
+ * usage: fmt_f64_bench [count]      exit status 1 on the first mismatch */
+#include "../runtime/choreo_rt.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t Rng = 0x9E3779B97F4A7C15ull;
+static uint64_t next(void) {                     /* xorshift64* */
+  Rng ^= Rng >> 12; Rng ^= Rng << 25; Rng ^= Rng >> 27;
+  return Rng * 0x2545F4914F6CDD1Dull;
+}
+
+static double randomDouble(int kind) {
+  double d;
+  uint64_t bits;
+  switch (kind) {
+  case 0:  return (double)(int64_t)(next() % 2000001) - 1000000;         /* integers */
+  case 1:  return (double)(int64_t)(next() % 20000001 - 10000000) / 100; /* 2 decimals */
+  case 2:  return ldexp((double)(next() >> 11), -(int)(next() % 80));    /* fractions */
+  default:                                                              /* any bit pattern */
+    bits = next();
+    memcpy(&d, &bits, sizeof d);
+    return d;
+  }
+}
+
+static double seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  long count = argc > 1 ? atol(argv[1]) : 2000000;
+  double *vals = malloc(sizeof(double) * count);
+  if (!vals) return 2;
+  for (long i = 0; i < count; ++i) vals[i] = randomDouble((int)(i % 4));
+  vals[0] = -0.0; if (count > 1) vals[1] = 0.5e-6; if (count > 2) vals[2] = 2.5e-6;
+
+  char a[CHOREO_F64_TEXT_MAX + 1], b[CHOREO_F64_TEXT_MAX + 1];
+  for (long i = 0; i < count; ++i) {
+    size_t n = choreo_format_f64(vals[i], a);
+    a[n] = '\0';
+    snprintf(b, sizeof b, "%f", vals[i]);
+    if (strcmp(a, b) != 0) {
+      fprintf(stderr, "mismatch for %a: got \"%s\", printf says \"%s\"\n", vals[i], a, b);
+      return 1;
+    }
+  }
+  printf("%ld values match printf(\"%%f\")\n", count);
+
+  /* timing per distribution, results summed so nothing gets optimized away */
+  static const char *kinds[] = { "integers", "2 decimals", "fractions", "any bits" };
+  size_t sink = 0;
+  printf("%-12s %14s %18s\n", "values", "snprintf ns", "choreo_format ns");
+  for (int k = 0; k < 4; ++k) {
+    long n = 0;
+    double t0 = seconds();
+    for (long i = k; i < count; i += 4, ++n) sink += (size_t)snprintf(b, sizeof b, "%f", vals[i]);
+    double t1 = seconds();
+    for (long i = k; i < count; i += 4) sink += choreo_format_f64(vals[i], a);
+    double t2 = seconds();
+    if (!n) continue;
+    printf("%-12s %14.1f %18.1f   (%.1fx)\n", kinds[k],
+           (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / n, (t1 - t0) / (t2 - t1));
+  }
+  printf("[%zu]\n", sink);
+  free(vals);
+  return 0;
+}
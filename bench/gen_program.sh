@@ -0,0 +1,79 @@
+#!/bin/sh
+# Synthetic ChoreoLang programs for the benchmark suite, written to stdout.
+# usage: bench/gen_program.sh <shape> <size> [seed]
+#   nested    <size> blocks of REPEATs nested DEPTH deep (default 8, 3 trips each)
+#   labels    <size> label / SPIN pairs inside a 10000-times label loop
+#   ensemble  16 ENSEMBLEs of <size> elements, filled and summed by REPEATs
+#   exprs     <size> assignments with LEN-term expression chains (default 64)
+#   mixed     all of the above at a quarter of <size> each
+# REPEAT=<n> runs the statements after the ENTERs n times in one loop around them
+SHAPE=${1:?shape: nested|labels|ensemble|exprs|mixed}
+SIZE=${2:?size}
+SEED=${3:-1}
+
+awk -v shape="$SHAPE" -v size="$SIZE" -v seed="$SEED" \
+    -v depth="${DEPTH:-8}" -v len="${LEN:-64}" -v repeat="${REPEAT:-0}" '
+function vars(n,   i) { for (i = 0; i < n; i++) printf "ENTER v%d = %d\n", i, i + 1 }
+
+function nested(n,   b, d, s) {
+  for (b = 0; b < n; b++) {
+    for (d = 0; d < depth; d++) {
+      printf "%*sREPEAT 3 TIMES\n", d * 2, ""
+      printf "%*sv%d = v%d + v%d * 2 - v%d\n", d * 2 + 2, "", (b + d) % 16, (b + d + 1) % 16, (b + 2 * d) % 16, (b + d) % 16
+    }
+    for (d = depth - 1; d >= 0; d--) printf "%*sENDREPEAT\n", d * 2, ""
+  }
+}
+
+function labels(n, tag,   i) {
+  printf "ENTER round%s = 0\n", tag
+  printf "top%s:\n", tag
+  for (i = 0; i < n; i++) {
+    printf "SPIN v%d > %d THEN MOVE TO skip%s_%d\n", i % 16, int(rand() * 64), tag, i
+    printf "v%d = v%d + 1\n", (i + 1) % 16, (i + 3) % 16
+    printf "skip%s_%d:\n", tag, i
+  }
+  printf "round%s = round%s + 1\n", tag, tag
+  printf "SPIN round%s < 10000 THEN MOVE TO top%s\n", tag, tag
+}
+
+function ensemble(n, tag,   a) {
+  printf "ENTER s%s = 0\n", tag
+  for (a = 0; a < 16; a++) {
+    printf "ENSEMBLE e%s_%d[%d]\n", tag, a, n
+    printf "ENTER i%s_%d = 0\n", tag, a
+    printf "REPEAT %d TIMES\n  e%s_%d[i%s_%d] = i%s_%d * 0.5 + %d\n  i%s_%d = i%s_%d + 1\nENDREPEAT\n", n, tag, a, tag, a, tag, a, a, tag, a, tag, a
+    printf "i%s_%d = 0\n", tag, a
+    printf "REPEAT %d TIMES\n  s%s = s%s + e%s_%d[i%s_%d]\n  i%s_%d = i%s_%d + 1\nENDREPEAT\n", n, tag, tag, tag, a, tag, a, tag, a, tag, a
+  }
+  printf "ECCO_D s%s\n", tag
+}
+
+function exprs(n,   i, t, op) {
+  for (i = 0; i < n; i++) {
+    printf "v%d = v%d", i % 16, int(rand() * 16)
+    for (t = 1; t < len; t++) {
+      op = substr("+-*+", int(rand() * 4) + 1, 1)
+      if (rand() < 0.5) printf " %s v%d", op, int(rand() * 16)
+      else              printf " %s %d", op, int(rand() * 9) + 1
+    }
+    printf "\n"
+  }
+}
+
+BEGIN {
+  srand(seed)
+  vars(16)
+  if (repeat > 0) printf "REPEAT %d TIMES\n", repeat
+  if (shape == "nested")        nested(size)
+  else if (shape == "labels")   labels(size, "")
+  else if (shape == "ensemble") ensemble(size, "")
+  else if (shape == "exprs")    exprs(size)
+  else if (shape == "mixed") {
+    q = int(size / 4); if (q < 1) q = 1
+    nested(q); labels(q, "l"); ensemble(q, "e"); exprs(q)
+  } else { print "unknown shape " shape > "/dev/stderr"; exit 1 }
+  if (repeat > 0) print "ENDREPEAT"
+  for (i = 0; i < 16; i++) printf "ECCO_D v%d\n", i
+  print "EXIT"
+}'
@@ -0,0 +1,60 @@
+#!/bin/sh
+# Start-up against steady state: one REPEAT loop of a few scalar operations at trip counts
+# 1, 10, 100, ... MAX, whole-process wall time of --run -O2 (module + -O2 + JIT before the first
+# statement), --interp --tier-up=0 (bytecode only) and --interp -O2 (bytecode, the loop tiers up
+# to -O2 native code once it has run --tier-up iterations). Prints the trip count from which
+# the JIT beats pure interpretation (the crossover) and checks the three agree on the output.
+# usage: bench/interp_bench.sh [choreo binary] [MAX] [TIER_UP]
+CHOREO=${1:-./choreo}
+MAX=${2:-10000000}
+TIER=${3:-10000}
+HERE=$(dirname "$0")
+MEASURE=$HERE/measure
+DIR=${TMPDIR:-/tmp}/choreo_interp_bench.$$
+mkdir -p "$DIR"
+
+# $1 = mode label, $2 = trip count, the rest = options: best wall ms of 3, output in $DIR/<label>.out
+run() {
+  label=$1; n=$2; shift 2
+  for k in 1 2 3; do
+    "$MEASURE" "$CHOREO" "$@" "$DIR/loop$n.choreo"
+  done | awk -v what="$label N=$n" '$3 != 0 { print "run failed: " what > "/dev/stderr"; bad = 1 }
+                                    NR == 1 || $1 < best { best = $1 }
+                                    END { if (bad) exit 1; printf "%.1f", best }' || return 1
+  "$CHOREO" "$@" "$DIR/loop$n.choreo" > "$DIR/$label.out" 2>/dev/null
+}
+
+echo "one loop, whole-process wall ms (best of 3), tier-up after $TIER iterations"
+printf "  %10s %10s %10s %10s\n" N run_O2 interp tiered
+crossover=
+n=1
+while [ "$n" -le "$MAX" ]; do
+  cat > "$DIR/loop$n.choreo" <<EOS
+ENTER i = 0
+ENTER x = 1
+ENTER s = 0
+REPEAT $n TIMES
+x = x * 1.000001 + 0.5
+s = s + x - i * 0.25
+i = i + 1
+ENDREPEAT
+ECCO_D i
+ECCO_D s
+EXIT
+EOS
+  jit=$(run jit "$n" --run -O2) &&
+  interp=$(run interp "$n" --interp --tier-up=0) &&
+  tiered=$(run tiered "$n" --interp -O2 --tier-up="$TIER") || { rm -rf "$DIR"; exit 1; }
+  cmp -s "$DIR/jit.out" "$DIR/interp.out" && cmp -s "$DIR/jit.out" "$DIR/tiered.out" ||
+    { echo "outputs differ at N=$n" >&2; rm -rf "$DIR"; exit 1; }
+  printf "  %10d %10s %10s %10s\n" "$n" "$jit" "$interp" "$tiered"
+  [ -z "$crossover" ] && awk "BEGIN { exit !($jit < $interp) }" && crossover=$n
+  rm -f "$DIR/loop$n.choreo"
+  n=$((n * 10))
+done
+if [ -n "$crossover" ]; then
+  echo "crossover: --run -O2 is faster than pure interpretation from N=$crossover"
+else
+  echo "crossover: interpretation stays faster up to N=$MAX"
+fi
+rm -rf "$DIR"
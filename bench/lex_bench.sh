@@ -0,0 +1,40 @@
+#!/bin/sh
+# Lexer throughput: a generated script of about MB megabytes (the mixed program of
+# gen_program.sh, repeated, with strings and labels), tokenized by the default lexer straight
+# from the mapped file and by the flex scanner (--lexer=flex). A stray `$` on the last line
+# stops the compile right after the lex pass of --time-report, so nothing else is timed; the
+# "lex" phase (best of 3) gives the MB/s of each.
+# usage: bench/lex_bench.sh [choreo binary] [MB]
+CHOREO=${1:-./choreo}
+MB=${2:-50}
+DIR=${TMPDIR:-/tmp}/choreo_lex_bench.$$
+mkdir -p "$DIR"
+SCRIPT=$DIR/big.choreo
+
+sh "$(dirname "$0")/gen_program.sh" mixed 400 > "$DIR/part.choreo" || exit 1
+printf 'ECCO "a string literal, with spaces"\nlabel_%d:\nENTER x_%d = 12345.678 + 0.125 * 3\n' 1 1 2 2 >> "$DIR/part.choreo"
+: > "$SCRIPT"
+while [ "$(wc -c < "$SCRIPT")" -lt $(( MB * 1048576 )) ]; do
+  cat "$DIR/part.choreo" >> "$SCRIPT"
+done
+echo '$' >> "$SCRIPT"
+bytes=$(wc -c < "$SCRIPT")
+
+# $1 = label, $2 = extra option; prints the best lex time of 3 and MB/s
+run() {
+  best=
+  for k in 1 2 3; do
+    "$CHOREO" --time-report $2 "$SCRIPT" > /dev/null 2> "$DIR/report"
+    ms=$(awk '$1 == "lex" { print $2 }' "$DIR/report")
+    [ -n "$ms" ] || { echo "no lex phase: $1" >&2; cat "$DIR/report" >&2; rm -rf "$DIR"; exit 1; }
+    [ -z "$best" ] || [ "$(awk -v a="$ms" -v b="$best" 'BEGIN { print (a < b) }')" = 1 ] && best=$ms
+  done
+  awk -v l="$1" -v ms="$best" -v b="$bytes" 'BEGIN { printf "  %-8s %10.1f ms  %8.1f MB/s\n", l, ms, b / 1048576 / (ms / 1000) }'
+  eval "ms_$3=$best"
+}
+
+printf "%d bytes, %d lines\n" "$bytes" "$(wc -l < "$SCRIPT")"
+run flex --lexer=flex flex
+run mapped "" mapped
+awk -v a="$ms_flex" -v b="$ms_mapped" 'BEGIN { printf "  speedup  %10.2fx\n", a / b }'
+rm -rf "$DIR"
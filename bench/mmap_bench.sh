@@ -0,0 +1,60 @@
+#!/bin/sh
+# ENSEMBLE a FROM "file" against the only way to get data in before it: a script with one
+# a[i] = v line per element. Both sum the same N doubles; wall time of --run -O2 (compile and
+# execute), best of 3. Then BIG doubles, written by a script with SAVE, are mapped and summed
+# by a compiled executable: wall time with the file in the page cache, and the MB/s it makes.
+# usage: bench/mmap_bench.sh [choreo binary] [N] [BIG]
+CHOREO=${1:-./choreo}
+N=${2:-5000}
+BIG=${3:-33554432}
+DIR=${TMPDIR:-/tmp}/choreo_mmap_bench.$$
+mkdir -p "$DIR"
+
+now_ms() { echo $(( $(date +%s%N) / 1000000 )); }
+
+# $1 = label, $2 = command; prints the best wall time of 3 and the output
+run() {
+  best=
+  for k in 1 2 3; do
+    t0=$(now_ms)
+    sh -c "$2" >"$DIR/out" 2>&1 || { echo "run failed: $1" >&2; cat "$DIR/out" >&2; exit 1; }
+    ms=$(( $(now_ms) - t0 ))
+    [ -z "$best" ] || [ "$ms" -lt "$best" ] && best=$ms
+  done
+  printf "  %-26s %8d ms   %s\n" "$1" "$best" "$(tr '\n' ' ' < "$DIR/out")"
+}
+
+# $1 = count, $2 = output file: a script that fills a[i] = i / 4 and saves it
+save_script() {
+  cat <<EOS
+ENSEMBLE a[$1]
+ENTER i = 0
+REPEAT $1 TIMES
+a[i] = i / 4
+i = i + 1
+ENDREPEAT
+SAVE a TO "$2"
+EXIT
+EOS
+}
+
+echo "N=$N"
+save_script "$N" "$DIR/small.bin" > "$DIR/save.choreo"
+"$CHOREO" --run -O2 "$DIR/save.choreo" || exit 1
+{
+  echo "ENSEMBLE a[$N]"
+  awk -v n="$N" 'BEGIN { for (i = 0; i < n; ++i) printf "a[%d] = %.17g\n", i, i / 4 }'
+  printf "ENTER s = 0\ns = SUM(a)\nECCO_D s\nEXIT\n"
+} > "$DIR/embedded.choreo"
+printf 'ENSEMBLE a FROM "%s"\nENTER s = 0\ns = SUM(a)\nECCO_D s\nEXIT\n' "$DIR/small.bin" > "$DIR/mapped.choreo"
+run "a[i] = v script ($(wc -c < "$DIR/embedded.choreo") B)" "'$CHOREO' --run -O2 '$DIR/embedded.choreo'"
+run "ENSEMBLE a FROM file" "'$CHOREO' --run -O2 '$DIR/mapped.choreo'"
+
+echo "BIG=$BIG ($(( BIG * 8 / 1048576 )) MiB)"
+save_script "$BIG" "$DIR/big.bin" > "$DIR/save.choreo"
+"$CHOREO" --run -O2 "$DIR/save.choreo" || exit 1
+printf 'ENSEMBLE a FROM "%s"\nENTER s = 0\ns = SUM(a)\nECCO_D s\nEXIT\n' "$DIR/big.bin" > "$DIR/sum.choreo"
+"$CHOREO" -O2 -march=native -o "$DIR/sum" "$DIR/sum.choreo" || exit 1
+run "map + SUM" "'$DIR/sum'"
+awk -v b="$BIG" -v ms="$best" 'BEGIN { printf "  %-26s %8.0f MB/s\n", "", (ms > 0 ? b * 8 / 1000 / ms : 0) }'
+rm -rf "$DIR"
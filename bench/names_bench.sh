@@ -0,0 +1,28 @@
+#!/bin/sh
+# Front-end cost of name handling: a generated script with N distinct ENTER
+# variables (every one read and assigned again) plus a label pair every 1000
+# statements, compiled at -O0 to IR so codegen dominates.
+# usage: bench/names_bench.sh [choreo binary] [N]
+CHOREO=${1:-./choreo}
+N=${2:-100000}
+SCRIPT=${TMPDIR:-/tmp}/choreo_names_bench.$$.choreo
+
+awk -v n="$N" 'BEGIN {
+  srand(1)
+  for (i = 0; i < n; i++) printf "ENTER v%d = %d\n", i, i % 97
+  for (i = 0; i < n; i++) {
+    a = int(rand() * n); b = int(rand() * n)
+    printf "v%d = v%d + v%d * 2\n", i, a, b
+    if (i % 1000 == 0) printf "l%d:\nSPIN v%d > 1000 THEN MOVE TO l%dx\nl%dx:\n", i, a, i, i
+  }
+  print "ECCO_D v5"
+  print "EXIT"
+}' > "$SCRIPT"
+
+now() { date +%s%N; }
+
+start=$(now)
+"$CHOREO" -O0 "$SCRIPT" > /dev/null 2>&1 || { echo "compile failed"; rm -f "$SCRIPT"; exit 1; }
+end=$(now)
+printf "%d identifiers  %6d ms\n" "$N" $(( (end - start) / 1000000 ))
+rm -f "$SCRIPT"
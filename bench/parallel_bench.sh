@@ -0,0 +1,73 @@
+#!/bin/sh
+# Scaling of REPEAT n TIMES PARALLEL: an element-wise kernel with a costly inner loop per
+# element, and a reduction over the same ENSEMBLE. Runs the plain REPEAT, then the PARALLEL
+# loop with CHOREO_THREADS=1, 2, 4, ... up to the cpu count (--run -O2 -march=native). Execute
+# time (best of 3), speedup over the plain loop, and the printed results, which do not depend
+# on the thread count.
+# usage: bench/parallel_bench.sh [choreo binary] [N] [INNER]
+CHOREO=${1:-./choreo}
+N=${2:-200000}
+INNER=${3:-200}
+DIR=${TMPDIR:-/tmp}/choreo_parallel_bench.$$
+mkdir -p "$DIR"
+CPUS=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+
+# $1 = hint after TIMES
+gen() {
+  cat <<EOS
+ENSEMBLE a[$N]
+ENTER i = 0
+ENTER j = 0
+ENTER x = 0.5
+ENTER s = 0
+REPEAT $N TIMES $1
+x = i / $N
+j = 0
+REPEAT $INNER TIMES
+x = x * x - 0.5 * x + 0.25
+j = j + 1
+ENDREPEAT
+a[i] = x
+i = i + 1
+ENDREPEAT
+i = 0
+REPEAT $N TIMES $1
+s = s + a[i] * a[i]
+i = i + 1
+ENDREPEAT
+ECCO_D x
+ECCO_D s
+EXIT
+EOS
+}
+
+# $1 = source, the rest = environment; prints the best execute time in ms
+best_ms() {
+  src=$1; shift
+  best=
+  for k in 1 2 3; do
+    ms=$(env "$@" "$CHOREO" --run -O2 -march=native --time-report "$src" 2>&1 >"$DIR/out" |
+         awk '$1 == "execute" { printf "%d", $2 }')
+    [ -n "$ms" ] || { echo "run failed: $src $*" >&2; exit 1; }
+    [ -z "$best" ] || [ "$ms" -lt "$best" ] && best=$ms
+  done
+  echo "$best"
+}
+row() {
+  printf "  %-14s %8d ms  %6s x   %s\n" "$1" "$2" \
+    "$(awk -v a="$BASE" -v b="$2" 'BEGIN { printf "%.2f", (b > 0 ? a / b : 0) }')" "$(tr '\n' ' ' < "$DIR/out")"
+}
+
+gen "" > "$DIR/seq.choreo"
+gen PARALLEL > "$DIR/par.choreo"
+echo "N=$N INNER=$INNER, $CPUS cpus"
+BASE=$(best_ms "$DIR/seq.choreo")
+row "REPEAT" "$BASE"
+t=1
+while :; do
+  row "PARALLEL x$t" "$(best_ms "$DIR/par.choreo" CHOREO_THREADS=$t)"
+  [ $t -ge "$CPUS" ] && break
+  t=$((t * 2))
+  [ $t -gt "$CPUS" ] && t=$CPUS
+done
+rm -rf "$DIR"
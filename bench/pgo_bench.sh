@@ -0,0 +1,60 @@
+#!/bin/sh
+# --profile-generate / --profile-use on a label / SPIN state machine: one SPIN almost always
+# jumps over a rarely used state, one wraps a counter now and then. Runs the plain -O2 build,
+# the instrumented build (once, to write the profile), then the -O2 build with the profile
+# (--run -O2, execute time, best of 3) and the printed results, which have to agree.
+# usage: bench/pgo_bench.sh [choreo binary] [N] [RARE]   (the rare state every RARE rounds)
+CHOREO=${1:-./choreo}
+N=${2:-30000000}
+RARE=${3:-200}
+DIR=${TMPDIR:-/tmp}/choreo_pgo_bench.$$
+mkdir -p "$DIR"
+
+cat > "$DIR/branchy.choreo" <<EOS
+ENTER i = 0
+ENTER x = 0
+ENTER y = 0
+ENTER s = 0
+top:
+i = i + 1
+SPIN i > $N THEN MOVE TO done
+x = x + 1
+SPIN x < $RARE THEN MOVE TO warm
+x = 0
+s = s * 0.5
+warm:
+y = y + 3
+SPIN y > 1000 THEN MOVE TO wrap
+s = s + x * 0.25
+MOVE TO top
+wrap:
+y = y - 1000
+s = s - 1
+MOVE TO top
+done:
+ECCO_D s
+ECCO_D y
+EXIT
+EOS
+
+# $1 = label, the rest = extra options
+run() {
+  label=$1; shift
+  best=
+  for k in 1 2 3; do
+    ms=$("$CHOREO" --run -O2 --time-report "$@" "$DIR/branchy.choreo" 2>&1 >"$DIR/out" |
+         awk '$1 == "execute" { printf "%d", $2 }')
+    [ -n "$ms" ] || { echo "run failed: $label" >&2; exit 1; }
+    [ -z "$best" ] || [ "$ms" -lt "$best" ] && best=$ms
+  done
+  printf "  %-22s %8d ms   %s\n" "$label" "$best" "$(tr '\n' ' ' < "$DIR/out")"
+}
+
+echo "N=$N RARE=$RARE"
+run "-O2"
+run "instrumented" --profile-generate="$DIR/branchy.profile"
+rm -f "$DIR/branchy.profile"
+"$CHOREO" --run -O2 --profile-generate="$DIR/branchy.profile" "$DIR/branchy.choreo" > /dev/null || exit 1
+sed 's/^/    /' "$DIR/branchy.profile"
+run "-O2 --profile-use" --profile-use="$DIR/branchy.profile"
+rm -rf "$DIR"
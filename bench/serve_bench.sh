@@ -0,0 +1,70 @@
+#!/bin/sh
+# Request latency of a small script (gen_program.sh mixed SIZE), one choreo process per request
+# against choreoc talking to choreo --serve, without and with the server's --cache. N requests one
+# after the other, then C clients at a time; p50 / p99 / max of the client-side wall time
+# (bench/measure) for --run -O2. The server saves the process start and LLVM's load and set-up on
+# every request; -O2 and the JIT still cost what they cost, unless the cache has the object.
+# usage: bench/serve_bench.sh [choreo binary] [choreoc binary] [N] [C] [SIZE]
+CHOREO=${1:-./choreo}
+CLIENT=${2:-./choreoc}
+N=${3:-200}
+C=${4:-4}
+SIZE=${5:-2}
+HERE=$(dirname "$0")
+MEASURE=$HERE/measure
+DIR=${TMPDIR:-/tmp}/choreo_serve_bench.$$
+mkdir -p "$DIR"
+export CHOREO_SERVER="$DIR/choreo.sock"
+SERVER=
+
+sh "$HERE/gen_program.sh" mixed "$SIZE" > "$DIR/small.choreo" || exit 1
+"$CHOREO" --run -O2 "$DIR/small.choreo" > "$DIR/expected" || exit 1
+
+stop_server() {
+  [ -n "$SERVER" ] && kill "$SERVER" && wait "$SERVER" 2>/dev/null
+  SERVER=
+}
+trap 'stop_server; rm -rf "$DIR"' EXIT INT TERM
+
+# $@ = server options: wait until it answers
+start_server() {
+  "$CHOREO" --serve "$@" 2>"$DIR/server.log" &
+  SERVER=$!
+  for k in $(seq 100); do
+    [ -S "$CHOREO_SERVER" ] && break
+    sleep 0.1
+  done
+  "$CLIENT" --run -O2 "$DIR/small.choreo" | cmp -s - "$DIR/expected" ||
+    { echo "server output differs" >&2; cat "$DIR/server.log" >&2; exit 1; }
+}
+
+# $1 = label, $2 = clients at a time, the rest = the command: p50 / p99 / max over N requests
+latency() {
+  label=$1; clients=$2; shift 2
+  : > "$DIR/ms"
+  pids=
+  for c in $(seq "$clients"); do
+    (for k in $(seq $((N / clients))); do "$MEASURE" "$@" "$DIR/small.choreo"; done >> "$DIR/ms.$c") &
+    pids="$pids $!"
+  done
+  wait $pids   # not the server
+  cat "$DIR"/ms.* > "$DIR/ms"; rm -f "$DIR"/ms.*
+  awk '$3 != 0 { bad++ } { print $1 }
+       END { if (bad) print "failed requests: " bad > "/dev/stderr" }' "$DIR/ms" | sort -n |
+    awk -v label="$label" -v clients="$clients" '{ v[NR] = $1 }
+      END { p50 = v[int(NR * 0.50 + 0.999)]; p99 = v[int(NR * 0.99 + 0.999)];
+            printf "  %-24s %7d %9.1f %9.1f %9.1f\n", label, clients, p50, p99, v[NR] }'
+}
+
+echo "$N requests of --run -O2 on a $(wc -l < "$DIR/small.choreo")-line script, wall ms per request"
+printf "  %-24s %7s %9s %9s %9s\n" mode clients p50 p99 max
+latency "choreo (one-shot)" 1 "$CHOREO" --run -O2
+latency "choreo (one-shot)" "$C" "$CHOREO" --run -O2
+start_server -j "$C"
+latency "choreoc + --serve" 1 "$CLIENT" --run -O2
+latency "choreoc + --serve" "$C" "$CLIENT" --run -O2
+stop_server
+rm -f "$CHOREO_SERVER"
+start_server -j "$C" --cache="$DIR/cache"
+latency "choreoc + --serve --cache" 1 "$CLIENT" --run -O2
+latency "choreoc + --serve --cache" "$C" "$CLIENT" --run -O2
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Compile time against program size, main() whole (--split=0) and cut into functions of about
+# SEG statements (--split=SEG) with the backend on one thread and on JOBS threads. The mixed
+# shape of gen_program.sh at growing sizes, -O2 to an object file: the optimizer and the
+# backend are worse than linear in the size of one function. The outputs of --run are checked
+# against each other on the smallest size first.
+# usage: bench/split_bench.sh [choreo binary] ["sizes"] [SEG] [JOBS]
+CHOREO=${1:-./choreo}
+SIZES=${2:-"50 100 200 400"}
+SEG=${3:-200}
+JOBS=${4:-$(nproc 2>/dev/null || echo 4)}
+HERE=$(dirname "$0")
+MEASURE=$HERE/measure
+WORK=${TMPDIR:-/tmp}/choreo_split_bench.$$
+mkdir -p "$WORK"
+
+set -- $SIZES
+sh "$HERE/gen_program.sh" mixed "$1" > "$WORK/check.choreo" || exit 1
+"$CHOREO" --run -O2 --split=0 "$WORK/check.choreo" > "$WORK/whole.txt"
+for j in 1 "$JOBS"; do
+  "$CHOREO" --run -O2 --split=1 -j "$j" "$WORK/check.choreo" > "$WORK/split.txt"
+  cmp -s "$WORK/whole.txt" "$WORK/split.txt" || { echo "--split=1 -j $j: output differs"; rm -rf "$WORK"; exit 1; }
+done
+
+printf "%6s %7s %10s %8s %14s %14s %8s\n" size lines functions whole_ms "split_j1_ms" "split_j${JOBS}_ms" speedup
+for size in $SIZES; do
+  sh "$HERE/gen_program.sh" mixed "$size" > "$WORK/p.choreo" || exit 1
+  functions=$("$CHOREO" -O0 --split="$SEG" --stats --emit-bc -o "$WORK/p.bc" "$WORK/p.choreo" 2>&1 |
+              awk '/main split into functions/ { n = $NF } END { print n ? n : 1 }')
+  row=
+  for mode in "--split=0" "--split=$SEG -j 1" "--split=$SEG -j $JOBS"; do
+    set -- $("$MEASURE" "$CHOREO" -O2 $mode --emit-obj -o "$WORK/p.o" "$WORK/p.choreo")
+    [ "$3" = 0 ] || { echo "$mode: compile failed"; rm -rf "$WORK"; exit 1; }
+    row="$row $1"
+  done
+  echo "$size $(wc -l < "$WORK/p.choreo") $functions $row" |
+    awk '{ best = $5 < $6 ? $5 : $6; printf "%6d %7d %10d %8.0f %14.0f %14.0f %7.1fx\n", $1, $2, $3, $4, $5, $6, $4 / best }'
+done
+rm -rf "$WORK"
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Peak memory of a whole-program compile against --stream on the same generated script (the
+# exprs shape of gen_program.sh: N assignments with 64-term expressions, so the AST is large
+# next to the IR). -O0 to bitcode, so the front end is most of the work; compile time, peak RSS
+# and the most AST bytes alive at once (--stats) for each. Without integer inference --stream has
+# every variable in a double; the outputs of --run are checked against the whole-program ones on
+# the nested and mixed shapes first.
+# usage: bench/stream_bench.sh [choreo binary] [N]
+CHOREO=${1:-./choreo}
+N=${2:-20000}
+HERE=$(dirname "$0")
+MEASURE=$HERE/measure
+WORK=${TMPDIR:-/tmp}/choreo_stream_bench.$$
+mkdir -p "$WORK"
+
+for shape in nested mixed; do
+  sh "$HERE/gen_program.sh" $shape 200 > "$WORK/check.choreo" || exit 1
+  "$CHOREO" --run "$WORK/check.choreo" > "$WORK/whole.txt"
+  "$CHOREO" --run --stream "$WORK/check.choreo" > "$WORK/stream.txt"
+  cmp -s "$WORK/whole.txt" "$WORK/stream.txt" || { echo "$shape: --stream output differs"; rm -rf "$WORK"; exit 1; }
+done
+
+sh "$HERE/gen_program.sh" exprs "$N" > "$WORK/big.choreo" || exit 1
+printf "%d lines, %d KiB of source\n" "$(wc -l < "$WORK/big.choreo")" $(( $(wc -c < "$WORK/big.choreo") / 1024 ))
+printf "  %-8s %10s %12s %12s\n" mode compile_ms peak_rss_KiB ast_KiB
+for mode in whole stream; do
+  opt=; [ "$mode" = stream ] && opt=--stream
+  set -- $("$MEASURE" "$CHOREO" -O0 $opt --emit-bc -o "$WORK/out.bc" "$WORK/big.choreo")
+  [ "$3" = 0 ] || { echo "$mode: compile failed"; rm -rf "$WORK"; exit 1; }
+  ast=$("$CHOREO" -O0 $opt --emit-bc -o "$WORK/out.bc" --stats "$WORK/big.choreo" 2>&1 |
+        awk '/AST objects/ { gsub(/[()]/, ""); print $(NF-1) }')
+  printf "  %-8s %10s %12s %12s\n" "$mode" "$1" "$2" "$ast"
+done
+rm -rf "$WORK"
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Compiler benchmark suite: compiles every generated shape (bench/gen_program.sh) with
+# FLAGS (default -O2), reports compile lines/s and peak RSS, then runs the program.
+# Each row is appended to bench/results.csv tagged with the commit, so runs of
+# different commits can be compared with bench/compare.sh.
+# usage: bench/suite.sh [choreo binary] [scale]     (scale multiplies every size)
+# The default sizes take a few seconds each at -O2; compile time of the nested and
+# labels shapes grows faster than linearly with size.
+CHOREO=${1:-./choreo}
+SCALE=${2:-1}
+FLAGS=${FLAGS:--O2}
+HERE=$(dirname "$0")
+MEASURE=$HERE/measure
+RESULTS=${RESULTS:-$HERE/results.csv}
+RUNTIME=${CHOREO_RUNTIME:-$(dirname "$CHOREO")/libchoreo_rt.a}
+WORK=${TMPDIR:-/tmp}/choreo_suite.$$
+mkdir -p "$WORK"
+
+commit=$(git -C "$HERE" rev-parse --short HEAD 2>/dev/null || echo unknown)
+git -C "$HERE" diff --quiet HEAD -- 2>/dev/null || commit="$commit-dirty"
+date=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+[ -f "$RESULTS" ] || echo "commit,date,shape,size,lines,flags,compile_ms,lines_per_s,peak_rss_kib,run_ms" > "$RESULTS"
+
+printf "%-9s %8s %8s %10s %12s %10s %10s\n" shape size lines compile_ms lines/s rss_KiB run_ms
+for spec in nested:20 labels:1000 ensemble:200000 exprs:2000 mixed:80; do
+  shape=${spec%%:*}
+  size=$(( ${spec#*:} * SCALE ))
+  src=$WORK/$shape.choreo
+  sh "$HERE/gen_program.sh" "$shape" "$size" > "$src"
+  lines=$(wc -l < "$src")
+
+  set -- $("$MEASURE" "$CHOREO" $FLAGS --emit-obj -o "$WORK/$shape.o" "$src")
+  compile_ms=$1 rss=$2
+  [ "$3" = 0 ] || { echo "$shape: compile failed"; continue; }
+  lps=$(awk -v l="$lines" -v ms="$compile_ms" 'BEGIN { printf "%d", (ms > 0 ? l * 1000 / ms : 0) }')
+
+  run_ms=
+  if cc "$WORK/$shape.o" "$RUNTIME" -o "$WORK/$shape" 2>/dev/null; then
+    set -- $("$MEASURE" "$WORK/$shape")
+    run_ms=$1
+  fi
+  printf "%-9s %8d %8d %10s %12s %10s %10s\n" "$shape" "$size" "$lines" "$compile_ms" "$lps" "$rss" "${run_ms:--}"
+  echo "$commit,$date,$shape,$size,$lines,$FLAGS,$compile_ms,$lps,$rss,$run_ms" >> "$RESULTS"
+done
+rm -rf "$WORK"
+echo "results appended to $RESULTS ($commit)"
@@ -0,0 +1,220 @@
+#include "cache.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <utime.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/BinaryFormat/Magic.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SHA256.h>
+#include <llvm/Support/raw_ostream.h>
+using namespace llvm;
+
+// bump when the entry format changes; a new build of choreo gets fresh keys anyway
+#define CHOREO_CACHE_FORMAT "1"
+
+std::string CompileCache::defaultDir() {
+if (const char *env = getenv("CHOREO_CACHE_DIR"))
+  if (*env)
+    return env;
+SmallString<128> dir;
+if (!sys::path::cache_directory(dir))   // $XDG_CACHE_HOME or ~/.cache
+  return "";
+sys::path::append(dir, "choreo");
+return dir.str().str();
+}
+
+// the build stamp stands in for "the compiler version": codegen changes between any two
+// builds, and a stale object that still links is the worst kind of cache bug
+std::string CompileCache::key(StringRef Options, StringRef Source) {
+SHA256 hash;
+hash.update("choreo cache " CHOREO_CACHE_FORMAT ", llvm " LLVM_VERSION_STRING
+            ", built " __DATE__ " " __TIME__);
+hash.update(StringRef("\0", 1));
+hash.update(Options);
+hash.update(StringRef("\0", 1));
+hash.update(Source);
+return toHex(hash.final(), /*LowerCase=*/true);
+}
+
+static SmallString<128> entryPath(StringRef Dir, StringRef Key, StringRef Ext) {
+SmallString<128> path(Dir);
+sys::path::append(path, Key + "." + Ext);
+return path;
+}
+
+//----------------------------------------------------------<dir>/stats: the counters, and the lock
+// fcntl locks belong to the process, not the descriptor, so the threads of a batch are
+// serialized with a mutex first; the file lock keeps the other processes out
+static std::mutex StatsMutex;
+
+namespace {
+struct LockedStats {
+  std::lock_guard<std::mutex> Guard{StatsMutex};
+  int FD = -1;
+  bool Locked = false;
+  uint64_t Hits = 0, Misses = 0, Evictions = 0;
+
+  // Wait = false: give up if another process holds the lock (it is pruning already)
+  LockedStats(StringRef Dir, bool Wait) {
+    SmallString<128> path(Dir);
+    sys::path::append(path, "stats");
+    if (sys::fs::openFileForReadWrite(path, FD, sys::fs::CD_OpenAlways, sys::fs::OF_None)) {
+      FD = -1;
+      return;
+    }
+    Locked = !(Wait ? sys::fs::lockFile(FD) : sys::fs::tryLockFile(FD));
+    char text[96] = {};
+    if (Locked && pread(FD, text, sizeof text - 1, 0) > 0)
+      sscanf(text, "%" SCNu64 " %" SCNu64 " %" SCNu64, &Hits, &Misses, &Evictions);
+  }
+  void save() {
+    char text[96];
+    int n = snprintf(text, sizeof text, "%" PRIu64 " %" PRIu64 " %" PRIu64 "\n", Hits, Misses, Evictions);
+    if (pwrite(FD, text, n, 0) != n || ftruncate(FD, n) != 0)
+      fprintf(stderr, " [cache] cannot update the counters\n");
+  }
+  ~LockedStats() {
+    if (Locked)
+      sys::fs::unlockFile(FD);
+    if (FD >= 0)
+      close(FD);
+  }
+};
+
+struct CacheFile {
+  std::string Path;
+  uint64_t Size;
+  sys::TimePoint<> LastUse;
+};
+}
+
+// the entries (*.o, *.bc) of the cache directory; RemoveStale also deletes temp files that a
+// crashed writer left behind
+static uint64_t scanEntries(StringRef Dir, std::vector<CacheFile> *Files, bool RemoveStale) {
+uint64_t total = 0;
+std::error_code ec;
+for (sys::fs::directory_iterator it(Dir, ec), end; it != end && !ec; it.increment(ec)) {
+  StringRef path = it->path();
+  ErrorOr<sys::fs::basic_file_status> st = it->status();
+  if (!st || st->type() != sys::fs::file_type::regular_file)
+    continue;
+  StringRef ext = sys::path::extension(path);
+  if (ext != ".o" && ext != ".bc") {
+    if (RemoveStale && path.contains(".tmp-") &&
+        st->getLastModificationTime() < std::chrono::system_clock::now() - std::chrono::hours(1))
+      sys::fs::remove(path);
+    continue;
+  }
+  total += st->getSize();
+  if (Files)
+    Files->push_back({ path.str(), st->getSize(), st->getLastModificationTime() });
+}
+return total;
+}
+
+//----------------------------------------------------------lookup / store
+std::unique_ptr<MemoryBuffer> CompileCache::lookup(StringRef Key, StringRef Ext) {
+if (std::error_code ec = sys::fs::create_directories(Dir)) {
+  fprintf(stderr, " [cache] cannot create %s: %s\n", Dir.c_str(), ec.message().c_str());
+  return nullptr;
+}
+SmallString<128> path = entryPath(Dir, Key, Ext);
+std::unique_ptr<MemoryBuffer> entry;
+auto file = MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+if (file) {
+  // entries are renamed into place whole, so this only catches foreign / damaged files
+  file_magic magic = identify_magic((*file)->getBuffer());
+  bool usable = Ext == "bc" ? magic == file_magic::bitcode
+                            : magic == file_magic::elf_relocatable || magic == file_magic::macho_object ||
+                              magic == file_magic::coff_object;
+  if (usable) {
+    entry = std::move(*file);
+    utime(path.c_str(), nullptr);   // the mtime is the LRU clock
+  } else {
+    sys::fs::remove(path);
+  }
+}
+
+LockedStats stats(Dir, /*Wait=*/true);
+if (stats.Locked) {
+  ++(entry ? stats.Hits : stats.Misses);
+  stats.save();
+}
+return entry;
+}
+
+bool CompileCache::store(StringRef Key, StringRef Ext, StringRef Bytes) {
+SmallString<128> path = entryPath(Dir, Key, Ext);
+SmallString<128> tmpPath;
+int fd;
+if (std::error_code ec = sys::fs::createUniqueFile(Twine(path) + ".tmp-%%%%%%%%", fd, tmpPath)) {
+  fprintf(stderr, " [cache] cannot write to %s: %s\n", Dir.c_str(), ec.message().c_str());
+  return false;
+}
+{
+  raw_fd_ostream out(fd, /*shouldClose=*/true);
+  out << Bytes;
+  out.close();
+  if (out.has_error()) {
+    fprintf(stderr, " [cache] cannot write %s: %s\n", tmpPath.c_str(), out.error().message().c_str());
+    out.clear_error();
+    sys::fs::remove(tmpPath);
+    return false;
+  }
+}
+// another process may have published the same entry meanwhile; it has the same bytes
+if (std::error_code ec = sys::fs::rename(tmpPath, path)) {
+  fprintf(stderr, " [cache] cannot publish %s: %s\n", path.c_str(), ec.message().c_str());
+  sys::fs::remove(tmpPath);
+  return false;
+}
+
+// over the cap: least recently used entries go first
+LockedStats stats(Dir, /*Wait=*/false);
+if (!stats.Locked)
+  return true;   // someone else is pruning right now
+std::vector<CacheFile> files;
+uint64_t total = scanEntries(Dir, &files, /*RemoveStale=*/true);
+if (total <= MaxBytes)
+  return true;
+std::sort(files.begin(), files.end(),
+          [](const CacheFile &a, const CacheFile &b) { return a.LastUse < b.LastUse; });
+for (const CacheFile &f : files) {
+  if (total <= MaxBytes)
+    break;
+  if (f.Path == path.str())
+    continue;   // never the entry we were asked to keep
+  if (!sys::fs::remove(f.Path)) {
+    total -= f.Size;
+    ++stats.Evictions;
+  }
+}
+stats.save();
+return true;
+}
+
+void CompileCache::remove(StringRef Key, StringRef Ext) {
+sys::fs::remove(entryPath(Dir, Key, Ext));
+}
+
+CompileCache::Counters CompileCache::counters() {
+Counters c;
+{
+  LockedStats stats(Dir, /*Wait=*/true);
+  c.Hits = stats.Hits;
+  c.Misses = stats.Misses;
+  c.Evictions = stats.Evictions;
+}
+std::vector<CacheFile> files;
+c.Bytes = scanEntries(Dir, &files, /*RemoveStale=*/false);
+c.Entries = files.size();
+return c;
+}
@@ -0,0 +1,40 @@
+// cache.h
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+// --cache: content-addressed store of compiled modules, one file per entry in a local
+// directory shared by every choreo process of the user. The key is a SHA-256 over the
+// compiler build, the options that change the output and the source text; the entry is a
+// native object (.o) or optimized bitcode (.bc). Entries are written to a temp file and
+// renamed into place, so readers never see half an entry; the counters and the pruning run
+// under an advisory lock on <dir>/stats.
+class CompileCache {
+  std::string Dir;
+  uint64_t MaxBytes;
+public:
+  struct Counters {
+    uint64_t Hits = 0, Misses = 0, Evictions = 0;   // cumulative, all processes
+    uint64_t Entries = 0, Bytes = 0;                // what is on disk right now
+  };
+
+  CompileCache(std::string Dir, uint64_t MaxBytes) : Dir(std::move(Dir)), MaxBytes(MaxBytes) {}
+  // $CHOREO_CACHE_DIR, else $XDG_CACHE_HOME/choreo, else ~/.cache/choreo
+  static std::string defaultDir();
+  // hex digest of the compiler build + Options + Source
+  static std::string key(llvm::StringRef Options, llvm::StringRef Source);
+
+  const std::string &dir() const { return Dir; }
+  // the entry for Key with extension Ext ("o" / "bc"), nullptr on a miss; counts the hit /
+  // miss and makes the entry the most recently used one
+  std::unique_ptr<llvm::MemoryBuffer> lookup(llvm::StringRef Key, llvm::StringRef Ext);
+  // publish an entry, then evict least recently used entries until the cache fits MaxBytes
+  bool store(llvm::StringRef Key, llvm::StringRef Ext, llvm::StringRef Bytes);
+  // drop an entry that turned out to be unusable
+  void remove(llvm::StringRef Key, llvm::StringRef Ext);
+  Counters counters();
+};
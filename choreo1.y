@@ -1,35 +1,62 @@
 %code requires {
   #include <vector>
   #include "ast.h"
+  #include "compilation.h"
+  class Scanner;   // lexer.h: the tokens of one file
 }
 %{
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cctype>
 #include <vector>
 
 #include "ast.h"       // ASTNode
+#include "compilation.h"  // per-file state: the arena owning every node, codegen slots
+#include "optimize.h"  // -O<n> pipeline
+#include "jit.h"       // --run
+#include "emit.h"      // --emit-obj / -o
+#include "stats.h"     // -v, --time-report / --stats
+#include "cache.h"     // --cache
+#include "profile.h"   // --profile-generate / --profile-use
+#include "interp.h"    // --interp
+#include "server.h"    // --serve
+#include "split.h"     // --split
+#include <chrono>
+#include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/IR/BasicBlock.h"
-extern FILE* yyin;
-extern int   yylex();
-extern char* yytext;
-extern int   yylineno;
-void yyerror(const char *s);
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
 using namespace llvm;
-// collect top‐level statements here
-static std::vector<ASTNode*> *programStmts = nullptr;
-extern std::map<std::string, BasicBlock*> LabelBlocks;
 
 %}
 
+// pure parser + reentrant scanner: all parse state lives in the Compilation and the Scanner
+%define api.pure full
+%parse-param {Compilation &C} {Scanner &scanner}
+%lex-param   {Scanner &scanner}
+
+%code {
+  #include "lexer.h"
+  static int yylex(YYSTYPE *yylval_param, Scanner &scanner) { return scanner.lex(yylval_param); }
+  void  yyerror(Compilation &C, Scanner &scanner, const char *s);
+}
+
 //------------------------------SEMANTIC VALUES-----------------------------------
 %union {
 
-  char*                         identifier;
+  const char*                   identifier;      //interned in the Compilation's arena by the lexer
   double                        double_literal;
-  char*                         string_literal;
+  const char*                   string_literal;
   ASTNode* node;
   std::vector<ASTNode*>*        stmt_list;       //Statement list 
+  LoopHints                     loop_hints;      //UNROLL / VECTORIZE after REPEAT n TIMES
  
 }
 
@@ -48,16 +75,21 @@ extern std::map<std::string, BasicBlock*> LabelBlocks;
 %token                   tok_ecco_d   //ECCO_D
 %token                   tok_moveto   //MOVE TO
 %token                   tok_REPEAT tok_TIMES tok_ENDREPEAT //loop syntax 'REPEAT X TIMES' 
+%token                   tok_UNROLL tok_VECTORIZE tok_FASTMATH tok_PARALLEL   //loop hints 'REPEAT X TIMES UNROLL 4 VECTORIZE 8 FASTMATH PARALLEL'
 %token                    tok_colon
 %token                   tok_lparen tok_rparen tok_comma
 %token                    tok_ENSEMBLE     /* ENSEMBLE keyword */
 %token                    tok_lbracket     /* ‘[’ */
 %token                    tok_rbracket     /* ‘]’ */
+%token                    tok_SUM tok_MIN tok_MAX tok_DOT   /* reductions of a whole ENSEMBLE */
+%token                    tok_FROM tok_SAVE tok_TO          /* ENSEMBLE a FROM "file", SAVE a TO "file" */
+%token                    tok_invalid      /* a character the lexer doesn't know (already reported) */
 
 /*─── Non‐terminals ───────────────────────────────────────────────────────────*/
-%type  <stmt_list>       stmt_list 
+%type  <stmt_list>       stmt_list top_stmts
+%type  <loop_hints>      loop_hints
 
-%type  <node>            enter_stmt echo_stmt lbl_stmt jmp_stmt if_stmt assign_stmt expr repeat_stmt ensemble_stmt 
+%type  <node>            stmt enter_stmt echo_stmt lbl_stmt jmp_stmt if_stmt assign_stmt expr repeat_stmt ensemble_stmt save_stmt
 /* Precedence: */
 %nonassoc tok_less tok_greater      /* comparisons */
 %left '+' '-'
@@ -66,28 +98,27 @@ extern std::map<std::string, BasicBlock*> LabelBlocks;
 %start program
 %%
 program:
-    stmt_list tok_EXIT    { programStmts = $1; }
+    top_stmts tok_EXIT    { C.Program = $1; }
+  ;
+
+// the top level: with --stream every statement goes to codegen as soon as it is reduced
+top_stmts:
+    /* empty */                 { $$ = C.Stream ? nullptr : C.Arena.make<std::vector<ASTNode*>>(); }
+  | top_stmts stmt              { if (C.Stream) C.Stream->statement($2); else $1->push_back($2); $$ = $1; }
   ;
 
 stmt_list:
-    /* empty */                 { $$ = new std::vector<ASTNode*>(); }
-  | stmt_list enter_stmt        { $1->push_back($2); $$ = $1; }
-  | stmt_list echo_stmt         { $1->push_back($2); $$ = $1; }
-  | stmt_list lbl_stmt          { $1->push_back($2); $$ = $1; }
-  | stmt_list jmp_stmt          { $1->push_back($2); $$ = $1; }
-  | stmt_list if_stmt           { $1->push_back($2); $$ = $1; }
-  | stmt_list assign_stmt       { $1->push_back($2); $$ = $1; }
-  | stmt_list repeat_stmt       { $1->push_back($2); $$ = $1; }
-  | stmt_list ensemble_stmt   { $1->push_back($2); $$ = $1; }
-  
-  
-  
-  
+    /* empty */                 { $$ = C.Arena.make<std::vector<ASTNode*>>(); }
+  | stmt_list stmt              { $1->push_back($2); $$ = $1; }
+  ;
+
+stmt:
+    enter_stmt | echo_stmt | lbl_stmt | jmp_stmt | if_stmt | assign_stmt | repeat_stmt | ensemble_stmt | save_stmt
   ;
 
 enter_stmt:
     tok_ENTER tok_identifier '=' tok_double_literal 
-                           { $$ = new VarDecl($2, new NumberExpr($4)); }
+                           { $$ = C.Arena.make<VarDecl>($2, C.Arena.make<NumberExpr>($4)); }
   ;
 
 /*──────────────────────────────────────────────────────────────────────────────*/
@@ -96,36 +127,37 @@ echo_stmt:
     tok_ecco tok_string_literal 
       {
         /* echo a string literal */
-        $$ = new EchoStr($2);
+        $$ = C.Arena.make<EchoStr>($2);
       }
   | tok_ecco_d tok_identifier 
       {
         /* echo a variable’s value */
-        $$ = new EchoVar($2);
+        $$ = C.Arena.make<EchoVar>($2);
       }
   | tok_ecco_d tok_identifier tok_lbracket expr tok_rbracket
      {
        /* $2 = array name, $4 = AST for index */
-       $$ = new EchoIndexedVar(std::string($2), $4);
+       $$ = C.Arena.make<EchoIndexedVar>($2, $4);
      }
   ;
 
-//assignment like 'identifier= exp'
+//assignment like 'identifier= exp'; when identifier is an ENSEMBLE this assigns every element
 assign_stmt:
     tok_identifier '=' expr
    {
-    fprintf(stderr, "  Parsed ASSIGN: %s = (AST@%p)\n", $1, $3);
+    if (Verbosity >= 2)
+      fprintf(stderr, "  Parsed ASSIGN: %s = (AST@%p)\n", $1, $3);
      //create the tree node with lhs name in $1, rhs subtree in $3
-     $$ = new Assign($1, $3);
+     $$ = C.Arena.make<Assign>($1, $3);
    }
    | tok_identifier tok_lbracket expr tok_rbracket '=' expr 
-      { $$ = new StoreToIndex(std::string($1), $3, $6); }
+      { $$ = C.Arena.make<StoreToIndex>($1, $3, $6); }
 ;
 // Label declaration like 'labelName:'
 lbl_stmt:
     tok_label
   {
-    $$ = new Label($1);
+    $$ = C.Arena.make<Label>($1);
   }
 ;
 
@@ -133,7 +165,7 @@ lbl_stmt:
 jmp_stmt:
     tok_moveto tok_identifier
   {
-    $$ = new Jump($2);
+    $$ = C.Arena.make<Jump>($2);
   }
 ;
 
@@ -141,9 +173,10 @@ jmp_stmt:
 if_stmt:
    tok_SPIN expr tok_THEN tok_moveto tok_identifier
  {
-  fprintf(stderr, " Parsed SPIN: cond → (AST@%p), label → %s\n",
-          $2, $5);
-   $$ = new IfStmt($2, $5);
+  if (Verbosity >= 2)
+    fprintf(stderr, " Parsed SPIN: cond → (AST@%p), label → %s\n",
+            $2, $5);
+   $$ = C.Arena.make<IfStmt>($2, $5);
  }
 ;
 
@@ -152,19 +185,24 @@ if_stmt:
 
 //expression
 expr:
-    tok_double_literal  { $$ = new NumberExpr($1); }
-  | tok_identifier      { $$ = new VariableExpr($1); }
-  | expr '+' expr       {$$ = new BinaryExpr('+', $1, $3); }
-  | expr '-' expr       {$$ = new BinaryExpr('-', $1, $3); }
-  | expr '*' expr       {$$ = new BinaryExpr('*', $1, $3); }
-  | expr '/' expr       {$$ = new BinaryExpr('/', $1, $3); }
-  | expr tok_less expr  {$$ = new ComparisonExpr("<", $1, $3); }
-  | expr tok_greater expr {$$ = new ComparisonExpr(">", $1, $3); }
+    tok_double_literal  { $$ = C.Arena.make<NumberExpr>($1); }
+  | tok_identifier      { $$ = C.Arena.make<VariableExpr>($1); }
+  | expr '+' expr       {$$ = C.Arena.make<BinaryExpr>('+', $1, $3); }
+  | expr '-' expr       {$$ = C.Arena.make<BinaryExpr>('-', $1, $3); }
+  | expr '*' expr       {$$ = C.Arena.make<BinaryExpr>('*', $1, $3); }
+  | expr '/' expr       {$$ = C.Arena.make<BinaryExpr>('/', $1, $3); }
+  | expr tok_less expr  {$$ = C.Arena.make<ComparisonExpr>("<", $1, $3); }
+  | expr tok_greater expr {$$ = C.Arena.make<ComparisonExpr>(">", $1, $3); }
   | tok_lparen expr tok_rparen         {$$ = $2; }
   /* array access: arr[expr] */
   | tok_identifier tok_lbracket expr tok_rbracket
-      { $$ = new IndexExpr(std::string($1), $3); }
-  
+      { $$ = C.Arena.make<IndexExpr>($1, $3); }
+  /* reductions over a whole ENSEMBLE: SUM(a), MIN(a), MAX(a), DOT(a, b) */
+  | tok_SUM tok_lparen tok_identifier tok_rparen { $$ = C.Arena.make<ReduceExpr>(ReduceExpr::Sum, $3); }
+  | tok_MIN tok_lparen tok_identifier tok_rparen { $$ = C.Arena.make<ReduceExpr>(ReduceExpr::Min, $3); }
+  | tok_MAX tok_lparen tok_identifier tok_rparen { $$ = C.Arena.make<ReduceExpr>(ReduceExpr::Max, $3); }
+  | tok_DOT tok_lparen tok_identifier tok_comma tok_identifier tok_rparen
+      { $$ = C.Arena.make<ReduceExpr>(ReduceExpr::Dot, $3, $5); }
 ;
 
 
@@ -173,96 +211,924 @@ expr:
 
 //loop  struct like 'REAPEAT 5 TIMES'
 repeat_stmt:
-    tok_REPEAT tok_double_literal tok_TIMES
-      /* we’ll collect the inner stmts into $4: */
+    tok_REPEAT tok_double_literal tok_TIMES loop_hints
+      /* we’ll collect the inner stmts into $5: */
       stmt_list
     tok_ENDREPEAT
   {
-    fprintf(stderr,
-            " Parsed REPEAT %g TIMES with %zu body stmts\n",
-            $2, $4->size());
-    $$ = new Repeat($2, $4);
+    if (Verbosity >= 2)
+      fprintf(stderr,
+              " Parsed REPEAT %g TIMES with %zu body stmts\n",
+              $2, $5->size());
+    $$ = C.Arena.make<Repeat>($2, $5, $4);
   }
   ;
+
+//optional hints after TIMES, e.g. 'UNROLL 4', 'VECTORIZE 8', 'VECTORIZE 0' (= don't), 'FASTMATH', 'PARALLEL'
+loop_hints:
+    /* empty */                              { $$ = LoopHints{-1, -1, false, false}; }
+  | loop_hints tok_UNROLL tok_double_literal    { $$ = $1; $$.Unroll = (int)$3; }
+  | loop_hints tok_VECTORIZE tok_double_literal { $$ = $1; $$.Vectorize = (int)$3; }
+  | loop_hints tok_FASTMATH                     { $$ = $1; $$.FastMath = true; }
+  | loop_hints tok_PARALLEL                     { $$ = $1; $$.Parallel = true; }
+  ;
 //array declaration like 'ENSEMBLE arrayName[double literal]
 ensemble_stmt:
     tok_ENSEMBLE tok_identifier
     tok_lbracket tok_double_literal tok_rbracket 
   {
     /* $2 = name, $4 = size as double */
-    $$ = new ArrayDecl(std::string($2),
+    $$ = C.Arena.make<ArrayDecl>($2,
                        static_cast<size_t>($4));
   }
+  /* mapped from a file of raw doubles: the first n of them, or as many as the file holds */
+  | tok_ENSEMBLE tok_identifier tok_lbracket tok_double_literal tok_rbracket tok_FROM tok_string_literal
+      { $$ = C.Arena.make<ArrayDecl>($2, static_cast<size_t>($4), $7); }
+  | tok_ENSEMBLE tok_identifier tok_FROM tok_string_literal
+      { $$ = C.Arena.make<ArrayDecl>($2, ArrayDecl::FileSized, $4); }
 ;
 
+//'SAVE arrayName TO "file"': the elements as raw doubles
+save_stmt:
+    tok_SAVE tok_identifier tok_TO tok_string_literal
+      { $$ = C.Arena.make<SaveArray>($2, $4); }
+;
 
 
 
-%%
 
+%%
 
 
 
 
 
 
-int yylex(); // forward declare
 
-void yyerror(const char *s) {
-    fprintf(stderr, "Syntax error at line %d: %s (token: %d)\n", yylineno, s, yylex());
+void yyerror(Compilation &C, Scanner &scanner, const char *s) {
+    StringRef near = scanner.text();
+    fprintf(stderr, "%s: Syntax error at line %d: %s (near `%.*s`)\n",
+            C.InputName.c_str(), scanner.line(), s, (int)near.size(), near.data());
+    ++C.Errors;
 }
 
 
-extern const char* last_jump_label;
-extern FILE *yyin;
-int main(int argc, char** argv) {
-  FILE* in = (argc>1) ? std::fopen(argv[1], "r") : stdin;
-  if (!in) { perror("fopen"); return 1; }
-  yyin = in;
-  yylineno = 1;
-  fprintf(stderr, " [main] Starting yyparse()\n");
-  yyparse();
-  fprintf(stderr, " [main] yyparse() returned\n");
-  if (!programStmts) {
-  fprintf(stderr, " Parse failed—no AST built.\n");
-  return 1;
-}
-  fprintf(stderr, "🛠  [main] Setting up LLVM & codegen\n");
-  // 1) Set up LLVM
-  LLVMContext Context;
-  auto TheModule = std::make_unique<Module>("choreo", Context);
-  IRBuilder<> Builder(Context);
+// command line, shared read-only by every compilation of a batch
+struct DriverOptions {
+  unsigned optLevel = 0;
+  bool runJIT = false;      // --run: JIT and execute in-process instead of printing IR
+  bool emitObj = false;     // --emit-obj: write a native object file instead of IR
+  bool emitBC = false;      // --emit-bc: write LLVM bitcode instead of IR text
+  bool moduleHash = false;  // --module-hash: with a module hash record in the bitcode
+  std::string outputPath;   // -o: object / bitcode path with --emit-obj / --emit-bc, executable path otherwise (batch: output directory)
+  std::string cpu;          // -march / -mcpu
+  long long echoBuffer = 0; // --echo-buffer: runtime output buffer size (0 = runtime default)
+  int echoLineMode = -1;    // --echo-mode: 1 line, 0 block, -1 runtime default (line on a tty)
+  unsigned jobs = 0;        // -j: batch threads, or backend threads of a split main (0 = one per core)
+  bool timeReport = false;  // --time-report: wall / cpu time per phase
+  bool showStats = false;   // --stats: tokens, AST nodes, blocks, instructions
+  std::string statsJSON;    // --stats-json=<file>: both as JSON ('-' = stdout)
+  std::string cacheDir;     // --cache[=<dir>]: reuse the output of identical compilations (empty = off)
+  uint64_t cacheMaxBytes = 256ull << 20;   // --cache-size=<MiB>
+  std::string profileGenerate;   // --profile-generate[=<file>]: count SPINs / labels, write the profile at exit
+  std::string profileUse;        // --profile-use=<file>: branch weights and entry count from such a profile
+  bool flexLexer = false;        // --lexer=flex: the flex scanner instead of the one over the mapped source
+  bool stream = false;           // --stream: generate each top-level statement as it is parsed, then drop its AST
+  bool interp = false;           // --interp: run the bytecode interpreter instead of building a module
+  uint64_t tierUp = 10000;       // --tier-up=<n>: iterations / visits after which a REPEAT / label runs natively (0 = never)
+  std::string serveSocket;       // --serve[=<socket>]: compile server for choreoc (empty = not a server)
+  unsigned splitSize = 200;      // --split=<n>: main as functions of about n statements each (0 = never)
 
+  bool collectStats() const { return timeReport || showStats || !statsJSON.empty(); }
+  bool linkExecutable() const { return !outputPath.empty() && !emitObj && !emitBC; }
+};
 
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-O0|-O1|-O2|-O3] [--run] [--emit-obj] [--emit-bc [--module-hash]] [-o <output>]\n"
+          "          [-march=<cpu|native>] [-mcpu=<cpu|native>]\n"
+          "          [--echo=printf|runtime] [--echo-buffer=<bytes>] [--echo-mode=line|block]\n"
+          "          [--fast-math[=reassoc,contract,nnan,ninf,nsz,arcp,afn|fast]] [--threads=<n>]\n"
+          "          [-v|-vv] [--time-report] [--stats] [--stats-json=<file>]\n"
+          "          [--cache[=<dir>]] [--cache-size=<MiB>]\n"
+          "          [--profile-generate[=<file>]] [--profile-use=<file>] [--lexer=fast|flex] [--stream]\n"
+          "          [--interp [--tier-up=<n>]] [--split=<n>] [-j <threads>]\n"
+          "          [file.choreo]\n"
+          "       %s [options] [-j <threads>] [-o <dir>] a.choreo b.choreo ...   (batch: a.ll b.ll ... or .o / .bc)\n"
+          "       %s --serve[=<socket>] [-j <requests>] [--cache[=<dir>]] [-v]   (server for choreoc)\n",
+          prog, prog, prog);
+}
 
-  // 4) Now create *one* main() and emit the rest of the statements there
+// the whole input: a file is mapped read-only (MemoryBuffer maps anything from 16 KiB up and
+// reads smaller ones), stdin is read; nullptr after reporting why not
+static std::unique_ptr<MemoryBuffer> readSource(const char *Path) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> source =
+    MemoryBuffer::getFileOrSTDIN(Path ? Path : "-", /*IsText=*/false, /*RequiresNullTerminator=*/false);
+  if (!source) {
+    fprintf(stderr, " %s: %s\n", Path ? Path : "<stdin>", source.getError().message().c_str());
+    return nullptr;
+  }
+  return std::move(*source);
+}
+
+// main() with Builder in its entry block, and what has to run before the first statement
+static Function *beginMain(Compilation &C, Module &M, IRBuilder<> &Builder, const DriverOptions &opts) {
   FunctionType *mainFT =
     FunctionType::get(Builder.getInt32Ty(), false);
   Function *mainF = Function::Create(mainFT,
                            Function::ExternalLinkage,
                            "main",
-                           TheModule.get());
-  BasicBlock *mainBB = BasicBlock::Create(Context, "entry", mainF);
+                           &M);
+  BasicBlock *mainBB = BasicBlock::Create(M.getContext(), "entry", mainF);
   Builder.SetInsertPoint(mainBB);
 
-  // If you have labels, create their blocks now:
-  for (ASTNode *stmt : *programStmts) {
-    if (auto *lbl = dynamic_cast<Label*>(stmt)) {
-      LabelBlocks[lbl->Name] =
-        BasicBlock::Create(Context, lbl->Name, mainF);
+  // non-default output buffering is set up before the first statement runs
+  if (EchoMode == EchoLowering::Runtime && (opts.echoBuffer > 0 || opts.echoLineMode >= 0)) {
+    FunctionCallee echoInit = M.getOrInsertFunction("choreo_echo_init",
+      Builder.getVoidTy(), Builder.getInt64Ty(), Builder.getInt32Ty());
+    Builder.CreateCall(echoInit, { Builder.getInt64(opts.echoBuffer), Builder.getInt32(opts.echoLineMode) });
+  }
+
+  if (!opts.profileGenerate.empty())
+    beginProfileCounters(C, M, Builder);
+  return mainF;
+}
+
+// lex (for the statistics) and parse C's source: C.Program, or with C.Stream every statement
+// straight to codegen; false after reporting why not
+static bool parseSource(Compilation &C, StringRef source, const DriverOptions &opts, CompileStats &stats) {
+  stats.Input = C.InputName;
+  PhaseTimer timer;
+
+  // for the statistics the input is lexed once on its own first: that gives the token count and
+  // a lexing time (inside yyparse lexing and parsing interleave token by token)
+  double lexWallMs = 0, lexCpuMs = 0;
+  if (opts.collectStats()) {
+    Scanner lexOnly(C, source, opts.flexLexer);
+    YYSTYPE value;
+    while (lexOnly.lex(&value) > 0)
+      ++stats.Tokens;
+    lexWallMs = timer.wallMs();
+    lexCpuMs = timer.cpuMs();
+    stats.addPhase("lex", lexWallMs, lexCpuMs);
+    if (C.Errors) {   // already reported by the lexer
+      fprintf(stderr, " %s: Parse failed—no AST built.\n", C.InputName.c_str());
+      return false;
+    }
+  }
+
+  bool stream = C.Stream;
+  Scanner scanner(C, source, opts.flexLexer);
+  if (Verbosity >= 1)
+    fprintf(stderr, " [main] Starting yyparse()\n");
+  timer.restart();
+  int parsed = yyparse(C, scanner);
+  C.Stream = nullptr;
+  stats.addPhase(stream ? "parse+codegen" : "parse", timer.wallMs() - lexWallMs, timer.cpuMs() - lexCpuMs);
+  if (Verbosity >= 1)
+    fprintf(stderr, " [main] yyparse() returned\n");
+  if (parsed != 0 || (!C.Program && !stream)) {
+    fprintf(stderr, " %s: Parse failed—no AST built.\n", C.InputName.c_str());
+    return false;
+  }
+  return true;
+}
+
+// names to slots, the --profile-use counts and integer inference over C.Program; false on errors
+static bool resolveProgram(Compilation &C, const DriverOptions &opts, ProfileData &profile, CompileStats &stats) {
+  // bind every name to its slot; undefined names / duplicate labels stop us before any IR exists
+  PhaseTimer timer;
+  if (unsigned errors = resolveNames(C)) {
+    fprintf(stderr, " %s: %u error(s), no code generated\n", C.InputName.c_str(), errors);
+    return false;
+  }
+  // a profile that does not fit (another program, an edited script) is ignored, not an error
+  if (!opts.profileUse.empty()) {
+    std::string why;
+    if (readProfile(opts.profileUse, C, profile, why))
+      C.Profile = &profile;
+    else
+      fprintf(stderr, " %s: warning: profile %s not used: %s\n", C.InputName.c_str(),
+              opts.profileUse.c_str(), why.c_str());
+    if (Verbosity >= 1 && C.Profile)
+      fprintf(stderr, " [profile] %s: %llu run(s), %zu SPIN(s), %zu label(s)\n", opts.profileUse.c_str(),
+              (unsigned long long)profile.Runs, profile.Executed.size(), profile.LabelCounts.size());
+  }
+  // Decide which variables can be i64 instead of double
+  inferIntegerVariables(C);
+  stats.addPhase("resolve", timer);
+  return true;
+}
+
+// parse, resolve and generate one file into a new module of Context; nullptr if it had errors
+static std::unique_ptr<Module> compileModule(Compilation &C, StringRef source, LLVMContext &Context,
+                                             const DriverOptions &opts, CompileStats &stats) {
+  auto TheModule = std::make_unique<Module>("choreo", Context);
+  IRBuilder<> Builder(Context);
+  Builder.setFastMathFlags(ProgramFastMath);   // --fast-math
+  CompilationScope scope(C);   // the AST nodes find their slots through this
+
+  // --stream: main exists before the first statement is parsed, and each one is generated into
+  // it straight from the grammar action (see StreamingCodegen)
+  Function *mainF = nullptr;
+  std::unique_ptr<StreamingCodegen> stream;
+  if (opts.stream) {
+    mainF = beginMain(C, *TheModule, Builder, opts);
+    stream.reset(new StreamingCodegen(C, *TheModule, Builder));
+    C.Stream = stream.get();
+  }
+  if (!parseSource(C, source, opts, stats))
+    return nullptr;
+
+  PhaseTimer timer;
+  ProfileData profile;   // --profile-use
+  if (stream) {
+    // labels jumped to but never defined only show up now
+    if (unsigned errors = stream->finish()) {
+      fprintf(stderr, " %s: %u error(s), no code generated\n", C.InputName.c_str(), errors);
+      return nullptr;
     }
+  } else {
+    if (!resolveProgram(C, opts, profile, stats))
+      return nullptr;
+
+    if (Verbosity >= 1)
+      fprintf(stderr, "🛠  [main] Setting up LLVM & codegen\n");
+    // Now create *one* main() and emit the statements there
+    timer.restart();
+    mainF = beginMain(C, *TheModule, Builder, opts);
+    // the statements (and the blocks of the labels) go into main, or into the functions main
+    // calls when the program is big enough for --split to cut it up
+    stats.MainFunctions = codegenProgram(C, mainF, Builder, opts.splitSize);
   }
-  for (ASTNode *stmt : *programStmts) {
-    stmt->codegen(Context, Builder, TheModule.get());
+
+  // the module is all we need from here on: drop the whole AST in one go
+  if (Verbosity >= 1)
+    fprintf(stderr, " [main] AST: %zu objects, %zu KiB at most / %zu KiB reserved in the arena\n",
+            C.Arena.objects(), C.Arena.peakBytes() / 1024, C.Arena.bytesReserved() / 1024);
+  if (opts.collectStats()) {
+    stats.NodesByClass = C.Arena.objectsByType();
+    stats.ASTBytes = C.Arena.peakBytes();
   }
+  C.Arena.reset();
+  C.Program = nullptr;
 
 
   // Finally, return 0 from main
-  if (!Builder.GetInsertBlock()->getTerminator())
+  if (!Builder.GetInsertBlock()->getTerminator()) {
+    // buffered ECCO output has to be written out before main returns
+    if (TheModule->getFunction("choreo_echo_str") || TheModule->getFunction("choreo_echo_f64"))
+      Builder.CreateCall(TheModule->getOrInsertFunction("choreo_echo_flush", Builder.getVoidTy()));
+    if (C.ProfileCounters)
+      emitProfileWrite(C, *TheModule, Builder, opts.profileGenerate);
     Builder.CreateRet(ConstantInt::get(Builder.getInt32Ty(), 0));
+  }
+  if (C.Profile)
+    attachProfileSummary(C, *TheModule, *mainF);
+  C.ProfileCounters = nullptr;
+  C.Profile = nullptr;
+  stats.addPhase("codegen", timer);
+
+  timer.restart();
+  if (verifyModule(*TheModule, &llvm::errs())) {
+    fprintf(stderr, " %s: Generated IR is broken, not emitting it.\n", C.InputName.c_str());
+    return nullptr;
+  }
+  stats.addPhase("verify", timer);
+  if (opts.collectStats()) {
+    stats.BasicBlocks = stats.BasicBlocksOpt = countBasicBlocks(*TheModule);
+    stats.IRInstructions = stats.IRInstructionsOpt = countInstructions(*TheModule);
+  }
+  return TheModule;
+}
+
+// target machine for the host (or -march cpu) + the -O pipeline; false if there is no usable target
+static bool prepareModule(Module &TheModule, const DriverOptions &opts, std::unique_ptr<TargetMachine> &TM,
+                          CompileStats &stats) {
+  PhaseTimer timer;
+  // target machine for the host (or -march cpu): gives the optimizer real cost models and lowers to native code
+  // (--cache has made it already, its cpu and features are part of the key)
+  if (!TM)
+    TM = createTargetMachine(opts.cpu, opts.optLevel);
+  if (TM) {
+    TheModule.setTargetTriple(TM->getTargetTriple().str());
+    TheModule.setDataLayout(TM->createDataLayout());
+  } else if (opts.emitObj || opts.linkExecutable()) {
+    return false;
+  }
+
+  // 5) Optimize: report how many instructions the pipeline got rid of
+  if (opts.optLevel > 0) {
+    size_t before = Verbosity >= 1 ? countInstructions(TheModule) : 0;
+    optimizeModule(TheModule, opts.optLevel, TM.get());
+    if (opts.collectStats()) {
+      stats.BasicBlocksOpt = countBasicBlocks(TheModule);
+      stats.IRInstructionsOpt = countInstructions(TheModule);
+    }
+    if (Verbosity >= 1)
+      fprintf(stderr, " [opt] -O%u: %zu -> %zu IR instructions\n",
+              opts.optLevel, before, countInstructions(TheModule));
+  }
+  stats.addPhase("opt", timer);
+  return true;
+}
+
+// --time-report / --stats on stderr, --stats-json into its file
+static bool reportStats(const std::vector<const CompileStats*> &all, const DriverOptions &opts) {
+  for (const CompileStats *s : all) {
+    if (opts.timeReport)
+      printTimeReport(*s, stderr);
+    if (opts.showStats)
+      printStats(*s, stderr);
+  }
+  if (opts.statsJSON.empty())
+    return true;
+  if (opts.statsJSON == "-") {
+    writeStatsJSON(all, outs());
+    return true;
+  }
+  std::error_code ec;
+  raw_fd_ostream out(opts.statsJSON, ec, sys::fs::OF_Text);
+  if (ec) {
+    fprintf(stderr, " %s: %s\n", opts.statsJSON.c_str(), ec.message().c_str());
+    return false;
+  }
+  writeStatsJSON(all, out);
+  return true;
+}
+
+//----------------------------------------------------------------------------- --cache
+// everything besides the source that decides what a compilation produces
+static std::string cacheOptions(const DriverOptions &opts, const TargetMachine *TM, const char *ext) {
+  std::string text;
+  raw_string_ostream os(text);
+  os << "-O" << opts.optLevel << " echo=" << (EchoMode == EchoLowering::Printf ? "printf" : "runtime")
+     << " buffer=" << opts.echoBuffer << " mode=" << opts.echoLineMode << " entry=" << ext
+     << " emit-bc=" << opts.emitBC << " hash=" << opts.moduleHash << " fast-math=";
+  ProgramFastMath.print(os);
+  os << " block-fast-math=";
+  BlockFastMath.print(os);
+  os << " threads=" << ParallelThreads;   // not --stream: all doubles, but the same results (see inferIntegerVariables)
+  os << " split=" << opts.splitSize;
+  os << " profile-generate=" << opts.profileGenerate << " profile-use=" << opts.profileUse;
+  if (!opts.profileUse.empty())   // the counts, not just the name, decide the weights
+    if (auto profile = MemoryBuffer::getFile(opts.profileUse, /*IsText=*/true))
+      os << " profile=" << (*profile)->getBuffer();
+  if (TM)   // -march=native spelled out as the cpu and features it stands for
+    os << " target=" << TM->getTargetTriple().str() << " cpu=" << TM->getTargetCPU()
+       << " features=" << TM->getTargetFeatureString();
+  return os.str();
+}
+
+// hash the source and look for its entry; Key is set for storeCached on a miss
+static std::unique_ptr<MemoryBuffer> lookupCached(CompileCache &cache, StringRef source, const char *ext,
+                                                  const TargetMachine *TM, const DriverOptions &opts,
+                                                  std::string &key, CompileStats &stats) {
+  PhaseTimer timer;
+  key = CompileCache::key(cacheOptions(opts, TM, ext), source);
+  std::unique_ptr<MemoryBuffer> entry = cache.lookup(key, ext);
+  stats.Cache = entry ? "hit" : "miss";
+  stats.addPhase("cache", timer);
+  if (Verbosity >= 1)
+    fprintf(stderr, " [cache] %s %s.%s\n", stats.Cache, key.c_str(), ext);
+  return entry;
+}
+
+// a freshly compiled module into the cache: its native object or its optimized bitcode (left
+// in Bytes for the caller). For objects the "store" phase is mostly the backend.
+static bool storeCached(CompileCache &cache, Module &M, TargetMachine *TM, const std::string &key,
+                        const char *ext, const DriverOptions &opts, SmallVectorImpl<char> &Bytes,
+                        CompileStats &stats) {
+  PhaseTimer timer;
+  if (!strcmp(ext, "bc")) {
+    raw_svector_ostream out(Bytes);
+    // --emit-bc: byte for byte what it writes; IR output: printed back from this on a hit
+    emitBitcode(M, out, opts.moduleHash, /*PreserveUseListOrder=*/!opts.emitBC);
+  } else if (!TM || !emitObjectBuffer(M, *TM, Bytes)) {
+    return false;
+  }
+  cache.store(key, ext, StringRef(Bytes.data(), Bytes.size()));
+  stats.addPhase("store", timer);
+  return true;
+}
+
+static void cacheCounters(CompileCache &cache, CompileStats &stats) {
+  CompileCache::Counters c = cache.counters();
+  stats.CacheHits = c.Hits;
+  stats.CacheMisses = c.Misses;
+  stats.CacheEvictions = c.Evictions;
+  stats.CacheEntries = c.Entries;
+  stats.CacheBytes = c.Bytes;
+}
+
+// a cached bitcode entry back into the IR text a compilation prints
+static bool printBitcode(const MemoryBuffer &bitcode, raw_ostream &out) {
+  LLVMContext Context;
+  Expected<std::unique_ptr<Module>> M = parseBitcodeFile(bitcode.getMemBufferRef(), Context);
+  if (!M) {
+    logAllUnhandledErrors(M.takeError(), errs(), "[cache] ");
+    return false;
+  }
+  (*M)->setModuleIdentifier("choreo");
+  (*M)->print(out, nullptr);
+  return true;
+}
+
+static bool writeBytes(StringRef path, StringRef bytes) {
+  std::error_code ec;
+  raw_fd_ostream out(path, ec, sys::fs::OF_None);
+  if (ec) {
+    fprintf(stderr, " %s: %s\n", path.str().c_str(), ec.message().c_str());
+    return false;
+  }
+  out << bytes;
+  return true;
+}
+
+// one file of a batch, start to finish on the calling thread (own Compilation, own LLVMContext)
+static bool compileBatchFile(const std::string &inputPath, const DriverOptions &opts, CompileCache *cache,
+                             CompileStats &stats) {
+  SmallString<128> outPath(opts.outputPath.empty() ? sys::path::parent_path(inputPath)
+                                                   : StringRef(opts.outputPath));
+  sys::path::append(outPath, sys::path::stem(inputPath) + (opts.emitObj ? ".o" : opts.emitBC ? ".bc" : ".ll"));
+
+  PhaseTimer readTimer;
+  std::unique_ptr<MemoryBuffer> source = readSource(inputPath.c_str());
+  if (!source)
+    return false;
+  stats.addPhase("read", readTimer);
+  Compilation C(inputPath);
+  stats.Input = inputPath;
+  const char *ext = opts.emitObj ? "o" : "bc";
+  std::unique_ptr<TargetMachine> TM;
+  std::string key;
+  std::unique_ptr<MemoryBuffer> entry;   // --cache: the object / bitcode to write out (or print)
+  if (cache) {
+    TM = createTargetMachine(opts.cpu, opts.optLevel);
+    entry = lookupCached(*cache, source->getBuffer(), ext, TM.get(), opts, key, stats);
+  }
+
+  LLVMContext Context;
+  std::unique_ptr<Module> TheModule;
+  SmallVector<char, 0> object;
+  if (!entry) {
+    TheModule = compileModule(C, source->getBuffer(), Context, opts, stats);
+    if (!TheModule || !prepareModule(*TheModule, opts, TM, stats))
+      return false;
+    if (cache && storeCached(*cache, *TheModule, TM.get(), key, ext, opts, object, stats) &&
+        (opts.emitObj || opts.emitBC))
+      entry = MemoryBuffer::getMemBuffer(StringRef(object.data(), object.size()), "", false);
+  }
+
+  PhaseTimer timer;
+  bool ok = true;
+  if ((opts.emitObj || opts.emitBC) && entry) {
+    ok = writeBytes(outPath, entry->getBuffer());
+  } else if (opts.emitObj) {
+    ok = emitObjectFile(*TheModule, *TM, outPath.str().str());
+  } else if (opts.emitBC) {
+    ok = emitBitcodeFile(*TheModule, outPath.str().str(), opts.moduleHash);
+  } else {
+    std::error_code ec;
+    raw_fd_ostream out(outPath, ec, sys::fs::OF_None);
+    if (ec) {
+      fprintf(stderr, " %s: %s\n", outPath.c_str(), ec.message().c_str());
+      return false;
+    }
+    if (entry)
+      ok = printBitcode(*entry, out);
+    else
+      TheModule->print(out, nullptr);
+  }
+  stats.addPhase("emit", timer);
+  if (cache && opts.collectStats())
+    cacheCounters(*cache, stats);
+  return ok;
+}
+
+// several inputs: compile them on a thread pool, one output per input
+static int compileBatch(const std::vector<std::string> &inputs, const DriverOptions &opts) {
+  if (opts.runJIT) {
+    fprintf(stderr, "--run takes a single input file\n");
+    return 1;
+  }
+  PhaseTimer timer;
+  std::atomic<unsigned> failed{0};
+  std::vector<CompileStats> stats(inputs.size());
+  std::unique_ptr<CompileCache> cache;
+  if (!opts.cacheDir.empty())
+    cache = std::make_unique<CompileCache>(opts.cacheDir, opts.cacheMaxBytes);
+  {
+    ThreadPool pool(hardware_concurrency(opts.jobs));
+    for (size_t i = 0; i < inputs.size(); ++i)
+      pool.async([&, i] {
+        if (!compileBatchFile(inputs[i], opts, cache.get(), stats[i]))
+          ++failed;
+      });
+    pool.wait();
+  }
+  if (Verbosity >= 1)
+    fprintf(stderr, " [batch] %zu files, %u failed, %u threads, %.3f ms\n",
+            inputs.size(), failed.load(), hardware_concurrency(opts.jobs).compute_thread_count(),
+            timer.wallMs());
+  if (opts.collectStats()) {
+    std::vector<const CompileStats*> all;
+    for (const CompileStats &s : stats)
+      all.push_back(&s);
+    if (!reportStats(all, opts))
+      return 1;
+  }
+  return failed ? 1 : 0;
+}
+
+// --run: the JIT phases in the statistics (and the -v summary)
+static void recordRun(const JITTimings &jitTimes, CompileStats &stats) {
+  stats.addPhase("jit", jitTimes.compileMs, jitTimes.compileCpuMs);
+  stats.addPhase("execute", jitTimes.executeMs, jitTimes.executeCpuMs);
+  if (Verbosity >= 1) {
+    double parseMs = 0, codegenMs = 0;
+    for (const PhaseTime &p : stats.Phases) {
+      if (!strcmp(p.Name, "lex") || !strcmp(p.Name, "parse")) parseMs += p.WallMs;
+      if (!strcmp(p.Name, "codegen")) codegenMs = p.WallMs;
+    }
+    fprintf(stderr,
+            " [time] parse %.3f ms, codegen %.3f ms, jit %.3f ms, execute %.3f ms\n",
+            parseMs, codegenMs, jitTimes.compileMs, jitTimes.executeMs);
+  }
+}
+
+// -o prog: WriteObject fills Count temp files (the k-th with object k), which are then linked
+// against libc (and the runtime); with --emit-obj (a module lowered in partitions) into the one
+// object file instead
+static bool linkProgram(const std::function<bool(unsigned, const std::string&)> &WriteObject, unsigned Count,
+                        const DriverOptions &opts, const char *argv0) {
+  std::vector<std::string> objects;
+  bool ok = true;
+  for (unsigned k = 0; k < Count && ok; ++k) {
+    SmallString<128> objPath;
+    if (sys::fs::createTemporaryFile("choreo", "o", objPath)) {
+      fprintf(stderr, " Cannot create a temporary object file.\n");
+      ok = false;
+      break;
+    }
+    objects.push_back(objPath.str().str());
+    ok = WriteObject(k, objects.back());
+  }
+  std::vector<std::string> temps = objects;
+  if (ok && opts.emitObj) {
+    ok = linkObjects(objects, opts.outputPath.empty() ? "out.o" : opts.outputPath);
+  } else if (ok) {
+    std::string runtimeLib = findRuntimeLibrary(argv0);
+    if (!runtimeLib.empty())
+      objects.push_back(runtimeLib);
+    else
+      fprintf(stderr, " libchoreo_rt.a not found next to choreo (set CHOREO_RUNTIME)\n");
+    ok = linkExecutable(objects, opts.outputPath);
+  }
+  for (const std::string &path : temps)
+    sys::fs::remove(path);
+  return ok;
+}
+
+// --split: a main cut into functions is lowered by up to -j threads at once, one object per
+// partition of the module (see emitObjectBuffers), which are then run or linked as one;
+// -1 when there is nothing to spread (one function, one thread, or IR / bitcode output)
+static int emitPartitionedOutput(Module &M, const DriverOptions &opts, const char *argv0, CompileStats &stats) {
+  unsigned parts = std::min(hardware_concurrency(opts.jobs).compute_thread_count(), stats.MainFunctions);
+  if (parts < 2 || !(opts.runJIT || opts.emitObj || opts.linkExecutable()))
+    return -1;
+  PhaseTimer timer;
+  std::vector<SmallVector<char, 0>> objects;
+  if (!emitObjectBuffers(M, parts, [&] { return createTargetMachine(opts.cpu, opts.optLevel); }, objects))
+    return 1;
+  stats.addPhase("backend", timer);
+  if (Verbosity >= 1)
+    fprintf(stderr, " [split] backend: %u partitions, %.3f ms\n", parts, timer.wallMs());
+  if (opts.runJIT) {
+    std::vector<std::unique_ptr<MemoryBuffer>> buffers;
+    for (const SmallVector<char, 0> &object : objects)
+      buffers.push_back(MemoryBuffer::getMemBuffer(StringRef(object.data(), object.size()), "", false));
+    JITTimings jitTimes;
+    int ret = runObjectJIT(std::move(buffers), jitTimes);
+    recordRun(jitTimes, stats);
+    return ret;
+  }
+  timer.restart();
+  bool ok = linkProgram([&](unsigned k, const std::string &objPath) {
+                          return writeBytes(objPath, StringRef(objects[k].data(), objects[k].size()));
+                        }, objects.size(), opts, argv0);
+  stats.addPhase("emit", timer);
+  return ok ? 0 : 1;
+}
 
-  // 5) Print LLVM IR
-  TheModule->print(llvm::outs(), nullptr);
+// the single-file outputs: run it, or write an object / executable / IR
+static int emitOutput(std::unique_ptr<Module> TheModule, std::unique_ptr<LLVMContext> TheContext,
+                      TargetMachine *TM, const DriverOptions &opts, const char *argv0, CompileStats &stats) {
+  int partitioned = emitPartitionedOutput(*TheModule, opts, argv0, stats);
+  if (partitioned >= 0)
+    return partitioned;
+  // 6) Either run the module right here or print the LLVM IR
+  if (opts.runJIT) {
+    JITTimings jitTimes;
+    int ret = runModuleJIT(std::move(TheModule), std::move(TheContext), jitTimes);
+    recordRun(jitTimes, stats);
+    return ret;
+  }
+  PhaseTimer timer;
+  int ret = 0;
+  if (opts.emitObj) {
+    std::string outputPath = opts.outputPath.empty() ? "out.o" : opts.outputPath;
+    ret = emitObjectFile(*TheModule, *TM, outputPath) ? 0 : 1;
+  } else if (opts.emitBC) {
+    // straight into the file: no IR text to build, nothing for lli / llc to re-parse
+    std::string outputPath = opts.outputPath.empty() ? "out.bc" : opts.outputPath;
+    ret = emitBitcodeFile(*TheModule, outputPath, opts.moduleHash) ? 0 : 1;
+  } else if (!opts.outputPath.empty()) {
+    ret = linkProgram([&](unsigned, const std::string &objPath) { return emitObjectFile(*TheModule, *TM, objPath); },
+                      1, opts, argv0) ? 0 : 1;
+  } else {
+    TheModule->print(llvm::outs(), nullptr);
+    outs().flush();
+  }
+  stats.addPhase("emit", timer);
+  return ret;
+}
+
+// the same outputs from a finished native object (a --cache entry)
+static int emitObjectOutput(std::unique_ptr<MemoryBuffer> Object, const DriverOptions &opts,
+                            const char *argv0, CompileStats &stats) {
+  if (opts.runJIT) {
+    JITTimings jitTimes;
+    int ret = runObjectJIT(std::move(Object), jitTimes);
+    recordRun(jitTimes, stats);
+    return ret;
+  }
+  PhaseTimer timer;
+  bool ok;
+  if (opts.emitObj)
+    ok = writeBytes(opts.outputPath.empty() ? "out.o" : opts.outputPath, Object->getBuffer());
+  else
+    ok = linkProgram([&](unsigned, const std::string &objPath) { return writeBytes(objPath, Object->getBuffer()); },
+                     1, opts, argv0);
+  stats.addPhase("emit", timer);
+  return ok ? 0 : 1;
+}
+
+// --cache, single file: reuse the object / bitcode of an identical earlier compilation, or
+// compile as usual and keep what came out
+static int compileCached(Compilation &C, StringRef source, const DriverOptions &opts, const char *argv0,
+                         CompileStats &stats) {
+  CompileCache cache(opts.cacheDir, opts.cacheMaxBytes);
+  bool object = opts.runJIT || opts.emitObj || opts.linkExecutable();
+  const char *ext = object ? "o" : "bc";
+  std::unique_ptr<TargetMachine> TM = createTargetMachine(opts.cpu, opts.optLevel);
+  std::string key;
+  stats.Input = C.InputName;
+  std::unique_ptr<MemoryBuffer> entry = lookupCached(cache, source, ext, TM.get(), opts, key, stats);
+
+  int ret;
+  if (!entry) {
+    auto TheContext = std::make_unique<LLVMContext>();
+    std::unique_ptr<Module> TheModule = compileModule(C, source, *TheContext, opts, stats);
+    if (!TheModule || !prepareModule(*TheModule, opts, TM, stats))
+      return 1;
+    SmallVector<char, 0> bytes;
+    bool stored = storeCached(cache, *TheModule, TM.get(), key, ext, opts, bytes, stats);
+    if (stored && object)   // go on from the object, as on a hit
+      ret = emitObjectOutput(MemoryBuffer::getMemBufferCopy(StringRef(bytes.data(), bytes.size())), opts, argv0, stats);
+    else if (stored && opts.emitBC)
+      ret = writeBytes(opts.outputPath.empty() ? "out.bc" : opts.outputPath, StringRef(bytes.data(), bytes.size())) ? 0 : 1;
+    else
+      ret = emitOutput(std::move(TheModule), std::move(TheContext), TM.get(), opts, argv0, stats);
+  } else if (object) {
+    ret = emitObjectOutput(std::move(entry), opts, argv0, stats);
+  } else {
+    PhaseTimer timer;
+    if (opts.emitBC)
+      ret = writeBytes(opts.outputPath.empty() ? "out.bc" : opts.outputPath, entry->getBuffer()) ? 0 : 1;
+    else
+      ret = printBitcode(*entry, outs()) ? 0 : 1;
+    outs().flush();
+    stats.addPhase("emit", timer);
+  }
+  if (opts.collectStats())
+    cacheCounters(cache, stats);
+  return ret;
+}
+
+// --interp: the front end as usual, then the bytecode; LLVM only comes in if a region gets hot
+static int interpretSource(Compilation &C, StringRef source, const DriverOptions &opts, CompileStats &stats) {
+  CompilationScope scope(C);
+  ProfileData profile;   // stays empty: no --profile-use with --interp
+  if (!parseSource(C, source, opts, stats) || !resolveProgram(C, opts, profile, stats))
+    return 1;
+  if (opts.collectStats()) {
+    stats.NodesByClass = C.Arena.objectsByType();
+    stats.ASTBytes = C.Arena.peakBytes();
+  }
+
+  InterpOptions interpOpts;
+  interpOpts.HotThreshold = opts.tierUp;
+  interpOpts.OptLevel = opts.optLevel;
+  interpOpts.CPU = opts.cpu;
+  interpOpts.EchoBuffer = opts.echoBuffer;
+  interpOpts.EchoLineMode = opts.echoLineMode;
+  InterpTimings times;
+  int ret = interpretProgram(C, interpOpts, times);
+  stats.addPhase("bytecode", times.bytecodeMs, times.bytecodeCpuMs);
+  stats.addPhase("tier-up", times.tierUpMs, times.tierUpCpuMs);
+  stats.addPhase("execute", times.executeMs, times.executeCpuMs);
+  if (Verbosity >= 1)
+    fprintf(stderr, " [time] bytecode %.3f ms, tier-up %.3f ms, execute %.3f ms\n",
+            times.bytecodeMs, times.tierUpMs, times.executeMs);
+  return ret;
+}
 
-  return 0;
-}
\ No newline at end of file
+// --serve: the server's --cache, for the requests that do not choose (set before it forks them)
+static bool InServer = false;
+static std::string ServerCacheDir;
+static uint64_t ServerCacheMaxBytes = 0;
+
+// --serve: one -O2 compilation, object emission and JIT link of a small script before the first
+// fork, so each request starts with the code of those paths paged in and the lazy bindings into
+// libLLVM resolved instead of paying for them itself
+static void warmUp() {
+  static const char script[] =
+    "ENTER i = 0\nENTER s = 0\nENSEMBLE a[16]\n"
+    "REPEAT 16 TIMES\na[i] = i * 0.5\ns = s + a[i]\ni = i + 1\nENDREPEAT\n"
+    "SPIN s > 100 THEN MOVE TO done\ns = SUM(a)\nECCO_D s\nECCO \"small\"\ndone:\nEXIT\n";
+  DriverOptions opts;
+  opts.optLevel = 2;
+  CompileStats stats;
+  Compilation C("<warm-up>");
+  auto TheContext = std::make_unique<LLVMContext>();
+  std::unique_ptr<Module> TheModule = compileModule(C, script, *TheContext, opts, stats);
+  std::unique_ptr<TargetMachine> TM;
+  if (!TheModule || !prepareModule(*TheModule, opts, TM, stats) || !TM)
+    return;
+  SmallVector<char, 0> object;
+  emitObjectBuffer(*TheModule, *TM, object);
+  TierJIT().compile(std::move(TheModule), std::move(TheContext), "main");   // linked, not run
+}
+
+static int driver(int argc, char** argv) {
+  // command line: optimization level and the input script(s) (stdin if none)
+  DriverOptions opts;
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3' && !arg[3]) {
+      opts.optLevel = arg[2] - '0';
+    } else if (!strcmp(arg, "--run")) {
+      opts.runJIT = true;
+    } else if (!strcmp(arg, "--emit-obj")) {
+      opts.emitObj = true;
+    } else if (!strcmp(arg, "--emit-bc")) {
+      opts.emitBC = true;
+    } else if (!strcmp(arg, "--module-hash")) {
+      opts.moduleHash = true;
+    } else if (!strcmp(arg, "-o") && i + 1 < argc) {
+      opts.outputPath = argv[++i];
+    } else if (!strcmp(arg, "-j") && i + 1 < argc) {
+      opts.jobs = atoi(argv[++i]);
+    } else if (arg[0] == '-' && arg[1] == 'j' && isdigit((unsigned char)arg[2])) {
+      opts.jobs = atoi(arg + 2);
+    } else if (!strncmp(arg, "-march=", 7) || !strncmp(arg, "-mcpu=", 6)) {
+      opts.cpu = strchr(arg, '=') + 1;
+    } else if (!strcmp(arg, "--fast-math") || !strncmp(arg, "--fast-math=", 12)) {
+      FastMathFlags fmf = BlockFastMath;   // plain --fast-math: reassoc,contract,nsz,arcp
+      if (arg[11] == '=') {
+        fmf.clear();
+        if (!parseFastMathFlags(arg + 12, fmf)) {
+          fprintf(stderr, "--fast-math: flags are fast, reassoc, contract, nnan, ninf, nsz, arcp, afn\n");
+          return 1;
+        }
+      }
+      ProgramFastMath = BlockFastMath = fmf;
+    } else if (!strncmp(arg, "--threads=", 10)) {
+      ParallelThreads = atoi(arg + 10);   // PARALLEL loops; 0 = one thread per cpu
+    } else if (!strcmp(arg, "--echo=printf") || !strcmp(arg, "--echo=runtime")) {
+      EchoMode = !strcmp(arg, "--echo=printf") ? EchoLowering::Printf : EchoLowering::Runtime;
+    } else if (!strncmp(arg, "--echo-buffer=", 14)) {
+      opts.echoBuffer = atoll(arg + 14);
+    } else if (!strcmp(arg, "--echo-mode=line") || !strcmp(arg, "--echo-mode=block")) {
+      opts.echoLineMode = !strcmp(arg, "--echo-mode=line");
+    } else if (!strcmp(arg, "-v") || !strcmp(arg, "-vv")) {
+      Verbosity = strlen(arg) - 1;
+    } else if (!strcmp(arg, "--time-report")) {
+      opts.timeReport = true;
+    } else if (!strcmp(arg, "--stats")) {
+      opts.showStats = true;
+    } else if (!strncmp(arg, "--stats-json=", 13)) {
+      opts.statsJSON = arg + 13;
+    } else if (!strcmp(arg, "--cache") || !strncmp(arg, "--cache=", 8)) {
+      opts.cacheDir = arg[7] ? arg + 8 : CompileCache::defaultDir();
+      if (opts.cacheDir.empty())
+        fprintf(stderr, "--cache: no cache directory (set CHOREO_CACHE_DIR), not caching\n");
+    } else if (!strncmp(arg, "--cache-size=", 13)) {
+      opts.cacheMaxBytes = strtoull(arg + 13, nullptr, 10) << 20;
+    } else if (!strcmp(arg, "--profile-generate") || !strncmp(arg, "--profile-generate=", 19)) {
+      opts.profileGenerate = arg[18] ? arg + 19 : "choreo.profile";
+    } else if (!strncmp(arg, "--profile-use=", 14)) {
+      opts.profileUse = arg + 14;
+    } else if (!strcmp(arg, "--stream")) {
+      opts.stream = true;
+    } else if (!strcmp(arg, "--interp")) {
+      opts.interp = true;
+    } else if (!strncmp(arg, "--split=", 8)) {
+      opts.splitSize = strtoul(arg + 8, nullptr, 10);
+    } else if (!strncmp(arg, "--tier-up=", 10)) {
+      opts.tierUp = strtoull(arg + 10, nullptr, 10);
+    } else if (!strcmp(arg, "--serve") || !strncmp(arg, "--serve=", 8)) {
+      char path[256];
+      if (arg[7]) {
+        opts.serveSocket = arg + 8;
+      } else if (choreo_server_socket(path, sizeof path)) {
+        opts.serveSocket = path;
+      } else {
+        fprintf(stderr, "--serve: socket path too long, pass --serve=<socket>\n");
+        return 1;
+      }
+    } else if (!strcmp(arg, "--lexer=fast") || !strcmp(arg, "--lexer=flex")) {
+      opts.flexLexer = !strcmp(arg, "--lexer=flex");
+    } else if (arg[0] == '-' && arg[1]) {
+      fprintf(stderr, "Unknown option `%s`\n", arg);
+      usage(argv[0]);
+      return 1;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+  if (!opts.serveSocket.empty()) {
+    if (InServer || !inputs.empty()) {
+      fprintf(stderr, "--serve takes no input files and is not a request: compile through choreoc\n");
+      return 1;
+    }
+    InServer = true;
+    ServerCacheDir = opts.cacheDir;
+    ServerCacheMaxBytes = opts.cacheMaxBytes;
+    std::string self = sys::fs::getMainExecutable(argv[0], (void*)&usage);   // requests run in the client's directory
+    unsigned verbosity = Verbosity;
+    Verbosity = 0;
+    warmUp();
+    Verbosity = verbosity;
+    return serveRequests(opts.serveSocket, opts.jobs, self.empty() ? argv[0] : self.c_str(), driver);
+  }
+  if (InServer && opts.cacheDir.empty() && !opts.interp && opts.profileGenerate.empty() && opts.profileUse.empty()) {
+    opts.cacheDir = ServerCacheDir;
+    opts.cacheMaxBytes = ServerCacheMaxBytes;
+  }
+  if (opts.emitBC && (opts.emitObj || opts.runJIT)) {
+    fprintf(stderr, "--emit-bc cannot be combined with --run or --emit-obj\n");
+    return 1;
+  }
+  if (opts.stream && !(opts.profileGenerate.empty() && opts.profileUse.empty())) {
+    fprintf(stderr, "--profile-generate / --profile-use need the whole program before codegen, not with --stream\n");
+    return 1;
+  }
+  if (inputs.size() > 1 && !(opts.profileGenerate.empty() && opts.profileUse.empty())) {
+    fprintf(stderr, "--profile-generate / --profile-use take a single input file\n");
+    return 1;
+  }
+  if (opts.interp && (inputs.size() > 1 || opts.stream || opts.emitObj || opts.emitBC || !opts.outputPath.empty() ||
+                      !opts.cacheDir.empty() || !opts.profileGenerate.empty() || !opts.profileUse.empty())) {
+    fprintf(stderr, "--interp runs a single file: no --stream, --cache, --emit-obj / --emit-bc, -o or profile options\n");
+    return 1;
+  }
+  if (inputs.size() > 1)
+    return compileBatch(inputs, opts);
+
+  const char *inputPath = inputs.empty() ? nullptr : inputs[0].c_str();
+  CompileStats stats;
+  PhaseTimer readTimer;
+  std::unique_ptr<MemoryBuffer> source = readSource(inputPath);
+  if (!source)
+    return 1;
+  stats.addPhase("read", readTimer);
+  Compilation C(inputPath ? inputPath : "<stdin>");
+  int ret;
+  if (opts.interp) {
+    ret = interpretSource(C, source->getBuffer(), opts, stats);
+  } else if (!opts.cacheDir.empty()) {
+    ret = compileCached(C, source->getBuffer(), opts, argv[0], stats);
+  } else {
+    auto TheContext = std::make_unique<LLVMContext>();
+    std::unique_ptr<Module> TheModule = compileModule(C, source->getBuffer(), *TheContext, opts, stats);
+    if (!TheModule) {
+      if (opts.collectStats())   // the phases it got through
+        reportStats({ &stats }, opts);
+      return 1;
+    }
+    std::unique_ptr<TargetMachine> TM;
+    if (!prepareModule(*TheModule, opts, TM, stats))
+      return 1;
+    ret = emitOutput(std::move(TheModule), std::move(TheContext), TM.get(), opts, argv[0], stats);
+  }
+  if (opts.collectStats() && !reportStats({ &stats }, opts))
+    return 1;
+  return ret;
+}
+
+int main(int argc, char** argv) {
+  return driver(argc, argv);
+}
@@ -0,0 +1,124 @@
+/* choreoc.c -- `choreo` through a running `choreo --serve`: same arguments, same output,
+   same exit status, without loading LLVM. Sends its arguments, directory, environment and
+   stdin / stdout / stderr to the server (protocol in server.h) and waits for the status.
+   With no server on the socket it runs the choreo next to it (or on $PATH) itself. */
+#include "server.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+extern char **environ;
+
+/* no server: exec the real thing with the same arguments */
+static int fallback(char **argv) {
+  char self[PATH_MAX];
+  ssize_t n = readlink("/proc/self/exe", self, sizeof self - sizeof "choreo");
+  if (n > 0) {
+    self[n] = '\0';
+    char *slash = strrchr(self, '/');
+    if (slash) {
+      strcpy(slash + 1, "choreo");
+      argv[0] = self;
+      execv(self, argv);
+    }
+  }
+  argv[0] = "choreo";
+  execvp("choreo", argv);
+  fprintf(stderr, "choreoc: no server and no choreo to run: %s\n", strerror(errno));
+  return 127;
+}
+
+/* Buf grows to hold Len more bytes */
+static int append(char **Buf, size_t *Size, size_t *Cap, const char *Str, size_t Len) {
+  if (*Size + Len > *Cap) {
+    size_t cap = *Cap ? *Cap : 4096;
+    while (cap < *Size + Len) cap *= 2;
+    char *p = realloc(*Buf, cap);
+    if (!p) return 0;
+    *Buf = p;
+    *Cap = cap;
+  }
+  memcpy(*Buf + *Size, Str, Len);
+  *Size += Len;
+  return 1;
+}
+
+static int writeAll(int Fd, const char *P, size_t N) {
+  while (N) {
+    ssize_t w = write(Fd, P, N);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return 0;
+    P += w;
+    N -= (size_t)w;
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  if (!choreo_server_socket(addr.sun_path, sizeof addr.sun_path))
+    return fallback(argv);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof addr) != 0)
+    return fallback(argv);
+
+  /* the directory, the arguments, the environment */
+  char *payload = NULL;
+  size_t size = 0, cap = 0;
+  char cwd[PATH_MAX];
+  if (!getcwd(cwd, sizeof cwd)) {
+    perror("choreoc: getcwd");
+    return 1;
+  }
+  int ok = append(&payload, &size, &cap, cwd, strlen(cwd) + 1);
+  for (int i = 1; i < argc && ok; ++i)
+    ok = append(&payload, &size, &cap, argv[i], strlen(argv[i]) + 1);
+  for (char **e = environ; *e && ok; ++e)
+    ok = append(&payload, &size, &cap, *e, strlen(*e) + 1);
+  if (!ok || size > CHOREO_REQUEST_MAX) {
+    fprintf(stderr, "choreoc: request too large\n");
+    return 1;
+  }
+
+  struct ChoreoRequest header = { CHOREO_REQUEST_MAGIC, (uint32_t)(argc - 1), (uint32_t)size };
+  int fds[3] = { 0, 1, 2 };
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof fds)];
+  } control;
+  struct iovec iov = { &header, sizeof header };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof control.buf;
+  struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(sizeof fds);
+  memcpy(CMSG_DATA(c), fds, sizeof fds);
+  if (sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof header || !writeAll(fd, payload, size)) {
+    perror("choreoc: send");
+    return 1;
+  }
+  free(payload);
+
+  int32_t status;
+  size_t got = 0;
+  while (got < sizeof status) {
+    ssize_t r = read(fd, (char *)&status + got, sizeof status - got);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) {
+      fprintf(stderr, "choreoc: the server dropped the request\n");
+      return 1;
+    }
+    got += (size_t)r;
+  }
+  return status;
+}
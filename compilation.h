@@ -0,0 +1,79 @@
+// compilation.h
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "arena.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+
+struct ASTNode;
+struct ProfileData;
+class StreamingCodegen;
+struct SplitSegment;
+
+// integer type inference: the values a variable / expression may take, both ends included
+struct ValueRange {
+  double Lo, Hi;
+};
+
+// Per-module constant pool: every distinct string literal / format string becomes one private
+// global, and the printf / runtime declarations are looked up once instead of on every call.
+struct ModuleConstants {
+  llvm::Module *Owner = nullptr;
+  std::map<std::string, llvm::Constant*, std::less<>> Strings;   // contents -> i8* to the first character
+  llvm::FunctionCallee Printf, EchoStr, EchoF64;
+  llvm::FunctionCallee Reductions[4];   // choreo_{sum,min,max,dot}_f64, indexed by ReduceExpr::Kind
+  llvm::FunctionCallee ParallelFor;     // choreo_parallel_for
+  llvm::MDNode *TBAAElement = nullptr, *TBAAPointer = nullptr, *TBAALength = nullptr;   // see ast.cpp
+};
+
+// Everything one source file needs from parsing to the finished module. Nothing in the lexer,
+// parser or codegen is global any more, so several files can be compiled at the same time,
+// one Compilation (and one LLVMContext) per thread.
+struct Compilation {
+  std::string InputName;                       // for diagnostics
+  ASTArena Arena;                              // the AST and the interned names / literals
+  std::vector<ASTNode*> *Program = nullptr;    // top-level statements, set by the parser
+  StreamingCodegen *Stream = nullptr;          // --stream: takes them one by one instead (Program stays null)
+  SplitSegment *Segment = nullptr;             // --split: the function of main being generated (see split.h)
+  unsigned Errors = 0;                         // lexer / parser / resolver errors
+
+  // codegen state, indexed by the dense slots resolveNames() hands out
+  std::vector<llvm::AllocaInst*> VarSlots;        // ENTER slot -> its stack slot
+  std::vector<llvm::GlobalVariable*> ArraySlots;  // ENSEMBLE slot -> its global ([n x double], or double* when mapped)
+  std::vector<llvm::Value*> ArrayLengths;         // ENSEMBLE slot -> i64 constant, or the i64 global of a file-sized one
+  std::vector<llvm::BasicBlock*> LabelSlots;      // label slot -> its block
+  std::vector<llvm::StringRef> LabelNames;        // label slot -> name (block names)
+  std::vector<bool> NonIntegerSlots;              // variable slots that need a double (everything else is i64)
+  std::vector<ValueRange> VarRanges;              // ... and the values the others hold
+  llvm::Value *ElementIndex = nullptr;            // i64 element a whole-ENSEMBLE assignment is computing
+  llvm::Value *RepeatStart = nullptr;             // i64 iteration the next REPEAT starts at (--interp tier-up), else 0
+  std::vector<llvm::StringRef> SpinTargets;       // SPIN number (program order) -> the label it jumps to
+  llvm::GlobalVariable *ProfileCounters = nullptr; // --profile-generate: the counters (see profile.h)
+  const ProfileData *Profile = nullptr;           // --profile-use: the counts of the training runs
+  ModuleConstants Constants;
+
+  explicit Compilation(std::string input = "<stdin>") : InputName(std::move(input)) {}
+  Compilation(const Compilation&) = delete;
+  Compilation& operator=(const Compilation&) = delete;
+};
+
+// The AST node interface (codegen, isIntegral) has no room for a context argument, so the
+// nodes find the state of their compilation here. Bind it with CompilationScope around
+// resolveNames / inferIntegerVariables / codegen; it is per thread.
+Compilation &currentCompilation();
+
+class CompilationScope {
+  Compilation *Prev;
+public:
+  explicit CompilationScope(Compilation &C);
+  ~CompilationScope();
+  CompilationScope(const CompilationScope&) = delete;
+  CompilationScope& operator=(const CompilationScope&) = delete;
+};
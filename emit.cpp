@@ -0,0 +1,170 @@
+#include "emit.h"
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/CodeGen/ParallelCG.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetOptions.h>
+using namespace llvm;
+
+//----------------------------------------------------------host TargetMachine, optionally tuned for a specific / the native cpu
+std::unique_ptr<TargetMachine> createTargetMachine(const std::string &CPU,
+                                                   unsigned OptLevel) {
+// target registration isn't thread safe; batch mode calls this from several threads
+static const bool targetsReady = (InitializeNativeTarget(), InitializeNativeTargetAsmPrinter(), true);
+(void)targetsReady;
+
+std::string triple = sys::getDefaultTargetTriple();
+std::string err;
+const Target *target = TargetRegistry::lookupTarget(triple, err);
+if (!target) {
+  errs() << "[emit] " << err << "\n";
+  return nullptr;
+}
+
+// "native" = whatever this machine is, with every feature it reports (sse4.2, avx2, avx512f, ...)
+std::string cpu = CPU;
+std::string features;
+if (cpu == "native") {
+  cpu = sys::getHostCPUName().str();
+  StringMap<bool> hostFeatures;
+  if (sys::getHostCPUFeatures(hostFeatures))
+    for (auto &f : hostFeatures)
+      features += (features.empty() ? "" : ",") + std::string(f.second ? "+" : "-") + f.first().str();
+}
+if (cpu.empty())
+  cpu = "generic";
+
+CodeGenOpt::Level level = CodeGenOpt::None;
+switch (OptLevel) {
+case 0:  level = CodeGenOpt::None; break;
+case 1:  level = CodeGenOpt::Less; break;
+case 2:  level = CodeGenOpt::Default; break;
+default: level = CodeGenOpt::Aggressive; break;
+}
+
+// PIC so the object links into the default (PIE) executables of the system cc
+TargetOptions opts;
+return std::unique_ptr<TargetMachine>(target->createTargetMachine(
+  triple, cpu, features, opts, Reloc::PIC_, None, level));
+}
+
+//----------------------------------------------------------module -> .o through the codegen pipeline of the TargetMachine
+static bool emitObject(Module &M, TargetMachine &TM, raw_pwrite_stream &out) {
+M.setTargetTriple(TM.getTargetTriple().str());
+M.setDataLayout(TM.createDataLayout());
+
+legacy::PassManager PM;
+if (TM.addPassesToEmitFile(PM, out, nullptr, CGFT_ObjectFile)) {
+  errs() << "[emit] target cannot emit object files\n";
+  return false;
+}
+PM.run(M);
+return true;
+}
+
+bool emitObjectFile(Module &M, TargetMachine &TM, const std::string &Path) {
+std::error_code ec;
+raw_fd_ostream out(Path, ec, sys::fs::OF_None);
+if (ec) {
+  errs() << "[emit] cannot open " << Path << ": " << ec.message() << "\n";
+  return false;
+}
+if (!emitObject(M, TM, out))
+  return false;
+out.flush();
+return true;
+}
+
+bool emitObjectBuffer(Module &M, TargetMachine &TM, SmallVectorImpl<char> &Object) {
+raw_svector_ostream out(Object);
+return emitObject(M, TM, out);
+}
+
+//----------------------------------------------------------module -> several .o on as many threads
+bool emitObjectBuffers(Module &M, unsigned Parts, const std::function<std::unique_ptr<TargetMachine>()> &MakeTM,
+                       std::vector<SmallVector<char, 0>> &Objects) {
+Objects.assign(Parts, SmallVector<char, 0>());
+std::vector<std::unique_ptr<raw_svector_ostream>> streams;
+std::vector<raw_pwrite_stream*> outs;
+for (SmallVector<char, 0> &object : Objects) {
+  streams.emplace_back(new raw_svector_ostream(object));
+  outs.push_back(streams.back().get());
+}
+std::unique_ptr<TargetMachine> TM = MakeTM();   // no target (reported by the factory) is an error, not a crash in a thread
+if (!TM)
+  return false;
+M.setTargetTriple(TM->getTargetTriple().str());
+M.setDataLayout(TM->createDataLayout());
+splitCodeGen(M, outs, {}, MakeTM);
+return true;
+}
+
+//----------------------------------------------------------module -> .bc
+void emitBitcode(const Module &M, raw_ostream &Out, bool ModuleHash, bool PreserveUseListOrder) {
+WriteBitcodeToFile(M, Out, PreserveUseListOrder, nullptr, ModuleHash);
+}
+
+bool emitBitcodeFile(const Module &M, const std::string &Path, bool ModuleHash) {
+std::error_code ec;
+raw_fd_ostream out(Path, ec, sys::fs::OF_None);
+if (ec) {
+  errs() << "[emit] cannot open " << Path << ": " << ec.message() << "\n";
+  return false;
+}
+emitBitcode(M, out, ModuleHash);
+out.close();
+if (out.has_error()) {
+  errs() << "[emit] cannot write " << Path << ": " << out.error().message() << "\n";
+  out.clear_error();
+  return false;
+}
+return true;
+}
+
+//----------------------------------------------------------where is the runtime archive?
+std::string findRuntimeLibrary(const char *Argv0) {
+if (const char *env = getenv("CHOREO_RUNTIME"))
+  return env;
+std::string exe = sys::fs::getMainExecutable(Argv0, (void*)&findRuntimeLibrary);
+SmallString<256> lib(sys::path::parent_path(exe));
+sys::path::append(lib, "libchoreo_rt.a");
+return sys::fs::exists(lib) ? lib.str().str() : std::string();
+}
+
+//----------------------------------------------------------objects + libc -> executable (cc picks crt files and the dynamic linker for us)
+static bool runLinker(const std::vector<std::string> &Objects, const char *Mode, const std::string &OutPath) {
+auto cc = sys::findProgramByName("cc");
+if (!cc) {
+  errs() << "[emit] no `cc` found in PATH to link with\n";
+  return false;
+}
+std::vector<StringRef> args{ *cc };
+for (auto &obj : Objects)
+  args.push_back(obj);
+args.push_back(Mode);
+args.push_back("-o");
+args.push_back(OutPath);
+
+std::string err;
+int rc = sys::ExecuteAndWait(*cc, args, None, {}, 0, 0, &err);
+if (rc != 0) {
+  errs() << "[emit] link failed" << (err.empty() ? "" : ": " + err) << "\n";
+  return false;
+}
+return true;
+}
+
+bool linkExecutable(const std::vector<std::string> &Objects, const std::string &ExePath) {
+return runLinker(Objects, "-pthread", ExePath);   // -pthread: the PARALLEL thread pool of libchoreo_rt.a
+}
+
+bool linkObjects(const std::vector<std::string> &Objects, const std::string &Path) {
+return runLinker(Objects, "-r", Path);
+}
@@ -0,0 +1,44 @@
+// emit.h
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+// Build a TargetMachine for the host triple. CPU is an LLVM cpu name
+// ("haswell", "znver3", ...) or "native" for the host cpu and all of its
+// SIMD features; empty means the generic cpu of the triple.
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(const std::string &CPU,
+                                                         unsigned OptLevel);
+
+// Lower the module to a native object file. Returns false (after printing why) on failure.
+bool emitObjectFile(llvm::Module &M, llvm::TargetMachine &TM, const std::string &Path);
+// Same, into memory: what --cache stores (and --run then JITs).
+bool emitObjectBuffer(llvm::Module &M, llvm::TargetMachine &TM, llvm::SmallVectorImpl<char> &Object);
+// --split: the module's functions in Parts partitions, lowered on a thread each (llvm::splitCodeGen)
+// into one object per partition; linked together the objects are what emitObjectBuffer makes of
+// the whole module. MakeTM builds the TargetMachine of each thread. Leaves M unusable.
+bool emitObjectBuffers(llvm::Module &M, unsigned Parts,
+                       const std::function<std::unique_ptr<llvm::TargetMachine>()> &MakeTM,
+                       std::vector<llvm::SmallVector<char, 0>> &Objects);
+
+// --emit-bc: LLVM bitcode instead of IR text, which lli / opt / llc load much faster.
+// ModuleHash adds a MODULE_CODE_HASH record (a SHA-1 of the module) for build systems / ThinLTO.
+// PreserveUseListOrder makes the IR printed from the bitcode identical to the module's own
+// (the order of `preds` comments); it costs a lot on huge functions, so only --cache uses it.
+void emitBitcode(const llvm::Module &M, llvm::raw_ostream &Out, bool ModuleHash,
+                 bool PreserveUseListOrder = false);
+bool emitBitcodeFile(const llvm::Module &M, const std::string &Path, bool ModuleHash);
+
+// Path of libchoreo_rt.a: $CHOREO_RUNTIME if set, else next to the choreo binary.
+// Empty if it can't be found.
+std::string findRuntimeLibrary(const char *Argv0);
+
+// Link objects into a standalone executable against libc with the system `cc`.
+bool linkExecutable(const std::vector<std::string> &Objects, const std::string &ExePath);
+// Link objects into one relocatable object (`cc -r`): --emit-obj of a module lowered in partitions.
+bool linkObjects(const std::vector<std::string> &Objects, const std::string &Path);
@@ -0,0 +1,794 @@
+#include "interp.h"
+#include "ast.h"
+#include "compilation.h"
+#include "emit.h"
+#include "jit.h"
+#include "optimize.h"
+#include "stats.h"
+#include "runtime/choreo_rt.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/raw_ostream.h>
+using namespace llvm;
+
+//----------------------------------------------------------the bytecode
+// Three operands per instruction. The table says which of them are registers (RA, RB, RC) and
+// whether A is written (W); the others are jump targets, loop / label / ENSEMBLE / string
+// numbers or counts. Jump targets are always C.
+enum OperandKinds : unsigned { RA = 1, RB = 2, RC = 4, W = 8 };
+#define CHOREO_OPCODES(X)                                                                  \
+  X(Halt,      0)             /* end of the program */                                    \
+  X(Mov,       W | RA | RB)   /* A = B */                                                 \
+  X(IToF,      W | RA | RB)   /* A = (double)B */                                         \
+  X(FToI,      W | RA | RB)   /* A = (i64)B, as fptosi */                                 \
+  X(AddI,      W | RA | RB | RC)   /* A = B op C, i64 wrapping */                         \
+  X(SubI,      W | RA | RB | RC)                                                          \
+  X(MulI,      W | RA | RB | RC)                                                          \
+  X(AddF,      W | RA | RB | RC)   /* A = B op C, double */                               \
+  X(SubF,      W | RA | RB | RC)                                                          \
+  X(MulF,      W | RA | RB | RC)                                                          \
+  X(DivF,      W | RA | RB | RC)                                                          \
+  X(LtI,       W | RA | RB | RC)   /* A = B < C (doubles: or unordered, like fcmp ult) */ \
+  X(GtI,       W | RA | RB | RC)                                                          \
+  X(LtF,       W | RA | RB | RC)                                                          \
+  X(GtF,       W | RA | RB | RC)                                                          \
+  X(Jmp,       0)             /* goto C */                                                \
+  X(JNZ,       RA)            /* if A != 0 goto C */                                      \
+  X(JNZF,      RA)                                                                        \
+  X(JLtI,      RA | RB)       /* if A < B goto C: a SPIN on a comparison */               \
+  X(JGtI,      RA | RB)                                                                   \
+  X(JLtF,      RA | RB)                                                                   \
+  X(JGtF,      RA | RB)                                                                   \
+  X(LoopEnter, 0)             /* REPEAT A: first iteration, or past the loop */           \
+  X(LoopNext,  0)             /* REPEAT A: next iteration, or fall out */                 \
+  X(LabelHit,  0)             /* label A reached */                                       \
+  X(EchoStr,   0)             /* ECCO string A */                                         \
+  X(EchoF,     RA)            /* ECCO_D A */                                              \
+  X(Load,      W | RA | RC)   /* A = ENSEMBLE B [C] */                                    \
+  X(Store,     RB | RC)       /* ENSEMBLE A [B] = C */                                    \
+  X(Len,       W | RA)        /* A = element count of ENSEMBLE B */                       \
+  X(Reduce,    W | RA)        /* A = SUM / MIN / MAX (C = ReduceExpr::Kind) of ENSEMBLE B */ \
+  X(Dot,       W | RA)        /* A = DOT(ENSEMBLE B, ENSEMBLE C) */                       \
+  X(CheckLen,  0)             /* stop unless ENSEMBLEs A and B have one size (string C) */ \
+  X(Map,       0)             /* ENSEMBLE A FROM string B, C elements (-1: the whole file) */ \
+  X(Save,      0)             /* SAVE ENSEMBLE A TO string B */
+
+enum Opcode : uint16_t {
+#define OPCODE_ENUM(Name, Operands) Op##Name,
+CHOREO_OPCODES(OPCODE_ENUM)
+#undef OPCODE_ENUM
+};
+
+static const struct { const char *Name; unsigned Operands; } OpInfo[] = {
+#define OPCODE_INFO(Name, Operands) { #Name, Operands },
+CHOREO_OPCODES(OPCODE_INFO)
+#undef OPCODE_INFO
+};
+
+struct Insn {
+  uint16_t Op;
+  int32_t A, B, C;
+};
+
+// a register: variables, temporaries and constants alike
+union Cell {
+  int64_t I;
+  double F;
+};
+
+// a compiled region: iterations Start.. of its loop (a label region ignores Start)
+typedef void (*NativeRegion)(Cell *Cells, int64_t Start);
+
+struct LoopInfo {
+  Repeat *Node;
+  int64_t Trip;
+  int32_t Body = 0, Exit = 0;      // first instruction of the body / after the loop
+  bool Closed = true;              // no MOVE TO / SPIN out of the body: it can go native
+  uint64_t HotAt = UINT64_MAX;     // interpreted iterations that make it native
+  int64_t Counter = 0;             // iteration being interpreted
+  uint64_t Iterations = 0;         // interpreted so far, over all entries
+  int64_t NativeFrom = -1;         // iteration the native code took over at
+  NativeRegion Native = nullptr;
+  double CompileMs = 0;
+};
+
+struct LabelInfo {
+  int32_t Pos = -1;
+  bool TopLevel = true;            // not inside a REPEAT: the rest of the program can go native from it
+  uint64_t HotAt = UINT64_MAX;     // visits that make it native
+  uint64_t Visits = 0;
+  NativeRegion Native = nullptr;
+  double CompileMs = 0;
+};
+
+struct ArrayInfo {
+  StringRef Name, Path;
+  size_t Count = 0;                // ArrayDecl::FileSized: from its file
+  double *Data = nullptr;          // plain: zeroed up front like the global; FROM: when mapped
+  int64_t Length = 0;
+  bool Owned = false;
+};
+
+// x86's cvttsd2si, what fptosi compiles to: INT64_MIN for NaN and anything out of range
+static int64_t fpToInt(double D) {
+return D >= -9223372036854775808.0 && D < 9223372036854775808.0 ? (int64_t)D : INT64_MIN;
+}
+
+//----------------------------------------------------------AST -> bytecode
+// Registers are numbered [variables][temporaries][constants]: variable slot s is register s,
+// temporaries are reused by every statement, constants (one per distinct value) are numbered
+// from ConstBase while compiling and moved behind the temporaries at the end.
+class BytecodeCompiler {
+public:
+  Compilation &C;
+  std::vector<Insn> Code;
+  std::vector<Cell> Regs;        // initial register file: zeros and the constants
+  std::vector<LoopInfo> Loops;
+  std::vector<LabelInfo> Labels;   // by label slot
+  std::vector<ArrayInfo> Arrays;   // by ENSEMBLE slot
+  std::vector<StringRef> Strings;
+  unsigned NumVars;
+  int32_t HaltPos = 0;
+  int ElementIndex = -1;   // register of the element a whole-ENSEMBLE assignment is at
+
+  explicit BytecodeCompiler(Compilation &C);
+  ~BytecodeCompiler();
+  void program(uint64_t HotThreshold);
+  void dump() const;
+
+  // for the nodes
+  int emit(Opcode Op, int A = 0, int B = 0, int Cc = 0);
+  BCValue constant(double V);
+  BCValue integer(int64_t V);
+  int temp();
+  BCValue toFloat(BCValue V);
+  BCValue toInt(BCValue V);
+  void store(int Slot, BCValue V);
+  int string(StringRef S);
+  void statements(const std::vector<ASTNode*> &Stmts);
+  void label(int Slot);
+  void jump(int Slot);
+  void branchIf(BCValue Cond, int Slot);
+  void loop(Repeat &R);
+  void declareArray(int Slot, StringRef Name, size_t Count, StringRef Path);
+  void assignElements(int Target, StringRef Name, const std::vector<int> &LengthChecks, ASTNode *RHS);
+  bool fileSized(int Slot) const { return Arrays[Slot].Count == ArrayDecl::FileSized; }
+
+private:
+  static const int ConstBase = 1 << 30;
+  int NextTemp, MaxTemp;
+  std::vector<Cell> Consts;
+  std::map<uint64_t, int> FloatConsts, IntConsts;   // bit pattern -> constant number
+  std::vector<std::pair<int32_t, int>> Fixups;      // instruction -> label slot its C jumps to
+  // labels defined in / jumped to from each REPEAT being compiled (innermost last)
+  struct LoopFrame { std::vector<int> Defined, Targets; };
+  std::vector<LoopFrame> Frames;
+  bool isConst(int Reg) const { return Reg >= ConstBase; }
+  const Cell &constValue(int Reg) const { return Consts[Reg - ConstBase]; }
+  bool isTemp(int Reg) const { return Reg >= (int)NumVars && Reg < ConstBase; }
+  void target(int Slot);
+};
+
+BytecodeCompiler::BytecodeCompiler(Compilation &C)
+  : C(C), NumVars(C.VarSlots.size()), NextTemp(NumVars), MaxTemp(NumVars) {
+Labels.resize(C.LabelNames.size());
+Arrays.resize(C.ArraySlots.size());
+}
+
+BytecodeCompiler::~BytecodeCompiler() {
+for (ArrayInfo &a : Arrays)
+  if (a.Owned)
+    free(a.Data);
+}
+
+int BytecodeCompiler::emit(Opcode Op, int A, int B, int Cc) {
+Code.push_back(Insn{ Op, A, B, Cc });
+return Code.size() - 1;
+}
+
+BCValue BytecodeCompiler::constant(double V) {
+uint64_t bits;
+memcpy(&bits, &V, sizeof bits);
+auto ins = FloatConsts.insert({ bits, (int)Consts.size() });
+if (ins.second) {
+  Cell c;
+  c.F = V;
+  Consts.push_back(c);
+}
+return BCValue{ ConstBase + ins.first->second, false };
+}
+
+BCValue BytecodeCompiler::integer(int64_t V) {
+auto ins = IntConsts.insert({ (uint64_t)V, (int)Consts.size() });
+if (ins.second) {
+  Cell c;
+  c.I = V;
+  Consts.push_back(c);
+}
+return BCValue{ ConstBase + ins.first->second, true };
+}
+
+int BytecodeCompiler::temp() {
+MaxTemp = std::max(MaxTemp, NextTemp + 1);
+return NextTemp++;
+}
+
+// the conversions of toDouble / toInt64 in ast.cpp; constants are converted right here
+BCValue BytecodeCompiler::toFloat(BCValue V) {
+if (!V.Int || V.Reg < 0) return V;
+if (isConst(V.Reg)) return constant((double)constValue(V.Reg).I);
+int t = temp();
+emit(OpIToF, t, V.Reg);
+return BCValue{ t, false };
+}
+
+BCValue BytecodeCompiler::toInt(BCValue V) {
+if (V.Int || V.Reg < 0) return V;
+if (isConst(V.Reg)) return integer(fpToInt(constValue(V.Reg).F));
+int t = temp();
+emit(OpFToI, t, V.Reg);
+return BCValue{ t, true };
+}
+
+// variable Slot = V, converted to the variable's type. When the last instruction computed V
+// into a temporary it writes the variable instead: `x = x + 1` is one AddI
+void BytecodeCompiler::store(int Slot, BCValue V) {
+if (Slot < 0 || V.Reg < 0) return;
+V = isIntegerVar(Slot) ? toInt(V) : toFloat(V);
+if (!Code.empty() && isTemp(V.Reg) && Code.back().A == V.Reg && (OpInfo[Code.back().Op].Operands & W)) {
+  Code.back().A = Slot;
+  return;
+}
+emit(OpMov, Slot, V.Reg);
+}
+
+int BytecodeCompiler::string(StringRef S) {
+Strings.push_back(C.Arena.intern(S));   // NUL-terminated for printf
+return Strings.size() - 1;
+}
+
+void BytecodeCompiler::statements(const std::vector<ASTNode*> &Stmts) {
+for (ASTNode *stmt : Stmts) {
+  NextTemp = NumVars;   // nothing lives in a temporary from one statement to the next
+  stmt->bytecode(*this);
+}
+}
+
+void BytecodeCompiler::target(int Slot) {
+Fixups.push_back({ (int32_t)Code.size() - 1, Slot });
+for (LoopFrame &f : Frames)
+  f.Targets.push_back(Slot);
+}
+
+void BytecodeCompiler::label(int Slot) {
+if (Slot < 0) return;
+Labels[Slot].Pos = Code.size();
+for (LoopFrame &f : Frames)
+  f.Defined.push_back(Slot);
+Labels[Slot].TopLevel = Frames.empty();
+emit(OpLabelHit, Slot);
+}
+
+void BytecodeCompiler::jump(int Slot) {
+if (Slot < 0) return;
+emit(OpJmp);
+target(Slot);
+}
+
+// SPIN: a comparison computed into a temporary just before becomes a compare-and-branch
+void BytecodeCompiler::branchIf(BCValue Cond, int Slot) {
+if (Slot < 0 || Cond.Reg < 0) return;
+Insn *last = Code.empty() ? nullptr : &Code.back();
+if (last && last->A == Cond.Reg && isTemp(Cond.Reg) &&
+    (last->Op == OpLtI || last->Op == OpGtI || last->Op == OpLtF || last->Op == OpGtF)) {
+  static const Opcode fused[] = { OpJLtI, OpJGtI, OpJLtF, OpJGtF };
+  *last = Insn{ fused[last->Op - OpLtI], last->B, last->C, 0 };
+} else {
+  emit(Cond.Int ? OpJNZ : OpJNZF, Cond.Reg);
+}
+target(Slot);
+}
+
+void BytecodeCompiler::loop(Repeat &R) {
+int id = Loops.size();
+LoopInfo info;
+info.Node = &R;
+info.Trip = R.trips();
+Loops.push_back(info);
+Frames.emplace_back();
+emit(OpLoopEnter, id);
+Loops[id].Body = Code.size();
+statements(R.Body);
+emit(OpLoopNext, id);
+Loops[id].Exit = Code.size();
+
+// a loop that jumps out of its body (or into another loop's) stays interpreted
+LoopFrame frame = std::move(Frames.back());
+Frames.pop_back();
+for (int t : frame.Targets)
+  Loops[id].Closed &= std::find(frame.Defined.begin(), frame.Defined.end(), t) != frame.Defined.end();
+}
+
+void BytecodeCompiler::declareArray(int Slot, StringRef Name, size_t Count, StringRef Path) {
+if (Slot < 0) return;
+ArrayInfo &a = Arrays[Slot];
+a.Name = Name;
+a.Path = Path;
+a.Count = Count;
+if (!Path.empty()) {   // mapped when the declaration runs
+  emit(OpMap, Slot, string(Path), Count == ArrayDecl::FileSized ? -1 : (int)Count);
+  return;
+}
+// like the zero-initialized global: there from the start, whether the declaration runs or not
+a.Data = static_cast<double*>(calloc(std::max<size_t>(Count, 1), sizeof(double)));
+if (!a.Data) {
+  fprintf(stderr, " %s: ENSEMBLE %.*s: out of memory\n", C.InputName.c_str(), (int)Name.size(), Name.data());
+  exit(1);
+}
+a.Length = Count;
+a.Owned = true;
+}
+
+// a = <expr> over every element, as in ast.cpp:
+//   n = len(a); i = 0; goto test;  body: a[i] = <expr at i>; i = i + 1;  test: if i < n goto body
+void BytecodeCompiler::assignElements(int Target, StringRef Name, const std::vector<int> &LengthChecks,
+                                      ASTNode *RHS) {
+for (int slot : LengthChecks)
+  emit(OpCheckLen, Target, slot, string(("assignment to " + Name).str()));
+int n = temp(), i = temp();
+emit(OpLen, n, Target);
+emit(OpMov, i, integer(0).Reg);
+int toTest = emit(OpJmp);
+int body = Code.size();
+ElementIndex = i;
+BCValue val = toFloat(RHS->bytecode(*this));
+ElementIndex = -1;
+if (val.Reg >= 0)
+  emit(OpStore, Target, i, val.Reg);
+emit(OpAddI, i, i, integer(1).Reg);
+Code[toTest].C = Code.size();
+emit(OpJLtI, i, n, body);
+}
+
+void BytecodeCompiler::program(uint64_t HotThreshold) {
+statements(*C.Program);
+HaltPos = emit(OpHalt);
+for (auto &fix : Fixups)
+  Code[fix.first].C = Labels[fix.second].Pos;
+uint64_t hot = HotThreshold ? HotThreshold : UINT64_MAX;
+for (LabelInfo &l : Labels)
+  l.HotAt = l.TopLevel ? hot : UINT64_MAX;
+for (LoopInfo &l : Loops)
+  l.HotAt = l.Node->Hints.Parallel ? 0 : l.Closed ? hot : UINT64_MAX;   // no threads in here
+
+// the constants go behind the temporaries
+int constStart = MaxTemp;
+for (Insn &insn : Code) {
+  unsigned ops = OpInfo[insn.Op].Operands;
+  if ((ops & RA) && isConst(insn.A)) insn.A += constStart - ConstBase;
+  if ((ops & RB) && isConst(insn.B)) insn.B += constStart - ConstBase;
+  if ((ops & RC) && isConst(insn.C)) insn.C += constStart - ConstBase;
+}
+Regs.assign(constStart + Consts.size(), Cell());
+std::copy(Consts.begin(), Consts.end(), Regs.begin() + constStart);
+}
+
+// -vv: the bytecode, registers as r<n>
+void BytecodeCompiler::dump() const {
+fprintf(stderr, " [interp] %zu instructions, %zu registers (%u variables)\n", Code.size(), Regs.size(), NumVars);
+for (size_t i = 0; i < Code.size(); ++i) {
+  const Insn &insn = Code[i];
+  unsigned ops = OpInfo[insn.Op].Operands;
+  fprintf(stderr, "  %5zu  %-9s %s%d %s%d %s%d\n", i, OpInfo[insn.Op].Name,
+          ops & RA ? "r" : "", insn.A, ops & RB ? "r" : "", insn.B, ops & RC ? "r" : "", insn.C);
+}
+}
+
+//----------------------------------------------------------the nodes
+BCValue NumberExpr::bytecode(BytecodeCompiler &B) {
+// exact integers as i64 constants: whatever uses them converts them as codegen would
+return isIntegral() ? B.integer((int64_t)Val) : B.constant(Val);
+}
+
+BCValue IntegerExpr::bytecode(BytecodeCompiler &B) { return B.integer(Val); }
+
+BCValue VariableExpr::bytecode(BytecodeCompiler &B) {
+if (ArraySlot >= 0) {   // whole-ENSEMBLE assignment: the element its loop is at
+  int t = B.temp();
+  B.emit(OpLoad, t, ArraySlot, B.ElementIndex);
+  return BCValue{ t, false };
+}
+return BCValue{ Slot, isIntegerVar(Slot) };
+}
+
+BCValue VarDecl::bytecode(BytecodeCompiler &B) {
+B.store(Slot, Init->bytecode(B));
+return BCValue();
+}
+
+BCValue EchoStr::bytecode(BytecodeCompiler &B) {
+B.emit(OpEchoStr, B.string(Str));
+return BCValue();
+}
+
+BCValue EchoVar::bytecode(BytecodeCompiler &B) {
+if (Slot >= 0)
+  B.emit(OpEchoF, B.toFloat(BCValue{ Slot, isIntegerVar(Slot) }).Reg);
+return BCValue();
+}
+
+BCValue Label::bytecode(BytecodeCompiler &B) { B.label(Slot); return BCValue(); }
+BCValue Jump::bytecode(BytecodeCompiler &B) { B.jump(Slot); return BCValue(); }
+
+BCValue BinaryExpr::bytecode(BytecodeCompiler &B) {
+BCValue l = Left->bytecode(B), r = Right->bytecode(B);
+if (l.Reg < 0 || r.Reg < 0) return BCValue();
+bool integral = isIntegral();
+l = integral ? B.toInt(l) : B.toFloat(l);
+r = integral ? B.toInt(r) : B.toFloat(r);
+Opcode op;
+switch (Op) {
+case '+': op = integral ? OpAddI : OpAddF; break;
+case '-': op = integral ? OpSubI : OpSubF; break;
+case '*': op = integral ? OpMulI : OpMulF; break;
+case '/': op = OpDivF; break;
+default:  return BCValue();
+}
+int t = B.temp();
+B.emit(op, t, l.Reg, r.Reg);
+return BCValue{ t, integral };
+}
+
+BCValue Assign::bytecode(BytecodeCompiler &B) {
+if (ArraySlot >= 0)
+  B.assignElements(ArraySlot, LHS, LengthChecks, RHS);
+else
+  B.store(Slot, RHS->bytecode(B));
+return BCValue();
+}
+
+BCValue ComparisonExpr::bytecode(BytecodeCompiler &B) {
+BCValue l = Left->bytecode(B), r = Right->bytecode(B);
+if (l.Reg < 0 || r.Reg < 0) return BCValue();
+bool integral = Left->isIntegral() && Right->isIntegral();
+l = integral ? B.toInt(l) : B.toFloat(l);
+r = integral ? B.toInt(r) : B.toFloat(r);
+int t = B.temp();
+B.emit(Op == "<" ? (integral ? OpLtI : OpLtF) : (integral ? OpGtI : OpGtF), t, l.Reg, r.Reg);
+return BCValue{ t, true };
+}
+
+BCValue IfStmt::bytecode(BytecodeCompiler &B) {
+B.branchIf(Cond->bytecode(B), Slot);
+return BCValue();
+}
+
+BCValue Repeat::bytecode(BytecodeCompiler &B) { B.loop(*this); return BCValue(); }
+
+BCValue ArrayDecl::bytecode(BytecodeCompiler &B) {
+B.declareArray(Slot, Name, Count, Path);
+return BCValue();
+}
+
+BCValue SaveArray::bytecode(BytecodeCompiler &B) {
+if (Slot >= 0)
+  B.emit(OpSave, Slot, B.string(Path));
+return BCValue();
+}
+
+BCValue IndexExpr::bytecode(BytecodeCompiler &B) {
+BCValue idx = B.toInt(Idx->bytecode(B));
+if (Slot < 0 || idx.Reg < 0) return BCValue();
+int t = B.temp();
+B.emit(OpLoad, t, Slot, idx.Reg);
+return BCValue{ t, false };
+}
+
+BCValue ReduceExpr::bytecode(BytecodeCompiler &B) {
+if (Slot < 0 || (Op == Dot && Slot2 < 0)) return BCValue();
+int t = B.temp();
+if (Op != Dot) {
+  B.emit(OpReduce, t, Slot, Op);
+  return BCValue{ t, false };
+}
+// the resolver compared the sizes it knew; one from a file is compared when it runs
+if (B.fileSized(Slot) || B.fileSized(Slot2))
+  B.emit(OpCheckLen, Slot, Slot2, B.string(("DOT(" + Name + ", " + Name2 + ")").str()));
+B.emit(OpDot, t, Slot, Slot2);
+return BCValue{ t, false };
+}
+
+BCValue StoreToIndex::bytecode(BytecodeCompiler &B) {
+BCValue idx = B.toInt(Idx->bytecode(B));
+BCValue val = B.toFloat(RHS->bytecode(B));
+if (Slot >= 0 && idx.Reg >= 0 && val.Reg >= 0)
+  B.emit(OpStore, Slot, idx.Reg, val.Reg);
+return BCValue();
+}
+
+BCValue EchoIndexedVar::bytecode(BytecodeCompiler &B) {
+BCValue idx = B.toInt(Idx->bytecode(B));
+if (Slot < 0 || idx.Reg < 0) return BCValue();
+int t = B.temp();
+B.emit(OpLoad, t, Slot, idx.Reg);
+B.emit(OpEchoF, t);
+return BCValue();
+}
+
+//----------------------------------------------------------the interpreter
+class Interpreter {
+  Compilation &C;
+  BytecodeCompiler &P;
+  const InterpOptions &Opts;
+  InterpTimings &Timings;
+  std::unique_ptr<TierJIT> JIT;
+  std::unique_ptr<TargetMachine> TM;
+public:
+  Interpreter(Compilation &C, BytecodeCompiler &P, const InterpOptions &Opts, InterpTimings &Timings)
+    : C(C), P(P), Opts(Opts), Timings(Timings) {}
+  void run();
+  bool tierUp(LoopInfo &L, int Id);
+  bool tierUp(LabelInfo &L, int Slot);
+private:
+  NativeRegion compileRegion(Repeat *Loop, int LabelSlot, const std::string &Name, double &CompileMs);
+};
+
+// Threaded dispatch: every handler ends in its own indirect jump to the next one (GNU computed
+// goto), so the branch predictor sees one jump per opcode instead of one shared switch.
+void Interpreter::run() {
+#define OPCODE_LABEL(Name, Operands) &&L##Name,
+static const void *const Handlers[] = { CHOREO_OPCODES(OPCODE_LABEL) };
+#undef OPCODE_LABEL
+const Insn *code = P.Code.data(), *ip = code;
+Cell *R = P.Regs.data();
+bool printfEcho = EchoMode == EchoLowering::Printf;
+#define NEXT() goto *Handlers[(++ip)->Op]
+#define JUMP(Target) do { ip = code + (Target); goto *Handlers[ip->Op]; } while (0)
+goto *Handlers[ip->Op];
+
+LHalt:
+  return;
+LMov:  R[ip->A] = R[ip->B]; NEXT();
+LIToF: R[ip->A].F = (double)R[ip->B].I; NEXT();
+LFToI: R[ip->A].I = fpToInt(R[ip->B].F); NEXT();
+// integer operands only where inferIntegerVariables proved the result below 2^53: never wraps
+LAddI: R[ip->A].I = (int64_t)((uint64_t)R[ip->B].I + (uint64_t)R[ip->C].I); NEXT();
+LSubI: R[ip->A].I = (int64_t)((uint64_t)R[ip->B].I - (uint64_t)R[ip->C].I); NEXT();
+LMulI: R[ip->A].I = (int64_t)((uint64_t)R[ip->B].I * (uint64_t)R[ip->C].I); NEXT();
+LAddF: R[ip->A].F = R[ip->B].F + R[ip->C].F; NEXT();
+LSubF: R[ip->A].F = R[ip->B].F - R[ip->C].F; NEXT();
+LMulF: R[ip->A].F = R[ip->B].F * R[ip->C].F; NEXT();
+LDivF: R[ip->A].F = R[ip->B].F / R[ip->C].F; NEXT();
+LLtI:  R[ip->A].I = R[ip->B].I < R[ip->C].I; NEXT();
+LGtI:  R[ip->A].I = R[ip->B].I > R[ip->C].I; NEXT();
+LLtF:  R[ip->A].I = !(R[ip->B].F >= R[ip->C].F); NEXT();
+LGtF:  R[ip->A].I = !(R[ip->B].F <= R[ip->C].F); NEXT();
+LJmp:  JUMP(ip->C);
+LJNZ:  if (R[ip->A].I) JUMP(ip->C); NEXT();
+LJNZF: if (R[ip->A].F != 0) JUMP(ip->C); NEXT();
+LJLtI: if (R[ip->A].I < R[ip->B].I) JUMP(ip->C); NEXT();
+LJGtI: if (R[ip->A].I > R[ip->B].I) JUMP(ip->C); NEXT();
+LJLtF: if (!(R[ip->A].F >= R[ip->B].F)) JUMP(ip->C); NEXT();
+LJGtF: if (!(R[ip->A].F <= R[ip->B].F)) JUMP(ip->C); NEXT();
+LLoopEnter: {
+  LoopInfo &L = P.Loops[ip->A];
+  if (L.Native || (L.Iterations >= L.HotAt && tierUp(L, ip->A))) {
+    L.Native(R, 0);
+    JUMP(L.Exit);
+  }
+  L.Counter = 0;
+  if (L.Trip <= 0) JUMP(L.Exit);
+  NEXT();
+}
+LLoopNext: {
+  LoopInfo &L = P.Loops[ip->A];
+  ++L.Iterations;
+  if (++L.Counter >= L.Trip) NEXT();
+  if (L.Iterations >= L.HotAt && tierUp(L, ip->A)) {   // the rest of this run natively
+    L.NativeFrom = L.Counter;
+    L.Native(R, L.Counter);
+    JUMP(L.Exit);
+  }
+  JUMP(L.Body);
+}
+LLabelHit: {
+  LabelInfo &L = P.Labels[ip->A];
+  if (++L.Visits >= L.HotAt && tierUp(L, ip->A)) {   // runs to EXIT
+    L.Native(R, 0);
+    JUMP(P.HaltPos);
+  }
+  NEXT();
+}
+LEchoStr: {
+  StringRef s = P.Strings[ip->A];
+  if (printfEcho)
+    printf("%s\n", s.data());
+  else
+    choreo_echo_str(s.data(), s.size());
+  NEXT();
+}
+LEchoF:
+  if (printfEcho)
+    printf("%f\n", R[ip->A].F);
+  else
+    choreo_echo_f64(R[ip->A].F);
+  NEXT();
+LLoad:  R[ip->A].F = P.Arrays[ip->B].Data[R[ip->C].I]; NEXT();
+LStore: P.Arrays[ip->A].Data[R[ip->B].I] = R[ip->C].F; NEXT();
+LLen:   R[ip->A].I = P.Arrays[ip->B].Length; NEXT();
+LReduce: {
+  const ArrayInfo &a = P.Arrays[ip->B];
+  static double (*const kernels[])(const double*, int64_t) = { choreo_sum_f64, choreo_min_f64, choreo_max_f64 };
+  R[ip->A].F = kernels[ip->C](a.Data, a.Length);
+  NEXT();
+}
+LDot:
+  R[ip->A].F = choreo_dot_f64(P.Arrays[ip->B].Data, P.Arrays[ip->C].Data, P.Arrays[ip->B].Length);
+  NEXT();
+LCheckLen:
+  choreo_check_length(P.Arrays[ip->A].Length, P.Arrays[ip->B].Length, P.Strings[ip->C].data());
+  NEXT();
+LMap: {
+  ArrayInfo &a = P.Arrays[ip->A];
+  a.Data = choreo_map_f64(P.Strings[ip->B].data(), ip->C, &a.Length);
+  NEXT();
+}
+LSave: {
+  const ArrayInfo &a = P.Arrays[ip->A];
+  choreo_save_f64(P.Strings[ip->B].data(), a.Data, a.Length);
+  NEXT();
+}
+#undef NEXT
+#undef JUMP
+}
+
+bool Interpreter::tierUp(LoopInfo &L, int Id) {
+L.Native = compileRegion(L.Node, -1, "choreo.loop." + std::to_string(Id), L.CompileMs);
+L.HotAt = UINT64_MAX;   // once, whatever came of it
+return L.Native;
+}
+
+bool Interpreter::tierUp(LabelInfo &L, int Slot) {
+L.Native = compileRegion(nullptr, Slot, ("choreo.label." + C.LabelNames[Slot]).str(), L.CompileMs);
+L.HotAt = UINT64_MAX;
+return L.Native;
+}
+
+// A region as `void Name(i8* cells, i64 start)` in a module of its own, made by the AST's own
+// codegen: a stack slot per variable, loaded from its cell on entry and stored back at the end,
+// and every ENSEMBLE a constant pointer to the interpreter's buffer. A loop runs from iteration
+// `start`; a label region is the whole program entered at that label.
+NativeRegion Interpreter::compileRegion(Repeat *Loop, int LabelSlot, const std::string &Name, double &CompileMs) {
+PhaseTimer timer;
+if (!JIT)   // the first hot region is what initializes LLVM's JIT at all
+  JIT.reset(new TierJIT());
+if (!TM)
+  TM = createTargetMachine(Opts.CPU, Opts.OptLevel);
+
+auto Ctx = std::make_unique<LLVMContext>();
+auto M = std::make_unique<Module>("choreo.tier", *Ctx);
+IRBuilder<> Builder(*Ctx);
+Builder.setFastMathFlags(ProgramFastMath);
+Type *i64 = Builder.getInt64Ty(), *f64 = Builder.getDoubleTy();
+Function *F = Function::Create(FunctionType::get(Builder.getVoidTy(), { Builder.getInt8PtrTy(), i64 }, false),
+                               Function::ExternalLinkage, Name, M.get());
+F->addFnAttr(Attribute::NoUnwind);
+Value *cells = F->getArg(0), *start = F->getArg(1);
+cells->setName("cells");
+start->setName("start");
+BasicBlock *entryBB = BasicBlock::Create(*Ctx, "entry", F);
+Builder.SetInsertPoint(entryBB);
+
+// codegen state of this module only (a module of an earlier region may sit at the same address)
+C.Constants = ModuleConstants();
+C.LabelSlots.assign(C.LabelNames.size(), nullptr);
+for (unsigned s = 0; s < P.NumVars; ++s)
+  C.VarSlots[s] = Builder.CreateAlloca(isIntegerVar(s) ? i64 : f64, nullptr, "var" + Twine(s));
+PointerType *dataTy = f64->getPointerTo();
+for (size_t a = 0; a < P.Arrays.size(); ++a) {
+  const ArrayInfo &arr = P.Arrays[a];
+  C.ArraySlots[a] = nullptr;   // FROM not run yet: the region maps it itself
+  C.ArrayLengths[a] = nullptr;
+  if (!arr.Data)
+    continue;
+  Constant *data = ConstantExpr::getIntToPtr(Builder.getInt64((uint64_t)(uintptr_t)arr.Data), dataTy);
+  C.ArraySlots[a] = new GlobalVariable(*M, dataTy, /*isConstant=*/true, GlobalValue::PrivateLinkage, data, arr.Name);
+  C.ArrayLengths[a] = Builder.getInt64(arr.Length);
+}
+
+BasicBlock *bodyBB = BasicBlock::Create(*Ctx, Loop ? "region" : "before", F);
+if (Loop) {
+  Builder.CreateBr(bodyBB);
+  Builder.SetInsertPoint(bodyBB);
+  if (!Loop->Hints.Parallel)   // those only ever start at 0
+    C.RepeatStart = start;
+  Loop->codegen(*Ctx, Builder, M.get());
+  C.RepeatStart = nullptr;
+} else {
+  createLabelBlocks(C, F);
+  Builder.CreateBr(C.LabelSlots[LabelSlot]);
+  Builder.SetInsertPoint(bodyBB);   // what comes before the label: only reached by a jump back
+  for (ASTNode *stmt : *C.Program)
+    stmt->codegen(*Ctx, Builder, M.get());
+}
+
+// only the variables the region uses go in and out
+Instruction *enter = entryBB->getTerminator();
+for (unsigned s = 0; s < P.NumVars; ++s) {
+  AllocaInst *slot = C.VarSlots[s];
+  if (slot->use_empty()) {
+    slot->eraseFromParent();
+    continue;
+  }
+  Type *ty = slot->getAllocatedType();
+  IRBuilder<> in(enter);
+  in.CreateStore(in.CreateLoad(ty, in.CreateBitCast(in.CreateConstInBoundsGEP1_64(in.getInt8Ty(), cells, s * 8),
+                                                    ty->getPointerTo())), slot);
+  Builder.CreateStore(Builder.CreateLoad(ty, slot),
+                      Builder.CreateBitCast(Builder.CreateConstInBoundsGEP1_64(Builder.getInt8Ty(), cells, s * 8),
+                                            ty->getPointerTo()));
+}
+Builder.CreateRetVoid();
+
+NativeRegion native = nullptr;
+if (verifyModule(*M, &errs())) {
+  fprintf(stderr, " [interp] %s: generated IR is broken, staying interpreted\n", Name.c_str());
+} else {
+  if (TM) {
+    M->setTargetTriple(TM->getTargetTriple().str());
+    M->setDataLayout(TM->createDataLayout());
+  }
+  optimizeModule(*M, Opts.OptLevel, TM.get());
+  native = reinterpret_cast<NativeRegion>(JIT->compile(std::move(M), std::move(Ctx), Name));
+}
+CompileMs = timer.wallMs();
+Timings.tierUpMs += CompileMs;
+Timings.tierUpCpuMs += timer.cpuMs();
+if (Verbosity >= 1)
+  fprintf(stderr, " [interp] %s: %s in %.3f ms\n", Name.c_str(), native ? "native" : "failed", CompileMs);
+return native;
+}
+
+//----------------------------------------------------------entry point
+int interpretProgram(Compilation &C, const InterpOptions &Opts, InterpTimings &Timings) {
+PhaseTimer timer;
+BytecodeCompiler program(C);
+program.program(Opts.HotThreshold);
+Timings.bytecodeMs = timer.wallMs();
+Timings.bytecodeCpuMs = timer.cpuMs();
+if (Verbosity >= 2)
+  program.dump();
+
+timer.restart();
+// non-default output buffering, as the generated main sets it up
+if (EchoMode == EchoLowering::Runtime && (Opts.EchoBuffer > 0 || Opts.EchoLineMode >= 0))
+  choreo_echo_init(Opts.EchoBuffer, Opts.EchoLineMode);
+Interpreter interp(C, program, Opts, Timings);
+interp.run();
+choreo_echo_flush();
+fflush(stdout);
+Timings.executeMs = timer.wallMs() - Timings.tierUpMs;
+Timings.executeCpuMs = timer.cpuMs() - Timings.tierUpCpuMs;
+
+if (Verbosity >= 1) {
+  for (size_t l = 0; l < program.Loops.size(); ++l) {
+    const LoopInfo &L = program.Loops[l];
+    fprintf(stderr, " [interp] loop %zu (REPEAT %" PRId64 "): %" PRIu64 " iterations interpreted", l, L.Trip, L.Iterations);
+    if (L.Native)
+      fprintf(stderr, ", native from iteration %" PRId64, std::max<int64_t>(L.NativeFrom, 0));
+    fprintf(stderr, "\n");
+  }
+  for (size_t l = 0; l < program.Labels.size(); ++l)
+    fprintf(stderr, " [interp] label %s: %" PRIu64 " visits%s\n", C.LabelNames[l].str().c_str(),
+            program.Labels[l].Visits, program.Labels[l].Native ? ", native from there on" : "");
+}
+return 0;
+}
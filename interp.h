@@ -0,0 +1,38 @@
+// interp.h
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct Compilation;
+
+// --interp: run a script without building a module for it first. The resolved and typed
+// C.Program is compiled into a register bytecode (one 8-byte cell per variable, temporary and
+// constant, i64 or double as integer inference decided) and run by a threaded interpreter,
+// so a short script never pays for LLVM's pipeline and JIT.
+// Every REPEAT counts its iterations and every label its visits. Once one reaches
+// HotThreshold the region goes to LLVM and runs natively from then on:
+//   REPEAT  a function running its iterations from a given one, called with the iteration the
+//           interpreter is at and on every later entry of the loop (not for loops with a
+//           MOVE TO / SPIN out of their body, which stay interpreted)
+//   label   (top level only) the whole program as a function entered at that label, which
+//           runs to EXIT: the rest of the script is native
+// Both work on the interpreter's cells and ENSEMBLE buffers directly. PARALLEL loops are
+// always compiled on entry: the interpreter has no threads.
+struct InterpOptions {
+  uint64_t HotThreshold = 10000;   // --tier-up=<n>; 0: never (PARALLEL loops aside)
+  unsigned OptLevel = 0;           // -O of the compiled regions
+  std::string CPU;                 // -march
+  long long EchoBuffer = 0;        // --echo-buffer / --echo-mode, as beginMain
+  int EchoLineMode = -1;
+};
+
+struct InterpTimings {
+  double bytecodeMs = 0, bytecodeCpuMs = 0;   // AST -> bytecode
+  double tierUpMs = 0, tierUpCpuMs = 0;       // codegen + -O + JIT of the hot regions
+  double executeMs = 0, executeCpuMs = 0;     // interpreter and native code, without tierUp
+};
+
+// Runs C.Program (after resolveNames / inferIntegerVariables, inside a CompilationScope);
+// returns the exit status like the generated main would
+int interpretProgram(Compilation &C, const InterpOptions &Opts, InterpTimings &Timings);
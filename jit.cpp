@@ -0,0 +1,140 @@
+#include "jit.h"
+#include "runtime/choreo_rt.h"
+#include "stats.h"
+#include <cstdio>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/raw_ostream.h>
+using namespace llvm;
+using namespace llvm::orc;
+
+// runtime/ functions the generated code may call; the driver has them linked in,
+// so they are handed to the JIT by address instead of being looked up in a library
+static const struct { const char *Name; void *Addr; } RuntimeSymbols[] = {
+  { "choreo_echo_init",  (void*)&choreo_echo_init },
+  { "choreo_echo_str",   (void*)&choreo_echo_str },
+  { "choreo_echo_f64",   (void*)&choreo_echo_f64 },
+  { "choreo_echo_flush", (void*)&choreo_echo_flush },
+  { "choreo_sum_f64",    (void*)&choreo_sum_f64 },
+  { "choreo_min_f64",    (void*)&choreo_min_f64 },
+  { "choreo_max_f64",    (void*)&choreo_max_f64 },
+  { "choreo_dot_f64",    (void*)&choreo_dot_f64 },
+  { "choreo_parallel_for", (void*)&choreo_parallel_for },
+  { "choreo_map_f64",    (void*)&choreo_map_f64 },
+  { "choreo_save_f64",   (void*)&choreo_save_f64 },
+  { "choreo_check_length", (void*)&choreo_check_length },
+  { "choreo_profile_write", (void*)&choreo_profile_write },
+};
+
+//----------------------------------------------------------an LLJIT that resolves host + runtime symbols
+static std::unique_ptr<LLJIT> createJIT() {
+InitializeNativeTarget();
+InitializeNativeTargetAsmPrinter();
+
+auto jitOrErr = LLJITBuilder().create();
+if (!jitOrErr) {
+  logAllUnhandledErrors(jitOrErr.takeError(), errs(), "[jit] ");
+  return nullptr;
+}
+std::unique_ptr<LLJIT> J = std::move(*jitOrErr);
+
+// let the generated code call printf & co. straight out of our own process
+auto hostGen = DynamicLibrarySearchGenerator::GetForCurrentProcess(
+  J->getDataLayout().getGlobalPrefix());
+if (!hostGen) {
+  logAllUnhandledErrors(hostGen.takeError(), errs(), "[jit] ");
+  return nullptr;
+}
+J->getMainJITDylib().addGenerator(std::move(*hostGen));
+
+SymbolMap runtimeSyms;
+for (auto &sym : RuntimeSymbols)
+  runtimeSyms[J->mangleAndIntern(sym.Name)] = JITEvaluatedSymbol(
+    pointerToJITTargetAddress(sym.Addr), JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+if (Error err = J->getMainJITDylib().define(absoluteSymbols(std::move(runtimeSyms)))) {
+  logAllUnhandledErrors(std::move(err), errs(), "[jit] ");
+  return nullptr;
+}
+return J;
+}
+
+//----------------------------------------------------------look main up (materializing it) and call it
+static int runMain(LLJIT &J, PhaseTimer &timer, JITTimings &Timings) {
+// looking main up is what actually triggers codegen of the module
+auto mainSym = J.lookup("main");
+if (!mainSym) {
+  logAllUnhandledErrors(mainSym.takeError(), errs(), "[jit] ");
+  return -1;
+}
+auto *mainFn = jitTargetAddressToFunction<int (*)()>(mainSym->getAddress());
+Timings.compileMs = timer.wallMs();
+Timings.compileCpuMs = timer.cpuMs();
+
+timer.restart();
+int ret = mainFn();
+fflush(stdout);
+Timings.executeMs = timer.wallMs();
+Timings.executeCpuMs = timer.cpuMs();
+return ret;
+}
+
+//----------------------------------------------------------JIT the module and call main() in this process
+int runModuleJIT(std::unique_ptr<Module> M,
+                 std::unique_ptr<LLVMContext> Ctx,
+                 JITTimings &Timings) {
+PhaseTimer timer;
+std::unique_ptr<LLJIT> J = createJIT();
+if (!J)
+  return -1;
+
+M->setDataLayout(J->getDataLayout());
+if (Error err = J->addIRModule(ThreadSafeModule(std::move(M), std::move(Ctx)))) {
+  logAllUnhandledErrors(std::move(err), errs(), "[jit] ");
+  return -1;
+}
+return runMain(*J, timer, Timings);
+}
+
+//----------------------------------------------------------link an already compiled object and call its main()
+int runObjectJIT(std::unique_ptr<MemoryBuffer> Object, JITTimings &Timings) {
+std::vector<std::unique_ptr<MemoryBuffer>> objects;
+objects.push_back(std::move(Object));
+return runObjectJIT(std::move(objects), Timings);
+}
+
+int runObjectJIT(std::vector<std::unique_ptr<MemoryBuffer>> Objects, JITTimings &Timings) {
+PhaseTimer timer;
+std::unique_ptr<LLJIT> J = createJIT();
+if (!J)
+  return -1;
+
+for (std::unique_ptr<MemoryBuffer> &object : Objects)
+  if (Error err = J->addObjectFile(std::move(object))) {
+    logAllUnhandledErrors(std::move(err), errs(), "[jit] ");
+    return -1;
+  }
+return runMain(*J, timer, Timings);
+}
+
+//----------------------------------------------------------TierJIT
+TierJIT::TierJIT() : J(createJIT()) {}
+TierJIT::~TierJIT() = default;
+
+void *TierJIT::compile(std::unique_ptr<Module> M, std::unique_ptr<LLVMContext> Ctx, StringRef Name) {
+if (!J)
+  return nullptr;
+M->setDataLayout(J->getDataLayout());
+if (Error err = J->addIRModule(ThreadSafeModule(std::move(M), std::move(Ctx)))) {
+  logAllUnhandledErrors(std::move(err), errs(), "[jit] ");
+  return nullptr;
+}
+auto sym = J->lookup(Name);
+if (!sym) {
+  logAllUnhandledErrors(sym.takeError(), errs(), "[jit] ");
+  return nullptr;
+}
+return jitTargetAddressToPointer<void*>(sym->getAddress());
+}
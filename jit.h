@@ -0,0 +1,40 @@
+// jit.h
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace llvm { namespace orc { class LLJIT; } }
+
+// Milliseconds spent in each JIT phase (wall clock, and CPU time of the calling thread)
+struct JITTimings {
+  double compileMs = 0, compileCpuMs = 0;   // adding the module + materializing main
+  double executeMs = 0, executeCpuMs = 0;   // running the generated main
+};
+
+// Hand the module to an in-process ORC LLJIT and call its `main`.
+// Host symbols (printf, ...) are resolved from the running process.
+// Returns main's return value, or -1 if the module could not be JIT-compiled.
+int runModuleJIT(std::unique_ptr<llvm::Module> M,
+                 std::unique_ptr<llvm::LLVMContext> Ctx,
+                 JITTimings &Timings);
+
+// Same for a native object of such a module (a --cache entry): no IR, only linking.
+int runObjectJIT(std::unique_ptr<llvm::MemoryBuffer> Object, JITTimings &Timings);
+// ... or for the objects of its partitions (--split with -j), linked with each other.
+int runObjectJIT(std::vector<std::unique_ptr<llvm::MemoryBuffer>> Objects, JITTimings &Timings);
+
+// A JIT that keeps what it compiled: modules are added one at a time and their functions stay
+// callable until it is destroyed (the hot regions of --interp). Same symbols as above.
+class TierJIT {
+  std::unique_ptr<llvm::orc::LLJIT> J;
+public:
+  TierJIT();
+  ~TierJIT();
+  // adds M and returns the address of its function Name; null after reporting why not
+  void *compile(std::unique_ptr<llvm::Module> M, std::unique_ptr<llvm::LLVMContext> Ctx,
+                llvm::StringRef Name);
+};
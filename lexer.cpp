@@ -0,0 +1,169 @@
+#include "lexer.h"
+#include "compilation.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+using namespace llvm;
+
+// the reentrant flex interface (lex.yy.c)
+typedef void* yyscan_t;
+int   yylex(YYSTYPE *yylval_param, yyscan_t yyscanner);
+int   yylex_init_extra(Compilation *user_defined, yyscan_t *scanner);
+int   yylex_destroy(yyscan_t yyscanner);
+void  yyset_in(FILE *in_str, yyscan_t yyscanner);
+int   yyget_lineno(yyscan_t yyscanner);
+char* yyget_text(yyscan_t yyscanner);
+
+//----------------------------------------------------------number literals
+// All the digits go into one integer and the '.' into a power of ten. Up to 19 digits fit a
+// uint64; a whole number converts with a single rounding, and a fraction whose digits stay
+// below 2^53 is an exact double divided by an exact power of ten (10^22 at most), which IEEE
+// division rounds correctly (Clinger's fast path). Longer literals go to strtod.
+double parseNumberLiteral(const char *Begin, const char *End) {
+static const double Pow10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+uint64_t mantissa = 0;
+int digits = 0, fraction = 0;
+bool inFraction = false;
+for (const char *p = Begin; p != End; ++p) {
+  if (*p == '.') {
+    inFraction = true;
+    continue;
+  }
+  mantissa = mantissa * 10 + (*p - '0');
+  digits += mantissa != 0;   // leading zeros do not count
+  fraction += inFraction;
+  if (digits > 19)
+    goto slow;
+}
+if (!fraction)
+  return (double)mantissa;
+if (mantissa <= (uint64_t(1) << 53) && fraction <= 22)
+  return (double)mantissa / Pow10[fraction];
+slow:
+std::string text(Begin, End);
+return strtod(text.c_str(), nullptr);
+}
+
+//----------------------------------------------------------Scanner
+static inline bool isDecimal(char c) { return c >= '0' && c <= '9'; }
+static inline bool isNameStart(char c) { return (unsigned char)((c | 0x20) - 'a') < 26 || c == '_'; }
+static inline bool isNameChar(char c) { return isNameStart(c) || isDecimal(c); }
+
+// the reserved words of choreo1.l ("MOVE TO" is handled on its own)
+static int keyword(StringRef Word) {
+static const struct { StringRef Text; int Token; } words[] = {
+  { "REPEAT", tok_REPEAT },     { "TIMES", tok_TIMES },       { "ENDREPEAT", tok_ENDREPEAT },
+  { "UNROLL", tok_UNROLL },     { "VECTORIZE", tok_VECTORIZE }, { "FASTMATH", tok_FASTMATH },
+  { "PARALLEL", tok_PARALLEL }, { "SPIN", tok_SPIN },         { "THEN", tok_THEN },
+  { "ENSEMBLE", tok_ENSEMBLE }, { "SUM", tok_SUM },           { "MIN", tok_MIN },
+  { "MAX", tok_MAX },           { "DOT", tok_DOT },           { "FROM", tok_FROM },
+  { "SAVE", tok_SAVE },         { "TO", tok_TO },             { "ECCO_D", tok_ecco_d },
+  { "ECCO", tok_ecco },         { "ENTER", tok_ENTER },       { "EXIT", tok_EXIT },
+};
+if (Word.size() < 2 || Word.size() > 9 || Word[0] < 'A' || Word[0] > 'Z')
+  return 0;
+for (const auto &w : words)
+  if (w.Text == Word)
+    return w.Token;
+return 0;
+}
+
+Scanner::Scanner(Compilation &C, StringRef Source, bool UseFlex)
+  : C(C), Cur(Source.begin()), End(Source.end()), TokStart(Source.begin()) {
+if (!UseFlex)
+  return;
+// fmemopen does not take an empty buffer
+FlexIn = Source.empty() ? fopen("/dev/null", "r") : fmemopen(const_cast<char*>(Source.data()), Source.size(), "r");
+if (!FlexIn)
+  perror("fmemopen");
+yylex_init_extra(&C, &Flex);
+yyset_in(FlexIn, Flex);
+}
+
+Scanner::~Scanner() {
+if (Flex)
+  yylex_destroy(Flex);
+if (FlexIn)
+  fclose(FlexIn);
+}
+
+int Scanner::lex(YYSTYPE *Value) {
+if (!Flex)
+  return lexSource(Value);
+return FlexIn ? yylex(Value, Flex) : 0;
+}
+
+int Scanner::line() const { return Flex ? yyget_lineno(Flex) : Line; }
+
+StringRef Scanner::text() const { return Flex ? StringRef(yyget_text(Flex)) : StringRef(TokStart, Cur - TokStart); }
+
+// the rules of choreo1.l, longest match first
+int Scanner::lexSource(YYSTYPE *Value) {
+for (;;) {
+  while (Cur != End && (*Cur == ' ' || *Cur == '\t'))
+    ++Cur;
+  TokStart = Cur;
+  if (Cur == End)
+    return 0;
+  char c = *Cur++;
+  switch (c) {
+  case '\n': ++Line; continue;
+  case '(': return tok_lparen;
+  case ')': return tok_rparen;
+  case ',': return tok_comma;
+  case ':': return tok_colon;
+  case '[': return tok_lbracket;
+  case ']': return tok_rbracket;
+  case '<': return tok_less;
+  case '>': return tok_greater;
+  case '+': case '-': case '*': case '/': case ';': case '=':
+    return c;
+  case '"': {
+    const char *close = static_cast<const char*>(memchr(Cur, '"', End - Cur));
+    if (!close)
+      break;   // no closing quote: the quote itself is unexpected
+    Line += std::count(Cur, close, '\n');
+    Value->string_literal = C.Arena.intern(StringRef(Cur, close - Cur)).data();   // without the quotes
+    Cur = close + 1;
+    return tok_string_literal;
+  }
+  default:
+    if (isDecimal(c)) {
+      while (Cur != End && isDecimal(*Cur))
+        ++Cur;
+      if (End - Cur >= 2 && *Cur == '.' && isDecimal(Cur[1])) {
+        Cur += 2;
+        while (Cur != End && isDecimal(*Cur))
+          ++Cur;
+      }
+      Value->double_literal = parseNumberLiteral(TokStart, Cur);
+      return tok_double_literal;
+    }
+    if (isNameStart(c)) {
+      while (Cur != End && isNameChar(*Cur))
+        ++Cur;
+      StringRef word(TokStart, Cur - TokStart);
+      if (Cur != End && *Cur == ':') {   // label: the name without the colon
+        ++Cur;
+        Value->identifier = C.Arena.intern(word).data();
+        return tok_label;
+      }
+      if (word == "MOVE" && End - Cur >= 3 && !memcmp(Cur, " TO", 3)) {
+        Cur += 3;
+        return tok_moveto;
+      }
+      if (int token = keyword(word))
+        return token;
+      Value->identifier = C.Arena.intern(word).data();
+      return tok_identifier;
+    }
+  }
+  fprintf(stderr, "%s: Unexpected `%c` on line %d\n", C.InputName.c_str(), c, Line);
+  ++C.Errors;
+  return tok_invalid;   // the parser reports it and gives up on this file
+}
+}
@@ -0,0 +1,37 @@
+// lexer.h
+#pragma once
+
+#include <cstdio>
+#include "llvm/ADT/StringRef.h"
+#include "choreo1.tab.h"   // YYSTYPE and the token numbers
+
+struct Compilation;
+
+// [0-9]+(\.[0-9]+)? rounded exactly like strtod, straight from the source text (no NUL needed)
+double parseNumberLiteral(const char *Begin, const char *End);
+
+// What the parser reads its tokens from. By default that is the source text itself, normally a
+// read-only mapping of the file: a token is a pointer range into it, identifiers and strings
+// are interned from there (one arena copy per distinct text) and numbers parsed in place, so
+// there is no stdio buffer in between and no copy or allocation per token.
+// --lexer=flex uses the flex scanner of choreo1.l instead; both produce the same tokens, except
+// that newlines inside string literals are counted here and not by flex.
+class Scanner {
+public:
+  Scanner(Compilation &C, llvm::StringRef Source, bool UseFlex);
+  ~Scanner();
+  Scanner(const Scanner&) = delete;
+  Scanner& operator=(const Scanner&) = delete;
+
+  int lex(YYSTYPE *Value);         // next token, 0 at the end of the input
+  int line() const;                // line of the last token
+  llvm::StringRef text() const;    // text of the last token (syntax errors)
+
+private:
+  Compilation &C;
+  const char *Cur, *End, *TokStart;
+  int Line = 1;
+  void *Flex = nullptr;            // yyscan_t with --lexer=flex
+  FILE *FlexIn = nullptr;
+  int lexSource(YYSTYPE *Value);
+};
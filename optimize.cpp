@@ -0,0 +1,59 @@
+#include "optimize.h"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Analysis/LoopAnalysisManager.h>
+#include <llvm/Analysis/CGSCCPassManager.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/OptimizationLevel.h>
+using namespace llvm;
+
+//----------------------------------------------------------count every instruction in every function body
+size_t countInstructions(const Module &M) {
+size_t n = 0;
+for (const Function &F : M)
+  for (const BasicBlock &BB : F)
+    n += BB.size();
+return n;
+}
+
+//----------------------------------------------------------count the basic blocks of every function body
+size_t countBasicBlocks(const Module &M) {
+size_t n = 0;
+for (const Function &F : M)
+  n += F.size();
+return n;
+}
+
+//----------------------------------------------------------run the standard -O<n> pipeline
+// The default per-module pipeline already contains everything our IR needs:
+// SROA/mem2reg promote the allocas VarDecl makes, instcombine + GVN clean up the
+// load/store on every VariableExpr/Assign, SimplifyCFG folds the empty cont/ifcont
+// blocks left by Jump and IfStmt, and the loop pipeline + loop/SLP vectorizers handle REPEAT.
+void optimizeModule(Module &M, unsigned OptLevel, TargetMachine *TM) {
+OptimizationLevel level = OptimizationLevel::O0;
+switch (OptLevel) {
+case 0:  level = OptimizationLevel::O0; break;
+case 1:  level = OptimizationLevel::O1; break;
+case 2:  level = OptimizationLevel::O2; break;
+default: level = OptimizationLevel::O3; break;
+}
+
+// the four analysis managers have to be declared in this order so they get destroyed in the right order
+LoopAnalysisManager     LAM;
+FunctionAnalysisManager FAM;
+CGSCCAnalysisManager    CGAM;
+ModuleAnalysisManager   MAM;
+
+PassBuilder PB(TM);
+PB.registerModuleAnalyses(MAM);
+PB.registerCGSCCAnalyses(CGAM);
+PB.registerFunctionAnalyses(FAM);
+PB.registerLoopAnalyses(LAM);
+PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+ModulePassManager MPM = (level == OptimizationLevel::O0)
+  ? PB.buildO0DefaultPipeline(level)
+  : PB.buildPerModuleDefaultPipeline(level);
+MPM.run(M, MAM);
+}
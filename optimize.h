@@ -0,0 +1,16 @@
+// optimize.h
+#pragma once
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+// Run the new-PM default pipeline for -O<OptLevel> (0..3) over the module.
+// -O0 only runs the always-inline/verifier style O0 pipeline.
+// With a TargetMachine the cost models (and so the vectorizers) see the real SIMD width.
+void optimizeModule(llvm::Module &M, unsigned OptLevel,
+                    llvm::TargetMachine *TM = nullptr);
+
+// Number of IR instructions in all function bodies of the module
+size_t countInstructions(const llvm::Module &M);
+// Number of basic blocks in all function bodies of the module
+size_t countBasicBlocks(const llvm::Module &M);
@@ -0,0 +1,127 @@
+#include "profile.h"
+#include "compilation.h"
+#include <algorithm>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/ProfileSummary.h>
+#include <llvm/ProfileData/InstrProf.h>
+#include <llvm/ProfileData/ProfileCommon.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+using namespace llvm;
+
+// first line of every profile (runtime/profile.c)
+static const char ProfileHeader[] = "# choreo profile 1";
+
+//----------------------------------------------------------counters and layout
+// counter 0: runs; 1 + 2*n, 2 + 2*n: SPIN n ran / fell through; then one per label slot
+static unsigned spinCounter(int Spin) { return 1 + 2 * Spin; }
+static unsigned labelCounter(const Compilation &C, int Slot) { return 1 + 2 * C.SpinTargets.size() + Slot; }
+static unsigned numCounters(const Compilation &C) { return labelCounter(C, C.LabelNames.size()); }
+
+// the lines of a profile without their counts, in counter order
+static std::string profileLayout(const Compilation &C) {
+std::string layout;
+raw_string_ostream os(layout);
+os << "entry\n";
+for (size_t i = 0; i < C.SpinTargets.size(); ++i)
+  os << "spin " << i << " " << C.SpinTargets[i] << "\n";
+for (StringRef name : C.LabelNames)
+  os << "label " << name << "\n";
+return os.str();
+}
+
+//------------------------------------------------------------profile-generate
+void beginProfileCounters(Compilation &C, Module &M, IRBuilder<> &B) {
+ArrayType *ty = ArrayType::get(B.getInt64Ty(), numCounters(C));
+C.ProfileCounters = new GlobalVariable(M, ty, false, GlobalValue::InternalLinkage,
+                                       ConstantAggregateZero::get(ty), "choreo.profile.counters");
+B.CreateStore(B.getInt64(1), B.CreateConstInBoundsGEP2_64(ty, C.ProfileCounters, 0, 0));
+}
+
+// plain load / add / store: SPINs and labels never run on more than one thread (not in PARALLEL loops)
+static void count(Compilation &C, unsigned Index, IRBuilder<> &B) {
+GlobalVariable *counters = C.ProfileCounters;
+Value *slot = B.CreateConstInBoundsGEP2_64(counters->getValueType(), counters, 0, Index);
+B.CreateStore(B.CreateAdd(B.CreateLoad(B.getInt64Ty(), slot), B.getInt64(1)), slot);
+}
+
+void countSpin(Compilation &C, int Spin, bool FellThrough, IRBuilder<> &B) {
+count(C, spinCounter(Spin) + FellThrough, B);
+}
+
+void countLabel(Compilation &C, int Slot, IRBuilder<> &B) { count(C, labelCounter(C, Slot), B); }
+
+void emitProfileWrite(Compilation &C, Module &M, IRBuilder<> &B, StringRef Path) {
+FunctionCallee write = M.getOrInsertFunction("choreo_profile_write", B.getVoidTy(),
+  B.getInt8PtrTy(), B.getInt8PtrTy(), B.getInt64Ty()->getPointerTo());
+GlobalVariable *counters = C.ProfileCounters;
+B.CreateCall(write, { B.CreateGlobalStringPtr(Path, "choreo.profile.path", 0, &M),
+                      B.CreateGlobalStringPtr(profileLayout(C), "choreo.profile.layout", 0, &M),
+                      B.CreateConstInBoundsGEP2_64(counters->getValueType(), counters, 0, 0) });
+}
+
+//------------------------------------------------------------profile-use
+bool readProfile(StringRef Path, const Compilation &C, ProfileData &Profile, std::string &Error) {
+ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(Path, /*IsText=*/true);
+if (!file) {
+  Error = file.getError().message();
+  return false;
+}
+SmallVector<StringRef, 64> lines;
+(*file)->getBuffer().split(lines, '\n', -1, /*KeepEmpty=*/false);
+if (lines.empty() || lines[0] != ProfileHeader) {
+  Error = "not a choreo profile";
+  return false;
+}
+SmallVector<StringRef, 64> expected;
+std::string layout = profileLayout(C);
+StringRef(layout).split(expected, '\n', -1, /*KeepEmpty=*/false);
+if (lines.size() != expected.size() + 1) {
+  Error = "made for a different program (or an older version of this one)";
+  return false;
+}
+Profile = ProfileData();
+for (size_t i = 0; i < expected.size(); ++i) {
+  StringRef line = lines[i + 1];
+  uint64_t ran = 0, taken = 0;
+  if (!line.consume_front(expected[i]) || !line.consume_front(" ") ||
+      line.consumeInteger(10, ran) || (expected[i].startswith("spin ") &&
+      (!line.consume_front(" ") || line.consumeInteger(10, taken) || taken > ran)) || !line.empty()) {
+    Error = (Twine("made for a different program (line ") + Twine(i + 2) + ": " + lines[i + 1] + ")").str();
+    return false;
+  }
+  if (expected[i] == "entry") {
+    Profile.Runs = ran;
+  } else if (expected[i].startswith("spin ")) {
+    Profile.Executed.push_back(ran);
+    Profile.Taken.push_back(taken);
+  } else {
+    Profile.LabelCounts.push_back(ran);
+  }
+}
+return true;
+}
+
+// taken / fell through, scaled into the 32 bits branch_weights hold
+MDNode *spinWeights(const Compilation &C, int Spin, LLVMContext &Ctx) {
+if (!C.Profile || Spin < 0 || !C.Profile->Executed[Spin])
+  return nullptr;
+uint64_t ran = C.Profile->Executed[Spin], taken = C.Profile->Taken[Spin];
+uint64_t scale = ran / UINT32_MAX + 1;
+return MDBuilder(Ctx).createBranchWeights((uint32_t)(taken / scale), (uint32_t)((ran - taken) / scale));
+}
+
+// main is the only counted function: its entry count is the number of runs, and every label
+// block and SPIN count goes into the summary that tells PSI what "hot" means in this program
+void attachProfileSummary(const Compilation &C, Module &M, Function &Main) {
+const ProfileData &P = *C.Profile;
+if (!P.Runs)
+  return;
+Main.setEntryCount(P.Runs);
+std::vector<uint64_t> counts{ P.Runs };
+counts.insert(counts.end(), P.LabelCounts.begin(), P.LabelCounts.end());
+counts.insert(counts.end(), P.Executed.begin(), P.Executed.end());
+InstrProfSummaryBuilder builder(ProfileSummaryBuilder::DefaultCutoffs);
+builder.addRecord(InstrProfRecord(std::move(counts)));
+M.setProfileSummary(builder.getSummary()->getMD(M.getContext()), ProfileSummary::PSK_Instr);
+}
@@ -0,0 +1,40 @@
+// profile.h
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+
+struct Compilation;
+
+// --profile-generate / --profile-use: how often every SPIN jumped and every label block ran in
+// the runs of an instrumented build. The instrumented program keeps one i64 counter per run of
+// main, two per SPIN (ran, fell through) and one per label, and writes them as text when main
+// returns (runtime/profile.c); a later compile turns them into branch weights on the SPINs, an
+// entry count on main and a profile summary, so block placement and the hot / cold decisions
+// of the optimizer follow the program's real behaviour.
+struct ProfileData {
+  uint64_t Runs = 0;
+  std::vector<uint64_t> Executed, Taken;   // SPIN number -> times it ran / jumped
+  std::vector<uint64_t> LabelCounts;       // label slot -> times its block ran
+};
+
+// Path, checked against the SPINs and labels of C (after resolveNames); false with Error set if
+// it cannot be read or was made by another program
+bool readProfile(llvm::StringRef Path, const Compilation &C, ProfileData &Profile, std::string &Error);
+
+// instrumented build: the counter array and the count of this run, at the start of main
+void beginProfileCounters(Compilation &C, llvm::Module &M, llvm::IRBuilder<> &B);
+// ++ the counter of SPIN Spin (FellThrough: the one of its fall-through block) / of label Slot
+void countSpin(Compilation &C, int Spin, bool FellThrough, llvm::IRBuilder<> &B);
+void countLabel(Compilation &C, int Slot, llvm::IRBuilder<> &B);
+// choreo_profile_write(Path, layout, counters), before main returns
+void emitProfileWrite(Compilation &C, llvm::Module &M, llvm::IRBuilder<> &B, llvm::StringRef Path);
+
+// --profile-use: !prof branch_weights of SPIN Spin, nullptr if it never ran
+llvm::MDNode *spinWeights(const Compilation &C, int Spin, llvm::LLVMContext &Ctx);
+// --profile-use: the entry count of main and the module's profile summary
+void attachProfileSummary(const Compilation &C, llvm::Module &M, llvm::Function &Main);
@@ -0,0 +1,73 @@
+/* choreo_rt.h -- runtime library linked into compiled ChoreoLang programs
+   (and into the choreo driver itself, so --run can hand these to the JIT). */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ---- buffered ECCO / ECCO_D output (echo.c) ----
+   Everything goes into one per-process buffer that is written to fd 1 when it
+   fills up, on choreo_echo_flush() (emitted before main returns) and at exit.
+   Line-buffered mode writes after every echo; the default is block-buffered,
+   or line-buffered when stdout is a terminal. */
+#define CHOREO_ECHO_DEFAULT_BUFFER (1 << 20)
+
+/* BufSize 0 keeps the default size; LineBuffered -1 keeps the default mode */
+void choreo_echo_init(int64_t BufSize, int32_t LineBuffered);
+/* ECCO "text": Len bytes of Str followed by a newline */
+void choreo_echo_str(const char *Str, int64_t Len);
+/* ECCO_D x: the value like printf("%f\n") */
+void choreo_echo_f64(double Val);
+void choreo_echo_flush(void);
+
+/* ---- number formatting (fmt_f64.c) ---- */
+/* longest %f text of a double (-DBL_MAX) plus the terminating NUL of the snprintf fallback */
+#define CHOREO_F64_TEXT_MAX 320
+
+/* Val exactly as printf("%f") prints it, without the varargs/locale machinery.
+   Writes at most CHOREO_F64_TEXT_MAX bytes (not NUL terminated), returns the length. */
+size_t choreo_format_f64(double Val, char *Out);
+
+/* ---- SUM / MIN / MAX / DOT of whole ENSEMBLEs (ensemble.c) ----
+   SSE2 or AVX2 kernels picked on the first call (CHOREO_SIMD=scalar|sse2|avx2 caps the
+   choice); every kernel sums in the same order, so the results do not depend on the cpu.
+   MIN / MAX of an empty ENSEMBLE are +inf / -inf. */
+double choreo_sum_f64(const double *P, int64_t N);
+double choreo_min_f64(const double *P, int64_t N);
+double choreo_max_f64(const double *P, int64_t N);
+double choreo_dot_f64(const double *A, const double *B, int64_t N);
+/* "scalar", "sse2" or "avx2" */
+const char *choreo_simd_kernels(void);
+
+/* ---- ENSEMBLE a FROM "file" / SAVE a TO "file" (mapfile.c) ----
+   Files are raw little-endian doubles. Errors (missing file, too short, ...) are reported on
+   stderr and end the program with status 1. */
+/* maps Path copy-on-write; Count >= 0: the first Count doubles (the file must have them),
+   Count < 0: all of them. Sets *Len (if not NULL) to the element count. */
+double *choreo_map_f64(const char *Path, int64_t Count, int64_t *Len);
+/* writes Len doubles to Path (created or resized) through a shared mapping + msync */
+void choreo_save_f64(const char *Path, const double *Data, int64_t Len);
+/* ends the program if two ENSEMBLEs an operation combines have different sizes */
+void choreo_check_length(int64_t Expected, int64_t Actual, const char *What);
+
+/* ---- REPEAT n TIMES PARALLEL (parallel.c) ----
+   Runs Body(Begin, End, Chunk, Ctx) for the Chunks contiguous chunks of [0, N), chunk k on
+   [k*N/Chunks, (k+1)*N/Chunks) give or take one, on a work-stealing pool of threads:
+   CHOREO_THREADS if set, else Threads, else one per online cpu (Threads <= 0). Returns when
+   every chunk is done. */
+typedef void (*ChoreoParallelBody)(int64_t Begin, int64_t End, int64_t Chunk, void *Ctx);
+void choreo_parallel_for(int64_t N, int64_t Chunks, ChoreoParallelBody Body, void *Ctx, int32_t Threads);
+
+/* ---- --profile-generate builds (profile.c) ----
+   Counts holds the counters of the lines of Layout ("entry\n", "spin <n> <label>\n",
+   "label <name>\n", every line ending in a newline); writes them to Path as a text profile,
+   added to the counts already there if Path is a profile of the same layout. */
+void choreo_profile_write(const char *Path, const char *Layout, const uint64_t *Counts);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,94 @@
+/* echo.c -- buffered output behind ECCO / ECCO_D */
+#include "choreo_rt.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char   *OutBuf;
+static size_t  OutCap = CHOREO_ECHO_DEFAULT_BUFFER;
+static size_t  OutLen;
+static int     LineMode = -1;          /* -1: not decided yet */
+
+/* write(2) everything, retrying on short writes and EINTR */
+static void writeAll(const char *p, size_t n) {
+  while (n > 0) {
+    ssize_t w = write(1, p, n);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return;                          /* stdout is gone, nothing sensible to do */
+    }
+    p += w;
+    n -= (size_t)w;
+  }
+}
+
+void choreo_echo_flush(void) {
+  if (OutLen) writeAll(OutBuf, OutLen);
+  OutLen = 0;
+}
+
+static void setup(void) {
+  if (LineMode < 0) LineMode = isatty(1);
+  OutBuf = (char *)malloc(OutCap);
+  if (!OutBuf) {                       /* fall back to unbuffered writes */
+    OutCap = 0;
+    LineMode = 1;
+  }
+}
+
+/* safety net for anything still buffered when the process exits
+   (a destructor instead of atexit(): lli can't resolve atexit, which lives in libc_nonshared.a) */
+__attribute__((destructor)) static void flushAtExit(void) {
+  choreo_echo_flush();
+}
+
+void choreo_echo_init(int64_t BufSize, int32_t LineBuffered) {
+  if (OutBuf) {                        /* re-init: flush what we have with the old settings */
+    choreo_echo_flush();
+    free(OutBuf);
+    OutBuf = NULL;
+  }
+  if (BufSize > 0) OutCap = (size_t)BufSize;
+  if (LineBuffered >= 0) LineMode = LineBuffered != 0;
+  setup();
+}
+
+/* append Len bytes, going straight to write(2) for anything bigger than the buffer */
+static void append(const char *p, size_t n) {
+  if (!OutBuf && OutCap) setup();
+  if (OutLen + n > OutCap) {
+    choreo_echo_flush();
+    if (n > OutCap) {
+      writeAll(p, n);
+      return;
+    }
+  }
+  memcpy(OutBuf + OutLen, p, n);
+  OutLen += n;
+}
+
+static void endLine(void) {
+  append("\n", 1);
+  if (LineMode) choreo_echo_flush();
+}
+
+void choreo_echo_str(const char *Str, int64_t Len) {
+  append(Str, (size_t)Len);
+  endLine();
+}
+
+void choreo_echo_f64(double Val) {
+  if (!OutBuf && OutCap) setup();
+  if (OutCap < CHOREO_F64_TEXT_MAX) {  /* tiny / no buffer: format on the stack */
+    char tmp[CHOREO_F64_TEXT_MAX];
+    append(tmp, choreo_format_f64(Val, tmp));
+    endLine();
+    return;
+  }
+  /* format straight into the buffer */
+  if (OutLen + CHOREO_F64_TEXT_MAX > OutCap) choreo_echo_flush();
+  OutLen += choreo_format_f64(Val, OutBuf + OutLen);
+  endLine();
+}
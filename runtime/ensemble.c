@@ -0,0 +1,205 @@
+/* ensemble.c -- SUM / MIN / MAX / DOT over whole ENSEMBLEs
+
+   Every kernel keeps 8 running lanes (lane j sees the elements i with i % 8 == j), folds
+   them as ((l0 op l4) op (l2 op l6)) op ((l1 op l5) op (l3 op l7)) and then takes in the
+   n % 8 tail elements in order. The scalar, SSE2 and AVX2 versions all do exactly that,
+   without FMA, so a script prints the same digits whichever one the cpu gets. */
+#include "choreo_rt.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define CHOREO_X86 1
+#endif
+
+typedef double (*ReduceFn)(const double *, int64_t);
+typedef double (*DotFn)(const double *, const double *, int64_t);
+
+struct Kernels {
+  const char *Name;
+  ReduceFn Sum, Min, Max;
+  DotFn Dot;
+};
+
+/* min / max like minpd / maxpd: the first operand when it compares less / greater */
+static inline double minOf(double a, double b) { return a < b ? a : b; }
+static inline double maxOf(double a, double b) { return a > b ? a : b; }
+
+static double fold8(const double *l, double (*op)(double, double)) {
+  return op(op(op(l[0], l[4]), op(l[2], l[6])), op(op(l[1], l[5]), op(l[3], l[7])));
+}
+static double addOf(double a, double b) { return a + b; }
+
+/* ---- scalar ---- */
+#define SCALAR_REDUCE(NAME, INIT, STEP, OP)                                  \
+  static double NAME(const double *p, int64_t n) {                          \
+    double l[8] = { INIT, INIT, INIT, INIT, INIT, INIT, INIT, INIT };       \
+    int64_t i = 0;                                                          \
+    for (; i + 8 <= n; i += 8)                                              \
+      for (int j = 0; j < 8; ++j) l[j] = STEP(p[i + j], l[j]);              \
+    double r = fold8(l, OP);                                                \
+    for (; i < n; ++i) r = STEP(p[i], r);                                   \
+    return r;                                                               \
+  }
+#define ADD_STEP(v, acc) ((acc) + (v))
+SCALAR_REDUCE(sumScalar, 0.0, ADD_STEP, addOf)
+SCALAR_REDUCE(minScalar, INFINITY, minOf, minOf)
+SCALAR_REDUCE(maxScalar, -INFINITY, maxOf, maxOf)
+
+static double dotScalar(const double *a, const double *b, int64_t n) {
+  double l[8] = { 0 };
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    for (int j = 0; j < 8; ++j) {
+      double prod = a[i + j] * b[i + j];
+      l[j] = l[j] + prod;
+    }
+  double r = fold8(l, addOf);
+  for (; i < n; ++i) {
+    double prod = a[i] * b[i];
+    r = r + prod;
+  }
+  return r;
+}
+
+static const struct Kernels ScalarKernels = { "scalar", sumScalar, minScalar, maxScalar, dotScalar };
+
+#ifdef CHOREO_X86
+/* ---- SSE2: four 2-lane registers, r0 = (l0,l1) .. r3 = (l6,l7) ---- */
+#define SSE2_REDUCE(NAME, INIT, VSTEP, STEP, OP)                            \
+  __attribute__((target("sse2")))                                           \
+  static double NAME(const double *p, int64_t n) {                          \
+    __m128d r0 = _mm_set1_pd(INIT), r1 = r0, r2 = r0, r3 = r0;              \
+    int64_t i = 0;                                                          \
+    for (; i + 8 <= n; i += 8) {                                            \
+      r0 = VSTEP(_mm_loadu_pd(p + i), r0);                                  \
+      r1 = VSTEP(_mm_loadu_pd(p + i + 2), r1);                              \
+      r2 = VSTEP(_mm_loadu_pd(p + i + 4), r2);                              \
+      r3 = VSTEP(_mm_loadu_pd(p + i + 6), r3);                              \
+    }                                                                       \
+    double l[8];                                                            \
+    _mm_storeu_pd(l, r0); _mm_storeu_pd(l + 2, r1);                         \
+    _mm_storeu_pd(l + 4, r2); _mm_storeu_pd(l + 6, r3);                     \
+    double r = fold8(l, OP);                                                \
+    for (; i < n; ++i) r = STEP(p[i], r);                                   \
+    return r;                                                               \
+  }
+#define SSE2_ADD(v, acc) _mm_add_pd(acc, v)
+SSE2_REDUCE(sumSSE2, 0.0, SSE2_ADD, ADD_STEP, addOf)
+SSE2_REDUCE(minSSE2, INFINITY, _mm_min_pd, minOf, minOf)
+SSE2_REDUCE(maxSSE2, -INFINITY, _mm_max_pd, maxOf, maxOf)
+
+__attribute__((target("sse2")))
+static double dotSSE2(const double *a, const double *b, int64_t n) {
+  __m128d r0 = _mm_setzero_pd(), r1 = r0, r2 = r0, r3 = r0;
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    r0 = _mm_add_pd(r0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    r1 = _mm_add_pd(r1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    r2 = _mm_add_pd(r2, _mm_mul_pd(_mm_loadu_pd(a + i + 4), _mm_loadu_pd(b + i + 4)));
+    r3 = _mm_add_pd(r3, _mm_mul_pd(_mm_loadu_pd(a + i + 6), _mm_loadu_pd(b + i + 6)));
+  }
+  double l[8];
+  _mm_storeu_pd(l, r0); _mm_storeu_pd(l + 2, r1);
+  _mm_storeu_pd(l + 4, r2); _mm_storeu_pd(l + 6, r3);
+  double r = fold8(l, addOf);
+  for (; i < n; ++i) {
+    double prod = a[i] * b[i];
+    r = r + prod;
+  }
+  return r;
+}
+
+static const struct Kernels SSE2Kernels = { "sse2", sumSSE2, minSSE2, maxSSE2, dotSSE2 };
+
+/* ---- AVX2: two 4-lane registers, r0 = (l0..l3), r1 = (l4..l7); "avx2" without "fma" so
+   the compiler cannot fuse the multiply-adds of DOT ---- */
+#define AVX2_REDUCE(NAME, INIT, VSTEP, STEP, OP)                            \
+  __attribute__((target("avx2")))                                           \
+  static double NAME(const double *p, int64_t n) {                          \
+    __m256d r0 = _mm256_set1_pd(INIT), r1 = r0;                             \
+    int64_t i = 0;                                                          \
+    for (; i + 8 <= n; i += 8) {                                            \
+      r0 = VSTEP(_mm256_loadu_pd(p + i), r0);                               \
+      r1 = VSTEP(_mm256_loadu_pd(p + i + 4), r1);                           \
+    }                                                                       \
+    double l[8];                                                            \
+    _mm256_storeu_pd(l, r0); _mm256_storeu_pd(l + 4, r1);                   \
+    double r = fold8(l, OP);                                                \
+    for (; i < n; ++i) r = STEP(p[i], r);                                   \
+    return r;                                                               \
+  }
+#define AVX2_ADD(v, acc) _mm256_add_pd(acc, v)
+AVX2_REDUCE(sumAVX2, 0.0, AVX2_ADD, ADD_STEP, addOf)
+AVX2_REDUCE(minAVX2, INFINITY, _mm256_min_pd, minOf, minOf)
+AVX2_REDUCE(maxAVX2, -INFINITY, _mm256_max_pd, maxOf, maxOf)
+
+__attribute__((target("avx2")))
+static double dotAVX2(const double *a, const double *b, int64_t n) {
+  __m256d r0 = _mm256_setzero_pd(), r1 = r0;
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    r0 = _mm256_add_pd(r0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    r1 = _mm256_add_pd(r1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+  }
+  double l[8];
+  _mm256_storeu_pd(l, r0); _mm256_storeu_pd(l + 4, r1);
+  double r = fold8(l, addOf);
+  for (; i < n; ++i) {
+    double prod = a[i] * b[i];
+    r = r + prod;
+  }
+  return r;
+}
+
+static const struct Kernels AVX2Kernels = { "avx2", sumAVX2, minAVX2, maxAVX2, dotAVX2 };
+#endif
+
+/* ---- dispatch: picked on the first call; CHOREO_SIMD=scalar|sse2|avx2 caps the choice ---- */
+static const struct Kernels *Active;
+
+#ifdef CHOREO_X86
+/* cpuid by hand rather than __builtin_cpu_supports, whose __cpu_model lives in libgcc and is
+   not there for lli / the JIT. AVX2 also needs the OS to save the ymm registers (xgetbv). */
+static int hasSSE2(void) {
+  unsigned a, b, c, d;
+  return __get_cpuid(1, &a, &b, &c, &d) && (d & bit_SSE2);
+}
+static int hasAVX2(void) {
+  unsigned a, b, c, d, lo, hi;
+  if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_OSXSAVE) || !(c & bit_AVX))
+    return 0;
+  __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  if ((lo & 6) != 6)
+    return 0;
+  return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_AVX2);
+}
+#endif
+
+static const struct Kernels *pick(void) {
+  const struct Kernels *k = __atomic_load_n(&Active, __ATOMIC_ACQUIRE);
+  if (k) return k;
+  const char *cap = getenv("CHOREO_SIMD");
+  k = &ScalarKernels;
+#ifdef CHOREO_X86
+  int scalarOnly = cap && !strcmp(cap, "scalar");
+  if (!scalarOnly && hasSSE2())
+    k = &SSE2Kernels;
+  if (!scalarOnly && !(cap && !strcmp(cap, "sse2")) && hasAVX2())
+    k = &AVX2Kernels;
+#else
+  (void)cap;
+#endif
+  __atomic_store_n(&Active, k, __ATOMIC_RELEASE);
+  return k;
+}
+
+double choreo_sum_f64(const double *P, int64_t N) { return pick()->Sum(P, N); }
+double choreo_min_f64(const double *P, int64_t N) { return pick()->Min(P, N); }
+double choreo_max_f64(const double *P, int64_t N) { return pick()->Max(P, N); }
+double choreo_dot_f64(const double *A, const double *B, int64_t N) { return pick()->Dot(A, B, N); }
+const char *choreo_simd_kernels(void) { return pick()->Name; }
@@ -0,0 +1,111 @@
+/* fmt_f64.c -- printf("%f")-identical double formatting without printf
+ *
+ * %f is "round the exact binary value to 6 decimals, half to even". With the
+ * double written as m * 2^e (m < 2^53) that is round(m * 5^6 * 2^(e+6)), which
+ * for |v| < 2^108 fits in 128-bit integer arithmetic: a left shift is exact and
+ * a right shift rounds on the bits shifted out. That covers everything a script
+ * realistically prints; larger magnitudes fall back to snprintf. */
+#include "choreo_rt.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef unsigned __int128 u128;
+
+static const char DigitPairs[201] =
+  "00010203040506070809101112131415161718192021222324"
+  "25262728293031323334353637383940414243444546474849"
+  "50515253545556575859606162636465666768697071727374"
+  "75767778798081828384858687888990919293949596979899";
+
+/* decimal digits of V, no leading zeros ("0" for 0); returns the length */
+static size_t formatU64(uint64_t V, char *Out) {
+  char tmp[20];
+  char *p = tmp + sizeof tmp;
+  while (V >= 100) {
+    unsigned pair = (unsigned)(V % 100);
+    V /= 100;
+    p -= 2;
+    memcpy(p, DigitPairs + 2 * pair, 2);
+  }
+  if (V >= 10) {
+    p -= 2;
+    memcpy(p, DigitPairs + 2 * V, 2);
+  } else {
+    *--p = (char)('0' + V);
+  }
+  size_t n = (size_t)(tmp + sizeof tmp - p);
+  memcpy(Out, p, n);
+  return n;
+}
+
+/* exactly Width digits of V (V < 10^Width), zero padded */
+static void formatFixedWidth(uint64_t V, char *Out, int Width) {
+  for (int i = Width - 1; i >= 0; --i) {
+    Out[i] = (char)('0' + V % 10);
+    V /= 10;
+  }
+}
+
+static size_t formatU128(u128 V, char *Out) {
+  const uint64_t e19 = 10000000000000000000ull;
+  if (V <= UINT64_MAX) return formatU64((uint64_t)V, Out);
+  /* < 2^128 has at most 39 digits: split into up to three 19 digit chunks */
+  uint64_t low = (uint64_t)(V % e19);
+  V /= e19;
+  size_t n;
+  if (V <= UINT64_MAX) {
+    n = formatU64((uint64_t)V, Out);
+  } else {
+    uint64_t mid = (uint64_t)(V % e19);
+    n = formatU64((uint64_t)(V / e19), Out);
+    formatFixedWidth(mid, Out + n, 19);
+    n += 19;
+  }
+  formatFixedWidth(low, Out + n, 19);
+  return n + 19;
+}
+
+size_t choreo_format_f64(double Val, char *Out) {
+  char *p = Out;
+  if (signbit(Val)) *p++ = '-';        /* printf prints -0.000000 and -nan too */
+  if (isnan(Val)) { memcpy(p, "nan", 3); return (size_t)(p - Out) + 3; }
+  if (isinf(Val)) { memcpy(p, "inf", 3); return (size_t)(p - Out) + 3; }
+  double a = fabs(Val);
+
+  /* integer fast path: counters, indices, array sums... */
+  if (a < 9223372036854775808.0 && a == (double)(int64_t)a) {
+    p += formatU64((uint64_t)a, p);
+    memcpy(p, ".000000", 7);
+    return (size_t)(p - Out) + 7;
+  }
+
+  if (a >= 0x1p108) return (size_t)snprintf(Out, CHOREO_F64_TEXT_MAX, "%f", Val);
+
+  /* a = m * 2^e exactly */
+  int e;
+  double frac = frexp(a, &e);                    /* a = frac * 2^e, frac in [0.5, 1) */
+  uint64_t m = (uint64_t)ldexp(frac, 53);
+  e -= 53;
+
+  u128 scaled = (u128)m * 15625u;                /* m * 5^6, the 2^6 goes into the shift */
+  int shift = e + 6;
+  u128 n;                                        /* round(a * 10^6) */
+  if (shift >= 0) {
+    n = scaled << shift;
+  } else if (-shift >= 68) {                     /* scaled < 2^67: below half a unit */
+    n = 0;
+  } else {
+    int s = -shift;
+    u128 rem  = scaled & (((u128)1 << s) - 1);
+    u128 half = (u128)1 << (s - 1);
+    n = scaled >> s;
+    if (rem > half || (rem == half && (n & 1))) ++n;
+  }
+
+  p += formatU128(n / 1000000u, p);
+  *p++ = '.';
+  formatFixedWidth((uint64_t)(n % 1000000u), p, 6);
+  return (size_t)(p - Out) + 6;
+}
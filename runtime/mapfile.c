@@ -0,0 +1,106 @@
+/* mapfile.c -- ENSEMBLE a FROM "file" / SAVE a TO "file"
+
+   The files are raw arrays of little-endian doubles, no header. Reading maps the file
+   copy-on-write, so the ENSEMBLE is the page cache itself and only the pages the script
+   writes get copied; saving maps the output file shared, copies the elements in and msyncs.
+   Neither needs the whole array in memory twice, whatever the size of the file. */
+#define _FILE_OFFSET_BITS 64
+#include "choreo_rt.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define CHOREO_SWAP_BYTES 1
+static void swapDoubles(double *P, int64_t N) {
+  for (int64_t i = 0; i < N; ++i) {
+    uint64_t u;
+    memcpy(&u, &P[i], 8);
+    u = __builtin_bswap64(u);
+    memcpy(&P[i], &u, 8);
+  }
+}
+#endif
+
+/* a script cannot go on without its data: report and stop, like a failed assertion */
+static void fail(const char *What, const char *Path, const char *Why) {
+  choreo_echo_flush();
+  fprintf(stderr, "choreo: %s %s: %s\n", What, Path, Why);
+  exit(1);
+}
+
+static double EmptyEnsemble[1];
+
+double *choreo_map_f64(const char *Path, int64_t Count, int64_t *Len) {
+  int fd = open(Path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    fail("cannot open", Path, strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+    fail("cannot stat", Path, strerror(errno));
+  if (st.st_size % 8 != 0)
+    fail("cannot load", Path, "the size is not a multiple of 8 bytes (raw doubles)");
+  int64_t n = st.st_size / 8;
+  if (Count >= 0 && n < Count) {
+    char why[96];
+    snprintf(why, sizeof why, "holds %lld doubles, the ENSEMBLE needs %lld", (long long)n, (long long)Count);
+    fail("cannot load", Path, why);
+  }
+  if (Count >= 0)
+    n = Count;
+  if (Len)
+    *Len = n;
+  if (n == 0) {
+    close(fd);
+    return EmptyEnsemble;
+  }
+
+  double *p = mmap(NULL, (size_t)n * 8, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED)
+    fail("cannot map", Path, strerror(errno));
+  close(fd);   /* the mapping keeps the file */
+  madvise(p, (size_t)n * 8, MADV_WILLNEED);
+#ifdef CHOREO_SWAP_BYTES
+  swapDoubles(p, n);
+#endif
+  return p;
+}
+
+void choreo_save_f64(const char *Path, const double *Data, int64_t Len) {
+  /* no O_TRUNC: the source may be a mapping of this very file */
+  int fd = open(Path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+  if (fd < 0)
+    fail("cannot create", Path, strerror(errno));
+  if (ftruncate(fd, (off_t)Len * 8) != 0)
+    fail("cannot resize", Path, strerror(errno));
+  if (Len > 0) {
+    double *out = mmap(NULL, (size_t)Len * 8, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (out == MAP_FAILED)
+      fail("cannot map", Path, strerror(errno));
+    if (out != Data)
+      memmove(out, Data, (size_t)Len * 8);
+#ifdef CHOREO_SWAP_BYTES
+    swapDoubles(out, Len);
+#endif
+    if (msync(out, (size_t)Len * 8, MS_SYNC) != 0)
+      fail("cannot write", Path, strerror(errno));
+    munmap(out, (size_t)Len * 8);
+  }
+  if (close(fd) != 0)
+    fail("cannot write", Path, strerror(errno));
+}
+
+void choreo_check_length(int64_t Expected, int64_t Actual, const char *What) {
+  if (Expected != Actual) {
+    choreo_echo_flush();
+    fprintf(stderr, "choreo: %s: ENSEMBLE sizes differ (%lld vs %lld)\n", What,
+            (long long)Expected, (long long)Actual);
+    exit(1);
+  }
+}
@@ -0,0 +1,156 @@
+/* parallel.c -- the thread pool behind REPEAT n TIMES PARALLEL
+
+   The N iterations are cut into Chunks contiguous chunks (a compile-time number, so the
+   reduction partials of a loop do not depend on the thread count). Every participating thread
+   starts with an equal run of chunks, kept as [lo, hi) in one 64-bit word: the owner takes
+   chunks from lo, an idle thread steals the upper half of somebody else's run by moving hi
+   down, both with a compare-and-swap of the whole word. A thief makes the stolen half its own
+   run, so it can be stolen from in turn. The calling thread is worker 0; the others are
+   started on first use and sleep on a condition variable between loops. */
+#include "choreo_rt.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_WORKERS 256
+
+struct Worker {
+  _Alignas(64) uint64_t Range;         /* lo | hi << 32, chunk indices */
+};
+
+static struct Worker Workers[MAX_WORKERS];
+static int NumStarted = 1;             /* worker 0 is whoever calls choreo_parallel_for */
+
+/* the current loop; written under PoolLock before Generation moves on */
+static struct {
+  int64_t N, Chunks;
+  ChoreoParallelBody Body;
+  void *Ctx;
+  int Threads;
+} Job;
+static uint64_t Generation;
+static int Running;                    /* helpers still working on the current loop */
+static pthread_mutex_t PoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  WorkReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  WorkDone  = PTHREAD_COND_INITIALIZER;
+/* one loop at a time, in case several threads of the host (the JIT) call in */
+static pthread_mutex_t CallLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint64_t packRange(uint32_t Lo, uint32_t Hi) { return Lo | (uint64_t)Hi << 32; }
+static inline uint32_t rangeLo(uint64_t R) { return (uint32_t)R; }
+static inline uint32_t rangeHi(uint64_t R) { return (uint32_t)(R >> 32); }
+
+/* chunk C covers [first(C), first(C + 1)): the first N % Chunks chunks get one extra iteration */
+static inline int64_t chunkBegin(int64_t C) {
+  int64_t q = Job.N / Job.Chunks, r = Job.N % Job.Chunks;
+  return C * q + (C < r ? C : r);
+}
+
+static int stealInto(int Self) {
+  for (int k = 1; k < Job.Threads; ++k) {
+    struct Worker *victim = &Workers[(Self + k) % Job.Threads];
+    uint64_t r = __atomic_load_n(&victim->Range, __ATOMIC_ACQUIRE);
+    while (rangeLo(r) < rangeHi(r)) {
+      uint32_t lo = rangeLo(r), hi = rangeHi(r), take = (hi - lo + 1) / 2;
+      if (__atomic_compare_exchange_n(&victim->Range, &r, packRange(lo, hi - take), 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&Workers[Self].Range, packRange(hi - take, hi), __ATOMIC_RELEASE);
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void work(int Self) {
+  struct Worker *me = &Workers[Self];
+  do {
+    uint64_t r = __atomic_load_n(&me->Range, __ATOMIC_ACQUIRE);
+    while (rangeLo(r) < rangeHi(r)) {
+      uint32_t c = rangeLo(r);
+      if (__atomic_compare_exchange_n(&me->Range, &r, packRange(c + 1, rangeHi(r)), 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        Job.Body(chunkBegin(c), chunkBegin(c + 1), c, Job.Ctx);
+        r = __atomic_load_n(&me->Range, __ATOMIC_ACQUIRE);
+      }
+    }
+  } while (stealInto(Self));
+}
+
+static void *helperMain(void *Arg) {
+  int self = (int)(intptr_t)Arg;
+  uint64_t seen = 0;
+  pthread_mutex_lock(&PoolLock);
+  for (;;) {
+    while (Generation == seen)
+      pthread_cond_wait(&WorkReady, &PoolLock);
+    seen = Generation;
+    if (self >= Job.Threads)
+      continue;                          /* not needed for this loop */
+    pthread_mutex_unlock(&PoolLock);
+    work(self);
+    pthread_mutex_lock(&PoolLock);
+    if (--Running == 0)
+      pthread_cond_signal(&WorkDone);
+  }
+  return NULL;
+}
+
+/* CHOREO_THREADS, else the compiled-in --threads, else one per online cpu */
+static int threadCount(int32_t Requested) {
+  const char *env = getenv("CHOREO_THREADS");
+  long n = env && *env ? atol(env) : Requested;
+  if (n <= 0)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1) n = 1;
+  if (n > MAX_WORKERS) n = MAX_WORKERS;
+  return (int)n;
+}
+
+void choreo_parallel_for(int64_t N, int64_t Chunks, ChoreoParallelBody Body, void *Ctx, int32_t Threads) {
+  if (N <= 0)
+    return;
+  if (Chunks < 1) Chunks = 1;
+  if (Chunks > N) Chunks = N;
+  if (Chunks > UINT32_MAX - 1) Chunks = UINT32_MAX - 1;
+  int threads = threadCount(Threads);
+  if (threads > Chunks) threads = (int)Chunks;
+
+  pthread_mutex_lock(&CallLock);
+  Job.N = N;
+  Job.Chunks = Chunks;
+  if (threads == 1) {
+    for (int64_t c = 0; c < Chunks; ++c)
+      Body(chunkBegin(c), chunkBegin(c + 1), c, Ctx);
+    pthread_mutex_unlock(&CallLock);
+    return;
+  }
+
+  pthread_mutex_lock(&PoolLock);
+  while (NumStarted < threads) {
+    pthread_t t;
+    if (pthread_create(&t, NULL, helperMain, (void *)(intptr_t)NumStarted) != 0)
+      break;                             /* go on with the threads we have */
+    pthread_detach(t);
+    ++NumStarted;
+  }
+  if (threads > NumStarted) threads = NumStarted;
+  Job.Body = Body;
+  Job.Ctx = Ctx;
+  Job.Threads = threads;
+  for (int w = 0; w < threads; ++w)
+    Workers[w].Range = packRange((uint32_t)(Chunks * w / threads), (uint32_t)(Chunks * (w + 1) / threads));
+  Running = threads - 1;
+  ++Generation;
+  pthread_cond_broadcast(&WorkReady);
+  pthread_mutex_unlock(&PoolLock);
+
+  work(0);
+
+  pthread_mutex_lock(&PoolLock);
+  while (Running > 0)
+    pthread_cond_wait(&WorkDone, &PoolLock);
+  pthread_mutex_unlock(&PoolLock);
+  pthread_mutex_unlock(&CallLock);
+}
@@ -0,0 +1,119 @@
+/* profile.c -- the counters of a --profile-generate build, written when main returns
+
+   The compiler passes a layout with one line per counted thing, in counter order:
+     entry              1 counter:  runs of main
+     spin <n> <label>   2 counters: times SPIN n ran, times it fell through
+     label <name>       1 counter:  times the block of the label ran
+   The file gets the same lines with the counts appended: "spin 0 loop 1000 999" ran 1000
+   times and jumped 999 of them. When the file already holds a profile of the same layout,
+   the counts are added to it, so several training runs make one profile. The file is
+   written next to itself and renamed into place: an interrupted run leaves the old one. */
+#include "choreo_rt.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_HEADER "# choreo profile 1\n"
+
+static int isSpin(const char *Line) { return !strncmp(Line, "spin ", 5); }
+static const char *nextLine(const char *Line) { return strchr(Line, '\n') + 1; }
+
+static char *readFile(const char *Path) {
+  FILE *f = fopen(Path, "rb");
+  if (!f)
+    return NULL;
+  size_t cap = 1 << 12, len = 0, n;
+  char *text = malloc(cap + 1);
+  while (text && (n = fread(text + len, 1, cap - len, f)) > 0) {
+    len += n;
+    if (len == cap)
+      text = realloc(text, (cap *= 2) + 1);
+  }
+  fclose(f);
+  if (text)
+    text[len] = 0;
+  return text;
+}
+
+/* adds the counts of an existing profile of the same layout to Values; leaves them alone
+   if there is none, or it is of another program (or another build of this one) */
+static void addPrevious(const char *Path, const char *Layout, uint64_t *Values, size_t NumValues) {
+  char *text = readFile(Path);
+  if (!text)
+    return;
+  uint64_t *prev = calloc(NumValues ? NumValues : 1, sizeof *prev);
+  const char *p = text;
+  size_t v = 0;
+  int ok = prev && !strncmp(p, PROFILE_HEADER, strlen(PROFILE_HEADER));
+  if (ok)
+    p += strlen(PROFILE_HEADER);
+  for (const char *line = Layout; ok && *line; line = nextLine(line)) {
+    size_t len = (size_t)(nextLine(line) - line) - 1;
+    ok = !strncmp(p, line, len) && p[len] == ' ';
+    p += len;
+    for (int k = isSpin(line) ? 2 : 1; ok && k > 0; --k) {
+      char *end;
+      prev[v++] = strtoull(p, &end, 10);
+      ok = end != p;
+      p = end;
+    }
+    ok = ok && *p == '\n';
+    ++p;
+  }
+  if (ok && *p == 0)
+    for (size_t i = 0; i < NumValues; ++i)
+      Values[i] += prev[i];
+  free(prev);
+  free(text);
+}
+
+void choreo_profile_write(const char *Path, const char *Layout, const uint64_t *Counts) {
+  size_t lines = 0, n = 0, c = 0;
+  for (const char *line = Layout; *line; line = nextLine(line))
+    ++lines;
+  uint64_t *values = malloc((2 * lines + 1) * sizeof *values);
+  if (!values)
+    return;
+  for (const char *line = Layout; *line; line = nextLine(line)) {
+    if (isSpin(line)) {
+      values[n++] = Counts[c];
+      values[n++] = Counts[c] - Counts[c + 1];
+      c += 2;
+    } else {
+      values[n++] = Counts[c++];
+    }
+  }
+  addPrevious(Path, Layout, values, n);
+
+  size_t pathLen = strlen(Path);
+  char *tmp = malloc(pathLen + 5);
+  if (!tmp) {
+    free(values);
+    return;
+  }
+  memcpy(tmp, Path, pathLen);
+  memcpy(tmp + pathLen, ".tmp", 5);
+  FILE *f = fopen(tmp, "w");
+  if (!f) {
+    choreo_echo_flush();
+    fprintf(stderr, "choreo: cannot write the profile %s\n", Path);
+  } else {
+    fputs(PROFILE_HEADER, f);
+    size_t v = 0;
+    for (const char *line = Layout; *line; line = nextLine(line)) {
+      fwrite(line, 1, (size_t)(nextLine(line) - line) - 1, f);
+      for (int k = isSpin(line) ? 2 : 1; k > 0; --k)
+        fprintf(f, " %" PRIu64, values[v++]);
+      fputc('\n', f);
+    }
+    if (fclose(f) != 0 || rename(tmp, Path) != 0) {
+      choreo_echo_flush();
+      fprintf(stderr, "choreo: cannot write the profile %s\n", Path);
+      remove(tmp);
+    }
+  }
+  free(tmp);
+  free(values);
+}
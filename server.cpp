@@ -0,0 +1,312 @@
+#include "server.h"
+#include "ast.h"
+#include "stats.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "llvm/Support/Threading.h"
+using namespace llvm;
+
+// The server is a zygote: it loads and warms up LLVM once, then forks a process per request.
+// A request gets the warm state for the price of a fork, runs the unchanged driver on its own
+// copy of every global (the option flags, the echo runtime, a script's exit(1)) and cannot take
+// the server down by crashing; the server only relays its exit status.
+
+//----------------------------------------------------------signals
+// SIGCHLD / SIGINT / SIGTERM only write a byte to a pipe the poll loop watches
+static int SignalPipe[2] = { -1, -1 };
+static volatile sig_atomic_t Stopping = 0;
+
+static void onSignal(int Sig) {
+int saved = errno;
+if (Sig != SIGCHLD)
+  Stopping = 1;
+char byte = 0;
+(void)!write(SignalPipe[1], &byte, 1);
+errno = saved;
+}
+
+static bool installSignals() {
+if (pipe2(SignalPipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+  perror("--serve: pipe");
+  return false;
+}
+struct sigaction sa;
+memset(&sa, 0, sizeof sa);
+sa.sa_handler = onSignal;
+sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+sigemptyset(&sa.sa_mask);
+sigaction(SIGCHLD, &sa, nullptr);
+sigaction(SIGINT, &sa, nullptr);
+sigaction(SIGTERM, &sa, nullptr);
+signal(SIGPIPE, SIG_IGN);   // a client that went away is not the server's problem
+return true;
+}
+
+//----------------------------------------------------------socket
+static int listenOn(const std::string &Path) {
+sockaddr_un addr;
+memset(&addr, 0, sizeof addr);
+addr.sun_family = AF_UNIX;
+if (Path.size() >= sizeof addr.sun_path) {
+  fprintf(stderr, "--serve: socket path too long: %s\n", Path.c_str());
+  return -1;
+}
+memcpy(addr.sun_path, Path.c_str(), Path.size() + 1);
+int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+if (fd < 0) {
+  perror("--serve: socket");
+  return -1;
+}
+// a socket file nobody answers on is left over from a server that died: take it over
+if (connect(fd, (sockaddr*)&addr, sizeof addr) == 0) {
+  fprintf(stderr, "--serve: a server is already listening on %s\n", Path.c_str());
+  close(fd);
+  return -1;
+}
+unlink(Path.c_str());
+mode_t mask = umask(077);   // the socket runs anything as this user: nobody else may connect
+int bound = bind(fd, (sockaddr*)&addr, sizeof addr);
+umask(mask);
+if (bound != 0 || listen(fd, 128) != 0) {
+  fprintf(stderr, "--serve: %s: %s\n", Path.c_str(), strerror(errno));
+  close(fd);
+  return -1;
+}
+return fd;
+}
+
+static bool readAll(int Fd, char *P, size_t N) {
+while (N) {
+  ssize_t r = read(Fd, P, N);
+  if (r < 0 && errno == EINTR)
+    continue;
+  if (r <= 0)
+    return false;
+  P += r;
+  N -= r;
+}
+return true;
+}
+
+//----------------------------------------------------------requests
+struct Request {
+  int Fds[3] = { -1, -1, -1 };   // the client's stdin, stdout, stderr
+  std::vector<char> Payload;
+  const char *Cwd = nullptr;
+  std::vector<char*> Argv;       // Argv0, the client's arguments, nullptr
+  std::vector<char*> Env;
+
+  ~Request() {
+    for (int fd : Fds)
+      if (fd >= 0)
+        close(fd);
+  }
+};
+
+// the header with the descriptors, then the strings; false on anything but a well-formed request
+static bool receiveRequest(int Conn, const char *Argv0, Request &R) {
+ChoreoRequest header;
+alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(int))];
+iovec iov = { &header, sizeof header };
+msghdr msg;
+memset(&msg, 0, sizeof msg);
+msg.msg_iov = &iov;
+msg.msg_iovlen = 1;
+msg.msg_control = control;
+msg.msg_controllen = sizeof control;
+ssize_t got;
+do
+  got = recvmsg(Conn, &msg, MSG_CMSG_CLOEXEC);
+while (got < 0 && errno == EINTR);
+if (got <= 0)
+  return false;
+for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+  if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+    continue;
+  int *fds = (int*)CMSG_DATA(c);
+  size_t n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+  for (size_t i = 0; i < n; ++i) {   // keep three, close anything else that came along
+    if (i < 3 && R.Fds[2] < 0)
+      R.Fds[i] = fds[i];
+    else
+      close(fds[i]);
+  }
+}
+if (R.Fds[2] < 0 || (msg.msg_flags & MSG_CTRUNC))
+  return false;
+if ((size_t)got < sizeof header && !readAll(Conn, (char*)&header + got, sizeof header - got))
+  return false;
+if (header.Magic != CHOREO_REQUEST_MAGIC || header.Length > CHOREO_REQUEST_MAX)
+  return false;
+R.Payload.resize(header.Length + 1);
+if (!readAll(Conn, R.Payload.data(), header.Length))
+  return false;
+R.Payload[header.Length] = '\0';   // whatever the client sent, the last string ends
+
+char *p = R.Payload.data(), *end = p + header.Length;
+R.Cwd = p;
+p += strlen(p) + 1;
+R.Argv.push_back(const_cast<char*>(Argv0));
+for (uint32_t i = 0; i < header.Argc; ++i) {
+  if (p >= end)
+    return false;
+  R.Argv.push_back(p);
+  p += strlen(p) + 1;
+}
+R.Argv.push_back(nullptr);
+for (; p < end; p += strlen(p) + 1)
+  R.Env.push_back(p);
+return true;
+}
+
+// in the forked process: become the client's `choreo <args>` and never return
+[[noreturn]] static void runRequest(Request &R, int (*Driver)(int, char**)) {
+signal(SIGCHLD, SIG_DFL);
+signal(SIGINT, SIG_DFL);
+signal(SIGTERM, SIG_DFL);
+signal(SIGPIPE, SIG_DFL);
+for (int i = 0; i < 3; ++i)
+  if (dup2(R.Fds[i], i) < 0)
+    _exit(127);
+if (chdir(R.Cwd) != 0) {
+  fprintf(stderr, "choreo: %s: %s\n", R.Cwd, strerror(errno));
+  _exit(1);
+}
+clearenv();
+for (char *var : R.Env)
+  putenv(var);
+Verbosity = 0;   // the server's -v and codegen options are not the request's
+resetCodegenOptions();
+exit(Driver((int)R.Argv.size() - 1, R.Argv.data()));   // exit, not _exit: stdio and the echo buffer get flushed
+}
+
+static int32_t exitStatus(int Status) {
+return WIFEXITED(Status) ? WEXITSTATUS(Status) : 128 + WTERMSIG(Status);
+}
+
+//----------------------------------------------------------serveRequests
+int serveRequests(const std::string &SocketPath, unsigned Jobs, const char *Argv0,
+                  int (*Driver)(int argc, char **argv)) {
+unsigned maxRunning = hardware_concurrency(Jobs).compute_thread_count();
+if (!installSignals())
+  return 1;
+int listener = listenOn(SocketPath);
+if (listener < 0)
+  return 1;
+if (Verbosity >= 1)
+  fprintf(stderr, " [serve] listening on %s, up to %u requests at a time\n", SocketPath.c_str(), maxRunning);
+
+struct Running {
+  pid_t Pid;
+  int Conn;
+  PhaseTimer Timer;
+  bool Killed;
+};
+std::vector<Running> running;
+uint64_t served = 0;
+for (;;) {
+  if (Stopping) {
+    if (listener >= 0) {   // no new requests; the ones in flight still get their status
+      close(listener);
+      unlink(SocketPath.c_str());
+      listener = -1;
+    }
+    if (running.empty())
+      break;
+  }
+  // the signal pipe, the listener while there is room, and every connection: a client that
+  // hangs up is gone for good (it sends nothing after the request)
+  std::vector<pollfd> fds;
+  fds.push_back({ SignalPipe[0], POLLIN, 0 });
+  bool accepting = listener >= 0 && running.size() < maxRunning;
+  if (accepting)
+    fds.push_back({ listener, POLLIN, 0 });
+  std::vector<size_t> polled;   // fds[firstConn + k] is running[polled[k]]
+  size_t firstConn = fds.size();
+  for (size_t i = 0; i < running.size(); ++i) {
+    if (running[i].Killed)
+      continue;
+    fds.push_back({ running[i].Conn, POLLIN, 0 });
+    polled.push_back(i);
+  }
+  if (poll(fds.data(), fds.size(), -1) < 0) {
+    if (errno == EINTR)
+      continue;
+    perror("--serve: poll");
+    break;
+  }
+
+  if (fds[0].revents) {
+    char drain[64];
+    while (read(SignalPipe[0], drain, sizeof drain) > 0) {}
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      for (size_t i = 0; i < running.size(); ++i) {
+        if (running[i].Pid != pid)
+          continue;
+        int32_t code = exitStatus(status);
+        (void)!send(running[i].Conn, &code, sizeof code, MSG_NOSIGNAL);
+        close(running[i].Conn);
+        if (Verbosity >= 1)
+          fprintf(stderr, " [serve] request %d: status %d in %.1f ms\n", (int)pid, (int)code, running[i].Timer.wallMs());
+        running.erase(running.begin() + i);
+        ++served;
+        break;
+      }
+    }
+    continue;   // the connection slots have moved
+  }
+  for (size_t k = 0; k < polled.size(); ++k) {
+    Running &r = running[polled[k]];
+    if (fds[firstConn + k].revents) {
+      kill(r.Pid, SIGKILL);   // reaped (and reported to nobody) above
+      r.Killed = true;
+    }
+  }
+  if (!accepting || !fds[1].revents)
+    continue;
+
+  int conn = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+  if (conn < 0)
+    continue;
+  timeval timeout = { 5, 0 };   // a local client sends its request at once
+  setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+  Request request;
+  PhaseTimer timer;
+  if (!receiveRequest(conn, Argv0, request)) {
+    close(conn);
+    continue;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(listener);
+    close(SignalPipe[0]);
+    close(SignalPipe[1]);
+    for (const Running &r : running)
+      close(r.Conn);
+    close(conn);
+    runRequest(request, Driver);
+  }
+  if (pid < 0) {
+    fprintf(stderr, "--serve: fork: %s\n", strerror(errno));
+    int32_t code = 70;   // EX_SOFTWARE
+    (void)!send(conn, &code, sizeof code, MSG_NOSIGNAL);
+    close(conn);
+    continue;
+  }
+  running.push_back({ pid, conn, timer, false });
+}
+if (Verbosity >= 1)
+  fprintf(stderr, " [serve] stopped after %llu requests\n", (unsigned long long)served);
+return 0;
+}
@@ -0,0 +1,52 @@
+/* server.h -- choreo --serve and its thin client (choreoc.c, plain C: no LLVM to load)
+
+   One request per connection, on a Unix stream socket:
+     client -> server  a ChoreoRequest header, sent with SCM_RIGHTS carrying the client's
+                       fds 0, 1 and 2, then Length bytes of NUL-terminated strings:
+                       the working directory, Argc arguments (without argv[0]) and the
+                       environment, one VAR=value per string
+     server -> client  the exit status as an int32_t once the compilation is over
+   The request runs with the client's stdin / stdout / stderr, directory and environment, so
+   it behaves like `choreo <args>` run by the client itself. Closing the connection early
+   (the client was interrupted) kills the request. */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CHOREO_REQUEST_MAGIC 0x43485231u   /* "CHR1" */
+#define CHOREO_REQUEST_MAX   (64u << 20)   /* payload bytes */
+
+struct ChoreoRequest {
+  uint32_t Magic;
+  uint32_t Argc;
+  uint32_t Length;
+};
+
+/* $CHOREO_SERVER, else $XDG_RUNTIME_DIR/choreo.sock, else /tmp/choreo-<uid>.sock;
+   0 if the path does not fit a sockaddr_un */
+static inline int choreo_server_socket(char *Buf, size_t Size) {
+  const char *env = getenv("CHOREO_SERVER");
+  const char *runtime = getenv("XDG_RUNTIME_DIR");
+  int n;
+  if (env && *env)
+    n = snprintf(Buf, Size, "%s", env);
+  else if (runtime && *runtime)
+    n = snprintf(Buf, Size, "%s/choreo.sock", runtime);
+  else
+    n = snprintf(Buf, Size, "/tmp/choreo-%u.sock", (unsigned)getuid());
+  return n > 0 && (size_t)n < Size && (size_t)n < 108;   /* sizeof(sockaddr_un::sun_path) */
+}
+
+#ifdef __cplusplus
+#include <string>
+
+/* --serve: listen on SocketPath and run each request as Driver(argc, argv) in a process forked
+   from this one, which has LLVM loaded and warmed up already; at most Jobs of them at a time
+   (0 = one per core). Argv0 replaces the client's argv[0]. Runs until SIGINT / SIGTERM, then
+   waits for the requests in flight; returns the exit status of the server. */
+int serveRequests(const std::string &SocketPath, unsigned Jobs, const char *Argv0,
+                  int (*Driver)(int argc, char **argv));
+#endif
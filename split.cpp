@@ -0,0 +1,233 @@
+#include "split.h"
+#include "ast.h"
+#include "compilation.h"
+#include "stats.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+using namespace llvm;
+
+//----------------------------------------------------------planning
+// where labels and jumps are: what decides the places main may be cut at
+struct ProgramShape {
+  std::vector<size_t> Weight;                  // top-level statement -> statements in it (REPEAT bodies too)
+  std::vector<size_t> LabelTop;                // label slot -> the top-level statement it is (in)
+  std::vector<bool> LabelNested;               // ... inside a REPEAT body
+  std::vector<std::pair<size_t, int>> Jumps;   // (top-level statement, label slot) per MOVE TO / SPIN
+};
+
+// statements in Stmt; its labels and jumps go into S as part of top-level statement Top
+static size_t scan(ASTNode *Stmt, size_t Top, bool Nested, ProgramShape &S) {
+if (auto *lbl = dynamic_cast<Label*>(Stmt)) {
+  if (lbl->Slot >= 0) {
+    S.LabelTop[lbl->Slot] = Top;
+    S.LabelNested[lbl->Slot] = Nested;
+  }
+} else if (auto *jump = dynamic_cast<Jump*>(Stmt)) {
+  if (jump->Slot >= 0)
+    S.Jumps.push_back({ Top, jump->Slot });
+} else if (auto *spin = dynamic_cast<IfStmt*>(Stmt)) {
+  if (spin->target() >= 0)
+    S.Jumps.push_back({ Top, spin->target() });
+} else if (auto *loop = dynamic_cast<Repeat*>(Stmt)) {
+  size_t n = 1;
+  for (ASTNode *stmt : loop->Body)
+    n += scan(stmt, Top, true, S);
+  return n;
+}
+return 1;
+}
+
+// the first top-level statement of every segment (just 0: not worth splitting)
+static std::vector<size_t> planSegments(Compilation &C, const ProgramShape &S, size_t SegmentSize) {
+const std::vector<ASTNode*> &program = *C.Program;
+size_t total = 0;
+for (size_t w : S.Weight)
+  total += w;
+std::vector<size_t> starts{ 0 };
+if (SegmentSize == 0 || total < 2 * SegmentSize)
+  return starts;
+
+// a jump into a REPEAT body needs the loop in its own function: no cut between the two
+std::vector<int> blocked(program.size() + 1, 0);   // difference array over "cut before statement i"
+for (const std::pair<size_t, int> &j : S.Jumps) {
+  size_t at = S.LabelTop[j.second];
+  if (!S.LabelNested[j.second] || at == j.first)
+    continue;
+  ++blocked[std::min(at, j.first) + 1];
+  --blocked[std::max(at, j.first) + 1];
+}
+size_t weight = 0;
+int open = 0;
+for (size_t i = 0; i < program.size(); ++i) {
+  open += blocked[i];
+  bool boundary = dynamic_cast<Label*>(program[i]) || dynamic_cast<Repeat*>(program[i]);
+  if (i > starts.back() && open == 0 && weight >= SegmentSize && (boundary || weight >= 2 * SegmentSize)) {
+    starts.push_back(i);
+    weight = 0;
+  }
+  weight += S.Weight[i];
+}
+return starts;
+}
+
+//----------------------------------------------------------segments
+// the program-wide state of the segments
+struct SplitProgram {
+  Module &M;
+  std::vector<GlobalVariable*> Globals;   // variable slot -> where it lives between segments
+  std::vector<bool> Entered;              // label slot -> some other segment jumps to it
+  explicit SplitProgram(Module &M) : M(M) {}
+};
+
+struct SplitSegment {
+  SplitProgram &P;
+  Function *F;
+  SwitchInst *Entry;          // entry: the stack copies are read in right before it
+  BasicBlock *Leave;          // every return goes through here, the copies are written back
+  PHINode *Next;              // ... with the entry main calls next
+  std::vector<int> Vars;      // variable slots with a stack copy here
+  std::vector<int> Labels;    // label slots with a block here (own labels and exits)
+  SplitSegment(SplitProgram &P, Function *F) : P(P), F(F) {}
+};
+
+AllocaInst *segmentVariable(Compilation &C, int Slot, StringRef Name) {
+SplitSegment &S = *C.Segment;
+Type *ty = isIntegerVar(Slot) ? Type::getInt64Ty(S.F->getContext()) : Type::getDoubleTy(S.F->getContext());
+std::string name = Name.empty() ? "var" + std::to_string(Slot) : Name.str();   // PARALLEL loops know no names
+GlobalVariable *&global = S.P.Globals[Slot];
+if (!global)
+  global = new GlobalVariable(S.P.M, ty, /*isConstant=*/false, GlobalValue::InternalLinkage,
+                              Constant::getNullValue(ty), "var." + name);
+IRBuilder<> entry(&S.F->getEntryBlock(), S.F->getEntryBlock().begin());
+S.Vars.push_back(Slot);
+return entry.CreateAlloca(ty, nullptr, name);
+}
+
+BasicBlock *segmentExit(Compilation &C, int LabelSlot) {
+SplitSegment &S = *C.Segment;
+BasicBlock *exit = BasicBlock::Create(S.F->getContext(), "to." + C.LabelNames[LabelSlot], S.F);
+BranchInst::Create(S.Leave, exit);
+S.Next->addIncoming(ConstantInt::get(S.Next->getType(), LabelSlot), exit);
+S.Labels.push_back(LabelSlot);
+S.P.Entered[LabelSlot] = true;
+return exit;
+}
+
+// statements [Begin, End) of C.Program as function F; Home gets the blocks of its labels
+static void codegenSegment(Compilation &C, SplitSegment &S, size_t Begin, size_t End, const ProgramShape &Shape,
+                           unsigned Next, IRBuilder<> &Builder, std::vector<BasicBlock*> &Home) {
+LLVMContext &ctx = S.F->getContext();
+Type *i32 = Builder.getInt32Ty();
+Argument *entry = S.F->getArg(0);
+entry->setName("at");
+BasicBlock *entryBB = BasicBlock::Create(ctx, "entry", S.F);
+BasicBlock *startBB = BasicBlock::Create(ctx, "start", S.F);
+S.Entry = SwitchInst::Create(entry, startBB, 0, entryBB);
+S.Leave = BasicBlock::Create(ctx, "leave", S.F);
+S.Next = PHINode::Create(i32, 2, "next", S.Leave);
+ReturnInst::Create(ctx, S.Next, S.Leave);
+for (size_t l = 0; l < Shape.LabelTop.size(); ++l) {
+  if (Shape.LabelTop[l] < Begin || Shape.LabelTop[l] >= End)
+    continue;
+  Home[l] = C.LabelSlots[l] = BasicBlock::Create(ctx, C.LabelNames[l], S.F);
+  S.Labels.push_back(l);
+}
+
+Builder.SetInsertPoint(startBB);
+C.Segment = &S;
+for (size_t i = Begin; i < End; ++i)
+  (*C.Program)[i]->codegen(ctx, Builder, &S.P.M);
+C.Segment = nullptr;
+if (!Builder.GetInsertBlock()->getTerminator()) {
+  S.Next->addIncoming(ConstantInt::get(i32, Next), Builder.GetInsertBlock());
+  Builder.CreateBr(S.Leave);
+}
+S.Leave->moveAfter(&S.F->back());
+
+// only the variables the segment uses go in and out
+IRBuilder<> in(S.Entry), out(S.Leave->getTerminator());
+for (int v : S.Vars) {
+  AllocaInst *slot = C.VarSlots[v];
+  Type *ty = slot->getAllocatedType();
+  GlobalVariable *global = S.P.Globals[v];
+  in.CreateStore(in.CreateLoad(ty, global), slot);
+  out.CreateStore(out.CreateLoad(ty, slot), global);
+  C.VarSlots[v] = nullptr;
+}
+for (int l : S.Labels)
+  C.LabelSlots[l] = nullptr;
+}
+
+//----------------------------------------------------------codegenProgram
+unsigned codegenProgram(Compilation &C, Function *Main, IRBuilder<> &Builder, unsigned SegmentSize) {
+const std::vector<ASTNode*> &program = *C.Program;
+size_t numLabels = C.LabelNames.size();
+ProgramShape shape;
+shape.LabelTop.assign(numLabels, 0);
+shape.LabelNested.assign(numLabels, false);
+for (size_t i = 0; i < program.size(); ++i)
+  shape.Weight.push_back(scan(program[i], i, false, shape));
+std::vector<size_t> starts = planSegments(C, shape, SegmentSize);
+if (starts.size() == 1) {
+  createLabelBlocks(C, Main);
+  for (ASTNode *stmt : program)
+    stmt->codegen(Main->getContext(), Builder, Main->getParent());
+  return 1;
+}
+
+// the segments, in program order
+Module &M = *Main->getParent();
+SplitProgram P(M);
+P.Globals.assign(C.VarSlots.size(), nullptr);
+P.Entered.assign(numLabels, false);
+BasicBlock *mainEntry = Builder.GetInsertBlock();
+Type *i32 = Builder.getInt32Ty();
+FunctionType *segmentTy = FunctionType::get(i32, { i32 }, false);
+std::vector<BasicBlock*> home(numLabels, nullptr);
+std::vector<std::unique_ptr<SplitSegment>> segments;
+for (size_t k = 0; k < starts.size(); ++k) {
+  Function *F = Function::Create(segmentTy, GlobalValue::InternalLinkage, Main->getName() + "." + Twine(k), &M);
+  F->addFnAttr(Attribute::NoInline);   // inlined back into main they would be one function again
+  segments.emplace_back(new SplitSegment(P, F));
+  size_t end = k + 1 < starts.size() ? starts[k + 1] : program.size();
+  codegenSegment(C, *segments.back(), starts[k], end, shape, numLabels + k + 1, Builder, home);
+}
+
+// main: call the segment the next entry is in until one falls off the end of the program
+LLVMContext &ctx = M.getContext();
+Builder.SetInsertPoint(mainEntry);
+AllocaInst *next = Builder.CreateAlloca(i32, nullptr, "next");
+Builder.CreateStore(Builder.getInt32(numLabels), next);
+BasicBlock *dispatchBB = BasicBlock::Create(ctx, "dispatch", Main);
+BasicBlock *doneBB = BasicBlock::Create(ctx, "done", Main);
+Builder.CreateBr(dispatchBB);
+Builder.SetInsertPoint(dispatchBB);
+Value *entry = Builder.CreateLoad(i32, next, "at");
+SwitchInst *dispatch = Builder.CreateSwitch(entry, doneBB, segments.size());
+std::vector<BasicBlock*> calls;
+for (size_t k = 0; k < segments.size(); ++k) {
+  BasicBlock *callBB = BasicBlock::Create(ctx, "call." + Twine(k), Main, doneBB);
+  Builder.SetInsertPoint(callBB);
+  Builder.CreateStore(Builder.CreateCall(segments[k]->F, { entry }), next);
+  Builder.CreateBr(dispatchBB);
+  dispatch->addCase(Builder.getInt32(numLabels + k), callBB);
+  calls.push_back(callBB);
+}
+for (size_t l = 0; l < numLabels; ++l) {
+  if (!P.Entered[l])
+    continue;
+  size_t k = std::upper_bound(starts.begin(), starts.end(), shape.LabelTop[l]) - starts.begin() - 1;
+  segments[k]->Entry->addCase(Builder.getInt32(l), home[l]);
+  dispatch->addCase(Builder.getInt32(l), calls[k]);
+}
+Builder.SetInsertPoint(doneBB);
+if (Verbosity >= 1)
+  fprintf(stderr, " [split] main: %zu top-level statements in %zu functions\n", program.size(), segments.size());
+return segments.size();
+}
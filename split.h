@@ -0,0 +1,35 @@
+// split.h
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+
+struct Compilation;
+struct SplitSegment;   // split.cpp: the segment function being generated
+
+// --split=<n>: the optimizer and the backend are worse than linear in the size of a function,
+// and one function is lowered by one thread, so a program of many thousand top-level statements
+// is not generated as one main() but cut into segments of about n statements (those in REPEAT
+// bodies count too), preferably right before a top-level label or REPEAT. Each segment is a
+// function `i32 main.<k>(i32 entry)` and main only dispatches between them:
+//   entry  a segment starts at its first statement (entry NumLabels + k) or at one of its
+//          top-level labels a jump of another segment goes to (entry = the label slot)
+//   return a jump to a label of another segment returns that label's slot; falling off the end
+//          returns the start of the next segment (past the last one main goes on to its return)
+// Variables live in globals between the segments; a segment works on stack copies of the ones
+// it uses (read on entry, written back on return), so they still become registers. A jump into
+// a REPEAT body is never cut off from that loop.
+// Generates C.Program into Main, whose entry block Builder is in, and leaves Builder where the
+// program ends like generating it straight into Main does (which is what a program of less than
+// 2 * SegmentSize statements gets, and any program when SegmentSize is 0). Returns the number of
+// functions main became (1: not split).
+unsigned codegenProgram(Compilation &C, llvm::Function *Main, llvm::IRBuilder<> &Builder,
+                        unsigned SegmentSize);
+
+// for ast.cpp while C.Segment is set: the segment's stack copy of variable slot Slot, and for a
+// label of another segment a block that returns to main's dispatcher with the label's entry
+llvm::AllocaInst *segmentVariable(Compilation &C, int Slot, llvm::StringRef Name);
+llvm::BasicBlock *segmentExit(Compilation &C, int LabelSlot);
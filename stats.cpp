@@ -0,0 +1,107 @@
+#include "stats.h"
+#include <ctime>
+#include <llvm/Support/JSON.h>
+using namespace llvm;
+
+unsigned Verbosity = 0;
+
+static double nowMs(clockid_t Clock) {
+struct timespec ts;
+clock_gettime(Clock, &ts);
+return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// thread CPU time, not process: batch mode runs several compilations at once
+void PhaseTimer::restart() {
+StartWall = nowMs(CLOCK_MONOTONIC);
+StartCpu = nowMs(CLOCK_THREAD_CPUTIME_ID);
+}
+double PhaseTimer::wallMs() const { return nowMs(CLOCK_MONOTONIC) - StartWall; }
+double PhaseTimer::cpuMs() const { return nowMs(CLOCK_THREAD_CPUTIME_ID) - StartCpu; }
+
+//----------------------------------------------------------text reports
+void printTimeReport(const CompileStats &S, FILE *Out) {
+double wall = 0, cpu = 0;
+for (const PhaseTime &p : S.Phases) {
+  wall += p.WallMs;
+  cpu += p.CpuMs;
+}
+fprintf(Out, "===-- time report: %s --===\n", S.Input.c_str());
+fprintf(Out, "  %-10s %12s %12s %7s\n", "phase", "wall ms", "cpu ms", "wall %");
+for (const PhaseTime &p : S.Phases)
+  fprintf(Out, "  %-10s %12.3f %12.3f %6.1f%%\n", p.Name, p.WallMs, p.CpuMs,
+          wall > 0 ? 100 * p.WallMs / wall : 0.0);
+fprintf(Out, "  %-10s %12.3f %12.3f\n", "total", wall, cpu);
+}
+
+void printStats(const CompileStats &S, FILE *Out) {
+size_t nodes = 0;
+for (auto &n : S.NodesByClass)
+  nodes += n.second;
+fprintf(Out, "===-- statistics: %s --===\n", S.Input.c_str());
+fprintf(Out, "  %-26s %10llu\n", "tokens", (unsigned long long)S.Tokens);
+fprintf(Out, "  %-26s %10zu  (%zu KiB)\n", "AST objects", nodes, S.ASTBytes / 1024);
+for (auto &n : S.NodesByClass)
+  fprintf(Out, "    %-24s %10zu\n", n.first.c_str(), n.second);
+fprintf(Out, "  %-26s %10zu -> %zu\n", "basic blocks (-> opt)", S.BasicBlocks, S.BasicBlocksOpt);
+fprintf(Out, "  %-26s %10zu -> %zu\n", "IR instructions (-> opt)", S.IRInstructions, S.IRInstructionsOpt);
+if (S.MainFunctions > 1)
+  fprintf(Out, "  %-26s %10u\n", "main split into functions", S.MainFunctions);
+if (S.Cache) {
+  fprintf(Out, "  %-26s %10s\n", "cache", S.Cache);
+  fprintf(Out, "  %-26s %10llu / %llu / %llu\n", "cache hits/misses/evicted", (unsigned long long)S.CacheHits,
+          (unsigned long long)S.CacheMisses, (unsigned long long)S.CacheEvictions);
+  fprintf(Out, "  %-26s %10llu  (%llu KiB)\n", "cache entries", (unsigned long long)S.CacheEntries,
+          (unsigned long long)S.CacheBytes / 1024);
+}
+}
+
+//----------------------------------------------------------JSON
+void writeStatsJSON(const std::vector<const CompileStats*> &All, raw_ostream &OS) {
+json::OStream J(OS, 2);
+J.object([&] {
+  J.attributeArray("compilations", [&] {
+    for (const CompileStats *S : All) {
+      J.object([&] {
+        J.attribute("input", S->Input);
+        double wall = 0, cpu = 0;
+        J.attributeObject("phases", [&] {
+          for (const PhaseTime &p : S->Phases) {
+            wall += p.WallMs;
+            cpu += p.CpuMs;
+            J.attributeObject(p.Name, [&] {
+              J.attribute("wall_ms", p.WallMs);
+              J.attribute("cpu_ms", p.CpuMs);
+            });
+          }
+        });
+        J.attributeObject("total", [&] {
+          J.attribute("wall_ms", wall);
+          J.attribute("cpu_ms", cpu);
+        });
+        J.attribute("tokens", (int64_t)S->Tokens);
+        J.attributeObject("ast_nodes", [&] {
+          for (auto &n : S->NodesByClass)
+            J.attribute(n.first, (int64_t)n.second);
+        });
+        J.attribute("ast_bytes", (int64_t)S->ASTBytes);
+        J.attribute("basic_blocks", (int64_t)S->BasicBlocks);
+        J.attribute("basic_blocks_optimized", (int64_t)S->BasicBlocksOpt);
+        J.attribute("ir_instructions", (int64_t)S->IRInstructions);
+        J.attribute("ir_instructions_optimized", (int64_t)S->IRInstructionsOpt);
+        J.attribute("main_functions", (int64_t)S->MainFunctions);
+        if (S->Cache)
+          J.attributeObject("cache", [&] {
+            J.attribute("result", S->Cache);
+            J.attribute("hits", (int64_t)S->CacheHits);
+            J.attribute("misses", (int64_t)S->CacheMisses);
+            J.attribute("evictions", (int64_t)S->CacheEvictions);
+            J.attribute("entries", (int64_t)S->CacheEntries);
+            J.attribute("bytes", (int64_t)S->CacheBytes);
+          });
+      });
+    }
+  });
+});
+OS << "\n";
+}
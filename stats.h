@@ -0,0 +1,52 @@
+// stats.h
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include "llvm/Support/raw_ostream.h"
+
+// -v / -vv: 0 = quiet (default), 1 = driver traces ([main], [opt], [time], [batch]),
+// 2 = also one line per parsed statement and per generated SPIN
+extern unsigned Verbosity;
+
+// Wall time and CPU time of the calling thread since construction / restart()
+class PhaseTimer {
+  double StartWall, StartCpu;
+public:
+  PhaseTimer() { restart(); }
+  void restart();
+  double wallMs() const;
+  double cpuMs() const;
+};
+
+struct PhaseTime {
+  const char *Name;
+  double WallMs, CpuMs;
+};
+
+// What --time-report / --stats / --stats-json report for one compilation
+struct CompileStats {
+  std::string Input;
+  std::vector<PhaseTime> Phases;                               // in the order they ran
+  uint64_t Tokens = 0;
+  std::vector<std::pair<std::string, size_t>> NodesByClass;    // AST objects per class
+  size_t ASTBytes = 0;                                         // arena bytes used by the AST (most at once with --stream)
+  size_t BasicBlocks = 0, IRInstructions = 0;                  // right after codegen
+  size_t BasicBlocksOpt = 0, IRInstructionsOpt = 0;            // after the -O pipeline
+  unsigned MainFunctions = 1;                                  // --split: the functions main was cut into
+  const char *Cache = nullptr;                                 // --cache: "hit" / "miss"
+  uint64_t CacheHits = 0, CacheMisses = 0, CacheEvictions = 0; // cumulative, every process using the cache
+  uint64_t CacheEntries = 0, CacheBytes = 0;                   // on disk afterwards
+
+  void addPhase(const char *Name, const PhaseTimer &T) { Phases.push_back({ Name, T.wallMs(), T.cpuMs() }); }
+  void addPhase(const char *Name, double WallMs, double CpuMs) { Phases.push_back({ Name, WallMs, CpuMs }); }
+};
+
+// human readable tables (stderr in the driver)
+void printTimeReport(const CompileStats &S, FILE *Out);
+void printStats(const CompileStats &S, FILE *Out);
+// {"compilations": [ {...}, ... ]}, one entry per input file, for dashboards
+void writeStatsJSON(const std::vector<const CompileStats*> &All, llvm::raw_ostream &OS);